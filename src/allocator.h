@@ -0,0 +1,242 @@
+#ifndef TS_STL_ALLOCATOR_H_
+#define TS_STL_ALLOCATOR_H_
+
+#include "src/utils.h"
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace ts_stl {
+
+// Whether A can drop all of its memory at once, see PoolAllocator
+template <typename A, typename = void> struct has_release : std::false_type {};
+
+template <typename A>
+struct has_release<A, std::void_t<decltype(std::declval<A &>().Release()),
+                                  decltype(std::declval<A &>().Unique())>>
+    : std::true_type {};
+
+// Single objects of one size, carved from chunks that double in size up to
+// kMaxChunk objects, so objects allocated together sit together. Freed ones
+// go onto a free list that is used first, Release() frees every chunk at
+// once. Not thread safe.
+class ObjectPool {
+public:
+  using size_type = std::size_t;
+
+  static constexpr size_type kMinChunk = 32;
+
+  static constexpr size_type kMaxChunk = 8192;
+
+private:
+  // A free slot holds the next free one, the first slot of every chunk links
+  // to the previous chunk
+  struct Slot {
+    Slot *next;
+  };
+
+  // A multiple of the object alignment, room for a Slot
+  const size_type slot_size_;
+
+  Slot *chunks_ = nullptr;
+
+  Slot *free_ = nullptr;
+
+  // Unused part of the newest chunk
+  char *next_ = nullptr;
+
+  char *end_ = nullptr;
+
+  size_type chunk_size_ = kMinChunk;
+
+public:
+  // The next pool of the same ObjectPools
+  ObjectPool *next_pool = nullptr;
+
+  explicit ObjectPool(size_type slot_size) : slot_size_(slot_size) {}
+
+  ObjectPool(const ObjectPool &) = delete;
+
+  ~ObjectPool() { Release(); }
+
+  auto operator=(const ObjectPool &) -> ObjectPool & = delete;
+
+  auto slot_size() const -> size_type { return slot_size_; }
+
+  auto Allocate() -> void * {
+    if (Slot *slot = free_) {
+      free_ = slot->next;
+      return slot;
+    }
+    if (next_ == end_) {
+      char *chunk = new char[(chunk_size_ + 1) * slot_size_];
+      reinterpret_cast<Slot *>(chunk)->next = chunks_;
+      chunks_ = reinterpret_cast<Slot *>(chunk);
+      next_ = chunk + slot_size_;
+      end_ = next_ + chunk_size_ * slot_size_;
+      chunk_size_ = Min(chunk_size_ * 2, kMaxChunk);
+    }
+    void *slot = next_;
+    next_ += slot_size_;
+    return slot;
+  }
+
+  void Deallocate(void *p) {
+    Slot *slot = static_cast<Slot *>(p);
+    slot->next = free_;
+    free_ = slot;
+  }
+
+  void Release() {
+    while (chunks_) {
+      Slot *chunk = chunks_;
+      chunks_ = chunk->next;
+      delete[] reinterpret_cast<char *>(chunk);
+    }
+    free_ = nullptr;
+    next_ = end_ = nullptr;
+    chunk_size_ = kMinChunk;
+  }
+};
+
+// The pools of a PoolAllocator family, one per object size
+class ObjectPools {
+private:
+  ObjectPool *first_ = nullptr;
+
+public:
+  ObjectPools() = default;
+
+  ObjectPools(const ObjectPools &) = delete;
+
+  ~ObjectPools() {
+    while (first_) {
+      ObjectPool *pool = first_;
+      first_ = pool->next_pool;
+      delete pool;
+    }
+  }
+
+  auto operator=(const ObjectPools &) -> ObjectPools & = delete;
+
+  auto Get(std::size_t slot_size) -> ObjectPool * {
+    for (ObjectPool *pool = first_; pool; pool = pool->next_pool) {
+      if (pool->slot_size() == slot_size) {
+        return pool;
+      }
+    }
+    ObjectPool *pool = new ObjectPool(slot_size);
+    pool->next_pool = first_;
+    first_ = pool;
+    return pool;
+  }
+};
+
+// Allocator for the nodes of Map. Single objects come from an ObjectPool,
+// arrays go to std::allocator. Every allocator created by the default
+// constructor starts a family; its copies and rebound copies join it and
+// compare equal, and each object size of the family has one pool. A
+// container copy starts a new family. Not thread safe, copies included.
+template <typename T> class PoolAllocator {
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using propagate_on_container_move_assignment = std::true_type;
+
+  template <typename U> struct rebind {
+    using other = PoolAllocator<U>;
+  };
+
+private:
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "PoolAllocator does not support over-aligned types.");
+
+  static constexpr size_type kSlotSize =
+      ((sizeof(T) > sizeof(void *) ? sizeof(T) : sizeof(void *)) +
+       alignof(T) - 1) /
+      alignof(T) * alignof(T);
+
+  // Null only in a moved-from allocator, which starts a new family when it
+  // allocates again
+  std::shared_ptr<ObjectPools> pools_;
+
+  // The pool of T in pools_
+  ObjectPool *pool_ = nullptr;
+
+  template <typename U> friend class PoolAllocator;
+
+  void Join(std::shared_ptr<ObjectPools> pools) {
+    pools_ = std::move(pools);
+    pool_ = pools_ ? pools_->Get(kSlotSize) : nullptr;
+  }
+
+public:
+  PoolAllocator() { Join(std::make_shared<ObjectPools>()); }
+
+  PoolAllocator(const PoolAllocator &) = default;
+
+  PoolAllocator(PoolAllocator &&other) noexcept
+      : pools_(std::move(other.pools_)),
+        pool_(std::exchange(other.pool_, nullptr)) {}
+
+  template <typename U> PoolAllocator(const PoolAllocator<U> &other) {
+    Join(other.pools_);
+  }
+
+  auto operator=(const PoolAllocator &) -> PoolAllocator & = default;
+
+  auto operator=(PoolAllocator &&other) noexcept -> PoolAllocator & {
+    pools_ = std::move(other.pools_);
+    pool_ = std::exchange(other.pool_, nullptr);
+    return *this;
+  }
+
+  auto allocate(size_type n) -> T * {
+    if (n != 1) {
+      return std::allocator<T>().allocate(n);
+    }
+    if (!pool_) {
+      Join(std::make_shared<ObjectPools>());
+    }
+    return static_cast<T *>(pool_->Allocate());
+  }
+
+  void deallocate(T *p, size_type n) {
+    if (n != 1) {
+      std::allocator<T>().deallocate(p, n);
+      return;
+    }
+    pool_->Deallocate(p);
+  }
+
+  auto select_on_container_copy_construction() const -> PoolAllocator {
+    return PoolAllocator();
+  }
+
+  // Whether no other allocator is in the family, so Release() frees only
+  // what this allocator handed out
+  auto Unique() const -> bool { return !pools_ || pools_.use_count() == 1; }
+
+  // Frees every object of T at once without destroying it
+  void Release() {
+    if (pool_) {
+      pool_->Release();
+    }
+  }
+
+  template <typename U>
+  auto operator==(const PoolAllocator<U> &other) const -> bool {
+    return pools_ == other.pools_;
+  }
+
+  template <typename U>
+  auto operator!=(const PoolAllocator<U> &other) const -> bool {
+    return pools_ != other.pools_;
+  }
+};
+
+} // namespace ts_stl
+
+#endif
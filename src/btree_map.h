@@ -0,0 +1,868 @@
+#ifndef TS_STL_BTREE_MAP_H_
+#define TS_STL_BTREE_MAP_H_
+
+#include "src/sync.h"
+#include "src/utils.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace ts_stl {
+
+// Ordered map as a B+-tree. Inner nodes hold separator keys and children,
+// leaves hold the entries, keys apart from values so that a search within a
+// node only reads keys. Nodes take 16 to 64 keys, a few cache lines of them,
+// so a lookup touches a handful of nodes instead of one per level of a binary
+// tree. Leaves are linked both ways, iterators walk them without going back
+// up the tree. Keys and values must be default constructible. Inserts and
+// deletes invalidate iterators.
+template <typename K, typename V, typename Compare = std::less<K>>
+class BTreeMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using key_compare = Compare;
+  using reference = value_type &;
+  using const_reference = const value_type &;
+
+private:
+  static constexpr auto Slots(size_type bytes, size_type entry) -> size_type {
+    return bytes / entry < 16 ? 16 : bytes / entry > 64 ? 64 : bytes / entry;
+  }
+
+  // About 256 bytes of keys per inner node and 512 bytes of entries per leaf
+  static constexpr size_type kInnerSlots = Slots(256, sizeof(key_type));
+
+  static constexpr size_type kLeafSlots =
+      Slots(512, sizeof(key_type) + sizeof(value_type));
+
+  // Fewest keys a node other than the root keeps, a split leaves at least
+  // this many on both sides
+  static constexpr size_type kMinInner = (kInnerSlots - 1) / 2;
+
+  static constexpr size_type kMinLeaf = kLeafSlots / 2;
+
+  struct alignas(kCacheLineSize) NodeBase {
+    size_type count = 0;
+
+    const bool leaf;
+
+    explicit NodeBase(bool is_leaf) : leaf(is_leaf) {}
+  };
+
+  struct Inner : NodeBase {
+    // Every key of children[i] is less than keys[i], every key of
+    // children[i + 1] is not
+    key_type keys[kInnerSlots];
+
+    NodeBase *children[kInnerSlots + 1];
+
+    Inner() : NodeBase(false) {}
+  };
+
+  struct Leaf : NodeBase {
+    Leaf *prev = nullptr;
+
+    Leaf *next = nullptr;
+
+    key_type keys[kLeafSlots];
+
+    value_type values[kLeafSlots];
+
+    Leaf() : NodeBase(true) {}
+  };
+
+  // An entry, leaf is nullptr for end()
+  struct Position {
+    Leaf *leaf;
+
+    size_type slot;
+  };
+
+  NodeBase *root_ = nullptr;
+
+  Leaf *first_ = nullptr;
+
+  Leaf *last_ = nullptr;
+
+  size_type size_ = 0;
+
+public:
+  class iterator {
+  private:
+    BTreeMap *map_;
+
+    Leaf *leaf_;
+
+    size_type slot_;
+
+  public:
+    iterator() = delete;
+
+    iterator(BTreeMap *map, Position position)
+        : map_(map), leaf_(position.leaf), slot_(position.slot) {}
+
+    iterator(const iterator &) = default;
+
+    iterator(iterator &&) = default;
+
+    ~iterator() = default;
+
+    auto operator=(const iterator &) -> iterator & = default;
+
+    auto operator=(iterator &&) -> iterator & = default;
+
+    auto operator++() -> iterator & {
+      Position p = map_->Next({leaf_, slot_});
+      leaf_ = p.leaf, slot_ = p.slot;
+      return *this;
+    }
+
+    auto operator++(int) -> iterator {
+      iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    auto operator--() -> iterator & {
+      Position p = map_->Previous({leaf_, slot_});
+      leaf_ = p.leaf, slot_ = p.slot;
+      return *this;
+    }
+
+    auto operator--(int) -> iterator {
+      iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    auto operator*() -> std::pair<const key_type &, value_type &> {
+      Assert(leaf_, "BTreeMap::iterator::operator*(): Invalid iterator!");
+      return {leaf_->keys[slot_], leaf_->values[slot_]};
+    }
+
+    auto operator==(const iterator &other) const -> bool {
+      return map_ == other.map_ && leaf_ == other.leaf_ &&
+             slot_ == other.slot_;
+    }
+
+    auto operator!=(const iterator &other) const -> bool {
+      return !(*this == other);
+    }
+  };
+
+  class const_iterator {
+  private:
+    const BTreeMap *map_;
+
+    const Leaf *leaf_;
+
+    size_type slot_;
+
+  public:
+    const_iterator() = delete;
+
+    const_iterator(const BTreeMap *map, Position position)
+        : map_(map), leaf_(position.leaf), slot_(position.slot) {}
+
+    const_iterator(const const_iterator &) = default;
+
+    const_iterator(const_iterator &&) = default;
+
+    ~const_iterator() = default;
+
+    auto operator=(const const_iterator &) -> const_iterator & = default;
+
+    auto operator=(const_iterator &&) -> const_iterator & = default;
+
+    auto operator++() -> const_iterator & {
+      Position p = map_->Next({const_cast<Leaf *>(leaf_), slot_});
+      leaf_ = p.leaf, slot_ = p.slot;
+      return *this;
+    }
+
+    auto operator++(int) -> const_iterator {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    auto operator--() -> const_iterator & {
+      Position p = map_->Previous({const_cast<Leaf *>(leaf_), slot_});
+      leaf_ = p.leaf, slot_ = p.slot;
+      return *this;
+    }
+
+    auto operator--(int) -> const_iterator {
+      const_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    auto operator*() -> std::pair<const key_type &, const value_type &> {
+      Assert(leaf_,
+             "BTreeMap::const_iterator::operator*(): Invalid iterator!");
+      return {leaf_->keys[slot_], leaf_->values[slot_]};
+    }
+
+    auto operator==(const const_iterator &other) const -> bool {
+      return map_ == other.map_ && leaf_ == other.leaf_ &&
+             slot_ == other.slot_;
+    }
+
+    auto operator!=(const const_iterator &other) const -> bool {
+      return !(*this == other);
+    }
+  };
+
+private:
+  // Lookups by other key types need a transparent Compare
+  template <typename Q>
+  using transparent_key_t = std::enable_if_t<is_transparent<Compare>::value, Q>;
+
+  // First of count keys not less than key
+  template <typename Q>
+  static auto LowerBound(const key_type *keys, size_type count, const Q &key)
+      -> size_type {
+    size_type low = 0;
+    while (count > 0) {
+      size_type half = count / 2;
+      if (Compare()(keys[low + half], key)) {
+        low += half + 1;
+        count -= half + 1;
+      } else {
+        count = half;
+      }
+    }
+    return low;
+  }
+
+  // First of count keys greater than key
+  template <typename Q>
+  static auto UpperBound(const key_type *keys, size_type count, const Q &key)
+      -> size_type {
+    size_type low = 0;
+    while (count > 0) {
+      size_type half = count / 2;
+      if (!Compare()(key, keys[low + half])) {
+        low += half + 1;
+        count -= half + 1;
+      } else {
+        count = half;
+      }
+    }
+    return low;
+  }
+
+  // The leaf that key belongs in, keys equal to a separator go right
+  template <typename Q> auto FindLeaf(const Q &key) const -> Leaf * {
+    NodeBase *p = root_;
+    if (!p) {
+      return nullptr;
+    }
+    while (!p->leaf) {
+      Inner *inner = static_cast<Inner *>(p);
+      p = inner->children[UpperBound(inner->keys, inner->count, key)];
+    }
+    return static_cast<Leaf *>(p);
+  }
+
+  // Moves slot past the end of a leaf to the start of the next one
+  static auto Normalize(Leaf *leaf, size_type slot) -> Position {
+    if (slot < leaf->count) {
+      return {leaf, slot};
+    }
+    return {leaf->next, 0};
+  }
+
+  auto Next(Position p) const -> Position {
+    if (!p.leaf) {
+      return {first_, 0};
+    }
+    return Normalize(p.leaf, p.slot + 1);
+  }
+
+  auto Previous(Position p) const -> Position {
+    if (!p.leaf) {
+      return {last_, last_ ? last_->count - 1 : 0};
+    }
+    if (p.slot > 0) {
+      return {p.leaf, p.slot - 1};
+    }
+    Leaf *prev = p.leaf->prev;
+    return {prev, prev ? prev->count - 1 : 0};
+  }
+
+  template <typename Q> auto FindNode(const Q &key) const -> Position {
+    Leaf *leaf = FindLeaf(key);
+    if (!leaf) {
+      return {nullptr, 0};
+    }
+    size_type i = LowerBound(leaf->keys, leaf->count, key);
+    if (i < leaf->count && !Compare()(key, leaf->keys[i])) {
+      return {leaf, i};
+    }
+    return {nullptr, 0};
+  }
+
+  // Keys of the leaves before the one key belongs in are all less than it
+  template <typename Q> auto FindLNode(const Q &key) const -> Position {
+    Leaf *leaf = FindLeaf(key);
+    if (!leaf) {
+      return {nullptr, 0};
+    }
+    size_type i = LowerBound(leaf->keys, leaf->count, key);
+    return i > 0 ? Position{leaf, i - 1} : Previous({leaf, 0});
+  }
+
+  template <typename Q> auto FindLENode(const Q &key) const -> Position {
+    Leaf *leaf = FindLeaf(key);
+    if (!leaf) {
+      return {nullptr, 0};
+    }
+    size_type i = UpperBound(leaf->keys, leaf->count, key);
+    return i > 0 ? Position{leaf, i - 1} : Previous({leaf, 0});
+  }
+
+  template <typename Q> auto FindGNode(const Q &key) const -> Position {
+    Leaf *leaf = FindLeaf(key);
+    if (!leaf) {
+      return {nullptr, 0};
+    }
+    return Normalize(leaf, UpperBound(leaf->keys, leaf->count, key));
+  }
+
+  template <typename Q> auto FindGENode(const Q &key) const -> Position {
+    Leaf *leaf = FindLeaf(key);
+    if (!leaf) {
+      return {nullptr, 0};
+    }
+    return Normalize(leaf, LowerBound(leaf->keys, leaf->count, key));
+  }
+
+  // Inserts key into the leaf, or assigns its value if it is there and
+  // assign is set. A full leaf is split first, the new right half is
+  // returned and its smallest key stored in separator.
+  template <typename T>
+  auto InsertIntoLeaf(Leaf *leaf, const key_type &key, T &&value, bool assign,
+                      Position &position, key_type &separator) -> NodeBase * {
+    size_type i = LowerBound(leaf->keys, leaf->count, key);
+    if (i < leaf->count && !Compare()(key, leaf->keys[i])) {
+      if (assign) {
+        leaf->values[i] = std::forward<T>(value);
+      }
+      position = {leaf, i};
+      return nullptr;
+    }
+    Leaf *right = nullptr;
+    if (leaf->count == kLeafSlots) {
+      right = new Leaf;
+      size_type mid = kLeafSlots / 2;
+      Move(right->keys, leaf->keys + mid, leaf->keys + kLeafSlots);
+      Move(right->values, leaf->values + mid, leaf->values + kLeafSlots);
+      right->count = kLeafSlots - mid;
+      leaf->count = mid;
+      right->prev = leaf;
+      right->next = leaf->next;
+      (leaf->next ? leaf->next->prev : last_) = right;
+      leaf->next = right;
+      separator = right->keys[0];
+      if (i > mid) {
+        i -= mid;
+        leaf = right;
+      }
+    }
+    MoveBackward(leaf->keys + leaf->count + 1, leaf->keys + i,
+                 leaf->keys + leaf->count);
+    MoveBackward(leaf->values + leaf->count + 1, leaf->values + i,
+                 leaf->values + leaf->count);
+    leaf->keys[i] = key;
+    leaf->values[i] = std::forward<T>(value);
+    ++leaf->count;
+    ++size_;
+    position = {leaf, i};
+    return right;
+  }
+
+  // Puts child right of children[i], with separator between them
+  static void InsertChild(Inner *inner, size_type i, key_type &&separator,
+                          NodeBase *child) {
+    MoveBackward(inner->keys + inner->count + 1, inner->keys + i,
+                 inner->keys + inner->count);
+    std::copy_backward(inner->children + i + 1,
+                       inner->children + inner->count + 1,
+                       inner->children + inner->count + 2);
+    inner->keys[i] = std::move(separator);
+    inner->children[i + 1] = child;
+    ++inner->count;
+  }
+
+  // Same contract as InsertIntoLeaf for the subtree at p
+  template <typename T>
+  auto InsertInto(NodeBase *p, const key_type &key, T &&value, bool assign,
+                  Position &position, key_type &separator) -> NodeBase * {
+    if (p->leaf) {
+      return InsertIntoLeaf(static_cast<Leaf *>(p), key, std::forward<T>(value),
+                            assign, position, separator);
+    }
+    Inner *inner = static_cast<Inner *>(p);
+    size_type i = UpperBound(inner->keys, inner->count, key);
+    key_type child_separator;
+    NodeBase *child =
+        InsertInto(inner->children[i], key, std::forward<T>(value), assign,
+                   position, child_separator);
+    if (!child) {
+      return nullptr;
+    }
+    if (inner->count < kInnerSlots) {
+      InsertChild(inner, i, std::move(child_separator), child);
+      return nullptr;
+    }
+    // The middle key moves up, the keys right of it go to the new node
+    Inner *right = new Inner;
+    size_type mid = kInnerSlots / 2;
+    Move(right->keys, inner->keys + mid + 1, inner->keys + kInnerSlots);
+    std::copy(inner->children + mid + 1, inner->children + kInnerSlots + 1,
+              right->children);
+    right->count = kInnerSlots - mid - 1;
+    inner->count = mid;
+    separator = std::move(inner->keys[mid]);
+    if (i <= mid) {
+      InsertChild(inner, i, std::move(child_separator), child);
+    } else {
+      InsertChild(right, i - mid - 1, std::move(child_separator), child);
+    }
+    return right;
+  }
+
+  // Returns where key is, operator[] passes assign false to keep the value
+  template <typename T>
+  auto InsertImpl(const key_type &key, T &&value, bool assign) -> Position {
+    Position position{nullptr, 0};
+    if (!root_) {
+      root_ = first_ = last_ = new Leaf;
+    }
+    key_type separator;
+    NodeBase *right = InsertInto(root_, key, std::forward<T>(value), assign,
+                                 position, separator);
+    if (right) {
+      Inner *root = new Inner;
+      root->keys[0] = std::move(separator);
+      root->children[0] = root_;
+      root->children[1] = right;
+      root->count = 1;
+      root_ = root;
+    }
+    return position;
+  }
+
+  // Refills children[i] of parent, which fell below the minimum, from a
+  // sibling, or merges it with one
+  void Rebalance(Inner *parent, size_type i) {
+    NodeBase *left = i > 0 ? parent->children[i - 1] : nullptr;
+    NodeBase *right = i < parent->count ? parent->children[i + 1] : nullptr;
+    NodeBase *child = parent->children[i];
+    if (child->leaf) {
+      Leaf *leaf = static_cast<Leaf *>(child);
+      if (left && left->count > kMinLeaf) {
+        Leaf *from = static_cast<Leaf *>(left);
+        MoveBackward(leaf->keys + leaf->count + 1, leaf->keys,
+                     leaf->keys + leaf->count);
+        MoveBackward(leaf->values + leaf->count + 1, leaf->values,
+                     leaf->values + leaf->count);
+        --from->count;
+        leaf->keys[0] = std::move(from->keys[from->count]);
+        leaf->values[0] = std::move(from->values[from->count]);
+        ++leaf->count;
+        parent->keys[i - 1] = leaf->keys[0];
+      } else if (right && right->count > kMinLeaf) {
+        Leaf *from = static_cast<Leaf *>(right);
+        leaf->keys[leaf->count] = std::move(from->keys[0]);
+        leaf->values[leaf->count] = std::move(from->values[0]);
+        ++leaf->count;
+        Move(from->keys, from->keys + 1, from->keys + from->count);
+        Move(from->values, from->values + 1, from->values + from->count);
+        --from->count;
+        parent->keys[i] = from->keys[0];
+      } else if (left) {
+        MergeLeaves(parent, i - 1);
+      } else {
+        MergeLeaves(parent, i);
+      }
+      return;
+    }
+    Inner *inner = static_cast<Inner *>(child);
+    if (left && left->count > kMinInner) {
+      Inner *from = static_cast<Inner *>(left);
+      MoveBackward(inner->keys + inner->count + 1, inner->keys,
+                   inner->keys + inner->count);
+      std::copy_backward(inner->children, inner->children + inner->count + 1,
+                         inner->children + inner->count + 2);
+      inner->keys[0] = std::move(parent->keys[i - 1]);
+      inner->children[0] = from->children[from->count];
+      parent->keys[i - 1] = std::move(from->keys[from->count - 1]);
+      --from->count;
+      ++inner->count;
+    } else if (right && right->count > kMinInner) {
+      Inner *from = static_cast<Inner *>(right);
+      inner->keys[inner->count] = std::move(parent->keys[i]);
+      inner->children[inner->count + 1] = from->children[0];
+      parent->keys[i] = std::move(from->keys[0]);
+      Move(from->keys, from->keys + 1, from->keys + from->count);
+      std::copy(from->children + 1, from->children + from->count + 1,
+                from->children);
+      --from->count;
+      ++inner->count;
+    } else if (left) {
+      MergeInners(parent, i - 1);
+    } else {
+      MergeInners(parent, i);
+    }
+  }
+
+  // Drops keys[i] and children[i + 1] of parent
+  static void RemoveChild(Inner *parent, size_type i) {
+    Move(parent->keys + i, parent->keys + i + 1, parent->keys + parent->count);
+    std::copy(parent->children + i + 2, parent->children + parent->count + 1,
+              parent->children + i + 1);
+    --parent->count;
+  }
+
+  // Moves children[i + 1] of parent into children[i]
+  void MergeLeaves(Inner *parent, size_type i) {
+    Leaf *left = static_cast<Leaf *>(parent->children[i]);
+    Leaf *right = static_cast<Leaf *>(parent->children[i + 1]);
+    Move(left->keys + left->count, right->keys, right->keys + right->count);
+    Move(left->values + left->count, right->values,
+         right->values + right->count);
+    left->count += right->count;
+    left->next = right->next;
+    (right->next ? right->next->prev : last_) = left;
+    delete right;
+    RemoveChild(parent, i);
+  }
+
+  void MergeInners(Inner *parent, size_type i) {
+    Inner *left = static_cast<Inner *>(parent->children[i]);
+    Inner *right = static_cast<Inner *>(parent->children[i + 1]);
+    left->keys[left->count] = std::move(parent->keys[i]);
+    Move(left->keys + left->count + 1, right->keys, right->keys + right->count);
+    std::copy(right->children, right->children + right->count + 1,
+              left->children + left->count + 1);
+    left->count += right->count + 1;
+    delete right;
+    RemoveChild(parent, i);
+  }
+
+  // Removes key from the subtree at p, the caller rebalances p
+  auto Erase(NodeBase *p, const key_type &key) -> bool {
+    if (p->leaf) {
+      Leaf *leaf = static_cast<Leaf *>(p);
+      size_type i = LowerBound(leaf->keys, leaf->count, key);
+      if (i == leaf->count || Compare()(key, leaf->keys[i])) {
+        return false;
+      }
+      Move(leaf->keys + i, leaf->keys + i + 1, leaf->keys + leaf->count);
+      Move(leaf->values + i, leaf->values + i + 1, leaf->values + leaf->count);
+      --leaf->count;
+      // Releases what the last slot still holds
+      leaf->keys[leaf->count] = key_type();
+      leaf->values[leaf->count] = value_type();
+      return true;
+    }
+    Inner *inner = static_cast<Inner *>(p);
+    size_type i = UpperBound(inner->keys, inner->count, key);
+    NodeBase *child = inner->children[i];
+    if (!Erase(child, key)) {
+      return false;
+    }
+    if (child->count < (child->leaf ? kMinLeaf : kMinInner)) {
+      Rebalance(inner, i);
+    }
+    return true;
+  }
+
+  static void Destroy(NodeBase *p) {
+    if (p->leaf) {
+      delete static_cast<Leaf *>(p);
+      return;
+    }
+    Inner *inner = static_cast<Inner *>(p);
+    for (size_type i = 0; i <= inner->count; ++i) {
+      Destroy(inner->children[i]);
+    }
+    delete inner;
+  }
+
+  // Copies the subtree at p, linking its leaves after last
+  static auto Clone(const NodeBase *p, Leaf *&last) -> NodeBase * {
+    if (p->leaf) {
+      const Leaf *from = static_cast<const Leaf *>(p);
+      Leaf *leaf = new Leaf;
+      Copy(leaf->keys, from->keys, from->keys + from->count);
+      Copy(leaf->values, from->values, from->values + from->count);
+      leaf->count = from->count;
+      leaf->prev = last;
+      if (last) {
+        last->next = leaf;
+      }
+      last = leaf;
+      return leaf;
+    }
+    const Inner *from = static_cast<const Inner *>(p);
+    Inner *inner = new Inner;
+    Copy(inner->keys, from->keys, from->keys + from->count);
+    for (size_type i = 0; i <= from->count; ++i) {
+      inner->children[i] = Clone(from->children[i], last);
+    }
+    inner->count = from->count;
+    return inner;
+  }
+
+  void CopyFrom(const BTreeMap &other) {
+    if (!other.root_) {
+      return;
+    }
+    Leaf *last = nullptr;
+    root_ = Clone(other.root_, last);
+    NodeBase *p = root_;
+    while (!p->leaf) {
+      p = static_cast<Inner *>(p)->children[0];
+    }
+    first_ = static_cast<Leaf *>(p);
+    last_ = last;
+    size_ = other.size_;
+  }
+
+  void MoveFrom(BTreeMap &other) {
+    root_ = other.root_;
+    first_ = other.first_;
+    last_ = other.last_;
+    size_ = other.size_;
+    other.root_ = other.first_ = other.last_ = nullptr;
+    other.size_ = 0;
+  }
+
+public:
+  BTreeMap() = default;
+
+  ~BTreeMap() { Clear(); }
+
+  BTreeMap(const BTreeMap &other) { CopyFrom(other); }
+
+  BTreeMap(BTreeMap &&other) { MoveFrom(other); }
+
+  auto operator=(const BTreeMap &other) -> BTreeMap & {
+    if (this != &other) {
+      Clear();
+      CopyFrom(other);
+    }
+    return *this;
+  }
+
+  auto operator=(BTreeMap &&other) -> BTreeMap & {
+    if (this != &other) {
+      Clear();
+      MoveFrom(other);
+    }
+    return *this;
+  }
+
+  auto begin() -> iterator { return iterator(this, {first_, 0}); }
+
+  auto begin() const -> const_iterator {
+    return const_iterator(this, {first_, 0});
+  }
+
+  auto cbegin() const -> const_iterator { return begin(); }
+
+  auto end() -> iterator { return iterator(this, {nullptr, 0}); }
+
+  auto end() const -> const_iterator {
+    return const_iterator(this, {nullptr, 0});
+  }
+
+  auto cend() const -> const_iterator { return end(); }
+
+  auto back() -> iterator { return iterator(this, Previous({nullptr, 0})); }
+
+  auto back() const -> const_iterator {
+    return const_iterator(this, Previous({nullptr, 0}));
+  }
+
+  auto Size() const -> size_type { return size_; }
+
+  auto Empty() const -> bool { return size_ == 0; }
+
+  void Clear() {
+    if (root_) {
+      Destroy(root_);
+    }
+    root_ = first_ = last_ = nullptr;
+    size_ = 0;
+  }
+
+  void Insert(const key_type &key, const value_type &value) {
+    InsertImpl(key, value, true);
+  }
+
+  void Insert(const key_type &key, value_type &&value) {
+    InsertImpl(key, std::move(value), true);
+  }
+
+  auto Delete(const key_type &key) -> bool {
+    if (!root_ || !Erase(root_, key)) {
+      return false;
+    }
+    --size_;
+    // The root shrinks by a level once it has a single child left
+    if (!root_->leaf && root_->count == 0) {
+      Inner *root = static_cast<Inner *>(root_);
+      root_ = root->children[0];
+      delete root;
+    } else if (root_->leaf && root_->count == 0) {
+      delete static_cast<Leaf *>(root_);
+      root_ = first_ = last_ = nullptr;
+    }
+    return true;
+  }
+
+  auto Contains(const key_type &key) const -> bool {
+    return FindNode(key).leaf != nullptr;
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto Contains(const Q &key) const -> bool {
+    return FindNode(key).leaf != nullptr;
+  }
+
+  // Less than
+  auto FindL(const key_type &key) -> iterator {
+    return iterator(this, FindLNode(key));
+  }
+
+  auto FindL(const key_type &key) const -> const_iterator {
+    return const_iterator(this, FindLNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindL(const Q &key) -> iterator {
+    return iterator(this, FindLNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindL(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindLNode(key));
+  }
+
+  // Less than or equal to
+  auto FindLE(const key_type &key) -> iterator {
+    return iterator(this, FindLENode(key));
+  }
+
+  auto FindLE(const key_type &key) const -> const_iterator {
+    return const_iterator(this, FindLENode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindLE(const Q &key) -> iterator {
+    return iterator(this, FindLENode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindLE(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindLENode(key));
+  }
+
+  // Greater than
+  auto FindG(const key_type &key) -> iterator {
+    return iterator(this, FindGNode(key));
+  }
+
+  auto FindG(const key_type &key) const -> const_iterator {
+    return const_iterator(this, FindGNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindG(const Q &key) -> iterator {
+    return iterator(this, FindGNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindG(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindGNode(key));
+  }
+
+  // Greater than or equal to
+  auto FindGE(const key_type &key) -> iterator {
+    return iterator(this, FindGENode(key));
+  }
+
+  auto FindGE(const key_type &key) const -> const_iterator {
+    return const_iterator(this, FindGENode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindGE(const Q &key) -> iterator {
+    return iterator(this, FindGENode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindGE(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindGENode(key));
+  }
+
+  auto Find(const key_type &key) -> iterator {
+    return iterator(this, FindNode(key));
+  }
+
+  auto Find(const key_type &key) const -> const_iterator {
+    return const_iterator(this, FindNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto Find(const Q &key) -> iterator {
+    return iterator(this, FindNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto Find(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindNode(key));
+  }
+
+  auto operator[](const key_type &key) -> reference {
+    Position p = InsertImpl(key, value_type(), false);
+    return p.leaf->values[p.slot];
+  }
+
+  auto operator[](const key_type &key) const -> const_reference {
+    Position p = FindNode(key);
+    Assert(p.leaf, "BTreeMap::operator[](): Invalid key!");
+    return p.leaf->values[p.slot];
+  }
+
+  // The key is only converted to key_type when it is inserted
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto operator[](const Q &key) -> reference {
+    Position p = FindNode(key);
+    if (!p.leaf) {
+      p = InsertImpl(key_type(key), value_type(), false);
+    }
+    return p.leaf->values[p.slot];
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto operator[](const Q &key) const -> const_reference {
+    Position p = FindNode(key);
+    Assert(p.leaf, "BTreeMap::operator[](): Invalid key!");
+    return p.leaf->values[p.slot];
+  }
+};
+
+} // namespace ts_stl
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef TS_STL_CACHE_H_
+#define TS_STL_CACHE_H_
+
+#include "src/array.h"
+#include "src/hashmap.h"
+#include "src/queue.h"
+#include "src/sync.h"
+#include "src/utils.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+namespace ts_stl {
+
+// Hit, miss and eviction counts of a ConcurrentCache
+struct CacheStats {
+  std::size_t hits = 0;
+  std::size_t misses = 0;
+  std::size_t evictions = 0;
+};
+
+// Bounded cache split into segments by hash. Every segment holds its entries
+// in a CLOCK ring indexed by a HashMap. A hit only takes the segment's shared
+// lock and sets the entry's reference bit; an insert into a full segment
+// advances the clock hand, clearing reference bits, to the first entry not
+// used since the hand last passed and evicts it. Slots freed by Delete wait
+// in a Queue for the next insert. Keys and values must be default
+// constructible. Segment locks are held for a lookup only, so Mutex defaults
+// to SpinSharedMutex.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>,
+          typename Mutex = SpinSharedMutex>
+class ConcurrentCache {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+
+private:
+  // Segments are halved until each holds at least this many entries
+  static constexpr size_type kMinSegmentCapacity = 16;
+
+  struct Entry {
+    key_type key{};
+
+    value_type value{};
+
+    // Set by hits under the shared lock
+    std::atomic<bool> referenced{false};
+  };
+
+  struct alignas(kCacheLineSize) Segment {
+    Mutex m;
+
+    HashMap<key_type, size_type, Hash, KeyEqual> index;
+
+    ts_stl::Array<Entry> ring;
+
+    // Slots below used were filled once, free holds those deleted since
+    size_type used = 0;
+
+    ts_stl::Queue<size_type> free;
+
+    size_type hand = 0;
+  };
+
+  const size_type segment_size_;
+
+  const size_type capacity_;
+
+  ts_stl::Array<Segment> segment_;
+
+  ShardedCounter size_;
+
+  ShardedCounter hits_;
+
+  ShardedCounter misses_;
+
+  ShardedCounter evictions_;
+
+  const Hash hasher_;
+
+  static auto SegmentSize(size_type capacity, size_type segment_size)
+      -> size_type {
+    segment_size = CeilPowerOfTwo(segment_size == 0 ? DefaultStripeSize()
+                                                    : segment_size);
+    while (segment_size > 1 &&
+           capacity / segment_size < kMinSegmentCapacity) {
+      segment_size >>= 1;
+    }
+    return segment_size;
+  }
+
+  // The HashMap of a segment indexes buckets by the high bits of a
+  // fibonacci hash, segments take the low bits of a mixed one
+  auto SegmentOf(const key_type &key) -> Segment & {
+    return segment_[MixHash(hasher_(key)) & (segment_size_ - 1)];
+  }
+
+  // Caller holds the unique lock. Returns a slot for a new entry, evicting
+  // one if the segment is full.
+  auto TakeSlot(Segment &segment) -> size_type {
+    if (segment.used < segment.ring.size()) {
+      return segment.used++;
+    }
+    if (!segment.free.Empty()) {
+      return segment.free.Pop();
+    }
+    // Every slot is live, the hand stops within two turns
+    for (;; segment.hand = (segment.hand + 1) % segment.ring.size()) {
+      Entry &entry = segment.ring[segment.hand];
+      if (!entry.referenced.exchange(false, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    size_type slot = segment.hand;
+    segment.hand = (segment.hand + 1) % segment.ring.size();
+    segment.index.Delete(segment.ring[slot].key);
+    size_.Add(-1);
+    evictions_.Add(1);
+    return slot;
+  }
+
+  // Caller holds the unique lock and key is absent
+  template <typename... Args>
+  auto Emplace(Segment &segment, const key_type &key, Args &&...args)
+      -> Entry & {
+    size_type slot = TakeSlot(segment);
+    Entry &entry = segment.ring[slot];
+    entry.key = key;
+    entry.value = value_type(std::forward<Args>(args)...);
+    entry.referenced.store(false, std::memory_order_relaxed);
+    segment.index.Insert(key, slot);
+    size_.Add(1);
+    return entry;
+  }
+
+public:
+  // Holds at most capacity entries. segment_size 0 picks
+  // DefaultStripeSize(), both are lowered for small capacities.
+  ConcurrentCache(size_type capacity, size_type segment_size = 0,
+                  Hash hasher = Hash())
+      : segment_size_(SegmentSize(capacity, segment_size)),
+        capacity_(Max(capacity, static_cast<size_type>(1))),
+        segment_(segment_size_), hasher_(hasher) {
+    for (size_type i = 0; i < segment_size_; ++i) {
+      // The first capacity % segment_size_ segments take one more entry
+      size_type segment_capacity =
+          capacity_ / segment_size_ + (i < capacity_ % segment_size_);
+      segment_[i].ring = ts_stl::Array<Entry>(segment_capacity);
+      segment_[i].index.Reserve(segment_capacity);
+    }
+  }
+
+  ConcurrentCache(const ConcurrentCache &) = delete;
+
+  auto operator=(const ConcurrentCache &) -> ConcurrentCache & = delete;
+
+  // Lock-free, exact whenever no write is in flight
+  auto size() const -> size_type {
+    return static_cast<size_type>(Max<int64_t>(size_.Load(), 0));
+  }
+
+  auto capacity() const -> size_type { return capacity_; }
+
+  auto segment_size() const -> size_type { return segment_size_; }
+
+  auto Stats() const -> CacheStats {
+    CacheStats stats;
+    stats.hits = static_cast<size_type>(hits_.Load());
+    stats.misses = static_cast<size_type>(misses_.Load());
+    stats.evictions = static_cast<size_type>(evictions_.Load());
+    return stats;
+  }
+
+  // Copies the value of key into value and counts a hit, or counts a miss
+  auto Get(const key_type &key, value_type &value) -> bool {
+    Segment &segment = SegmentOf(key);
+    std::shared_lock<Mutex> lock(segment.m);
+    const size_type *slot = segment.index.Find(key);
+    if (slot == nullptr) {
+      misses_.Add(1);
+      return false;
+    }
+    Entry &entry = segment.ring[*slot];
+    // Skips the store when set, so hot entries stay shared in every cache
+    if (!entry.referenced.load(std::memory_order_relaxed)) {
+      entry.referenced.store(true, std::memory_order_relaxed);
+    }
+    value = entry.value;
+    hits_.Add(1);
+    return true;
+  }
+
+  // Neither counts nor marks the entry as used
+  auto Contains(const key_type &key) -> bool {
+    Segment &segment = SegmentOf(key);
+    std::shared_lock<Mutex> lock(segment.m);
+    return segment.index.Contains(key);
+  }
+
+  void Put(const key_type &key, const value_type &value) {
+    Segment &segment = SegmentOf(key);
+    std::unique_lock<Mutex> lock(segment.m);
+    if (size_type *slot = segment.index.Find(key)) {
+      segment.ring[*slot].value = value;
+      segment.ring[*slot].referenced.store(true, std::memory_order_relaxed);
+      return;
+    }
+    Emplace(segment, key, value);
+  }
+
+  void Put(const key_type &key, value_type &&value) {
+    Segment &segment = SegmentOf(key);
+    std::unique_lock<Mutex> lock(segment.m);
+    if (size_type *slot = segment.index.Find(key)) {
+      segment.ring[*slot].value = std::move(value);
+      segment.ring[*slot].referenced.store(true, std::memory_order_relaxed);
+      return;
+    }
+    Emplace(segment, key, std::move(value));
+  }
+
+  // Returns the value of key, inserting factory() on a miss. Concurrent
+  // misses of one key call factory() once.
+  template <typename F>
+  auto GetOrCompute(const key_type &key, F factory) -> value_type {
+    value_type value;
+    if (Get(key, value)) {
+      return value;
+    }
+    Segment &segment = SegmentOf(key);
+    std::unique_lock<Mutex> lock(segment.m);
+    if (size_type *slot = segment.index.Find(key)) {
+      segment.ring[*slot].referenced.store(true, std::memory_order_relaxed);
+      return segment.ring[*slot].value;
+    }
+    return Emplace(segment, key, factory()).value;
+  }
+
+  auto Delete(const key_type &key) -> bool {
+    Segment &segment = SegmentOf(key);
+    std::unique_lock<Mutex> lock(segment.m);
+    const size_type *found = segment.index.Find(key);
+    if (found == nullptr) {
+      return false;
+    }
+    size_type slot = *found;
+    segment.index.Delete(key);
+    segment.ring[slot].value = value_type();
+    segment.free.Push(slot);
+    size_.Add(-1);
+    return true;
+  }
+
+  void Clear() {
+    for (auto &segment : segment_) {
+      std::unique_lock<Mutex> lock(segment.m);
+      size_.Add(-static_cast<int64_t>(segment.index.size()));
+      segment.index.Clear();
+      segment.index.Reserve(segment.ring.size());
+      for (size_type i = 0; i < segment.used; ++i) {
+        segment.ring[i].value = value_type();
+      }
+      segment.used = 0;
+      segment.free.Clear();
+      segment.hand = 0;
+    }
+  }
+};
+
+} // namespace ts_stl
+
+#endif
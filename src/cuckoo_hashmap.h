@@ -0,0 +1,836 @@
+#ifndef TS_STL_CUCKOO_HASHMAP_H_
+#define TS_STL_CUCKOO_HASHMAP_H_
+
+#include "src/array.h"
+#include "src/hashmap.h"
+#include "src/sync.h"
+#include "src/utils.h"
+#include "src/vector.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <shared_mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ts_stl {
+
+// Bucketized cuckoo hashing: every key may only live in one of two buckets
+// of kCuckooSlots slots, so a lookup reads at most two buckets however the
+// keys are distributed. An insert into two full buckets first moves entries
+// to their other bucket along the shortest path a breadth-first search finds
+// and grows the table only if there is none. Every slot has a one-byte tag
+// from the hash, 0 marks an empty slot. The second bucket is derived from the
+// first and the tag (partial-key cuckoo hashing), so moving an entry never
+// hashes its key again.
+
+inline constexpr std::size_t kCuckooSlots = 4;
+
+// Buckets a path search may visit
+inline constexpr std::size_t kCuckooSearchLimit = 256;
+
+// Longest displacement path, counting the bucket with the free slot
+inline constexpr std::size_t kCuckooMaxPath = 5;
+
+// Buckets for size entries at a load of about 7/8
+inline auto CuckooBucketSize(std::size_t size) -> std::size_t {
+  return CeilPowerOfTwo(size / kCuckooSlots + size / (kCuckooSlots * 7) + 1);
+}
+
+// Slot storage shared by CuckooHashMap and SyncCuckooHashMap. Hashes are
+// already mixed, buckets come from their low bits and tags from their high
+// bits. Tags are atomic so SeqLock readers may load them during a write. If
+// kShared, slots are written with RelaxedStore() so those readers may copy
+// them with Load(), which needs trivially copyable keys and values.
+template <typename K, typename V, bool kShared = false> class CuckooTable {
+public:
+  using size_type = std::size_t;
+  using slot_type = std::pair<K, V>;
+
+  // A slot, slot is kCuckooSlots if there is none
+  struct Position {
+    size_type bucket;
+    size_type slot;
+  };
+
+private:
+  // A power of two minus one
+  size_type mask_ = 0;
+
+  // kCuckooSlots per bucket
+  std::atomic<uint8_t> *tags_ = nullptr;
+
+  // Cache line aligned, so small entries keep a bucket on one line
+  slot_type *slots_ = nullptr;
+
+  auto Index(const Position &position) const -> size_type {
+    return position.bucket * kCuckooSlots + position.slot;
+  }
+
+  void Destroy() {
+    if (tags_ == nullptr) {
+      return;
+    }
+    for (size_type i = 0; i < (mask_ + 1) * kCuckooSlots; ++i) {
+      if (tags_[i].load(std::memory_order_relaxed) != 0) {
+        slots_[i].~slot_type();
+      }
+    }
+    delete[] tags_;
+    ::operator delete(slots_, std::align_val_t(kCacheLineSize));
+    tags_ = nullptr;
+    slots_ = nullptr;
+  }
+
+public:
+  // bucket_size is rounded up to a power of two
+  explicit CuckooTable(size_type bucket_size = 1)
+      : mask_(CeilPowerOfTwo(bucket_size) - 1),
+        tags_(new std::atomic<uint8_t>[(mask_ + 1) * kCuckooSlots]()),
+        slots_(static_cast<slot_type *>(
+            ::operator new((mask_ + 1) * kCuckooSlots * sizeof(slot_type),
+                           std::align_val_t(kCacheLineSize)))) {}
+
+  CuckooTable(const CuckooTable &other) : CuckooTable(other.bucket_size()) {
+    for (size_type i = 0; i < (mask_ + 1) * kCuckooSlots; ++i) {
+      uint8_t tag = other.tags_[i].load(std::memory_order_relaxed);
+      if (tag != 0) {
+        new (slots_ + i) slot_type(other.slots_[i]);
+        tags_[i].store(tag, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // other is left an empty table of one bucket
+  CuckooTable(CuckooTable &&other) : CuckooTable() { Swap(other); }
+
+  ~CuckooTable() { Destroy(); }
+
+  auto operator=(const CuckooTable &other) -> CuckooTable & {
+    if (this != &other) {
+      CuckooTable copy(other);
+      *this = std::move(copy);
+    }
+    return *this;
+  }
+
+  auto operator=(CuckooTable &&other) -> CuckooTable & {
+    if (this != &other) {
+      CuckooTable table(std::move(other));
+      Swap(table);
+    }
+    return *this;
+  }
+
+  void Swap(CuckooTable &other) {
+    std::swap(mask_, other.mask_);
+    std::swap(tags_, other.tags_);
+    std::swap(slots_, other.slots_);
+  }
+
+  static auto Tag(size_t hash) -> uint8_t {
+    uint8_t tag = static_cast<uint8_t>(hash >> 56);
+    return tag == 0 ? 1 : tag;
+  }
+
+  // Flips bits of index by tag, AltIndex(AltIndex(i, t), t) == i
+  static auto AltIndex(size_t index, uint8_t tag) -> size_t {
+    return index ^ ((tag + 1) * 0xc6a4a7935bd1e995ull);
+  }
+
+  auto bucket_size() const -> size_type { return mask_ + 1; }
+
+  auto Bucket(size_t hash) const -> size_type { return hash & mask_; }
+
+  auto AltBucket(size_type bucket, uint8_t tag) const -> size_type {
+    return AltIndex(bucket, tag) & mask_;
+  }
+
+  auto TagAt(const Position &position) const -> uint8_t {
+    return tags_[Index(position)].load(std::memory_order_relaxed);
+  }
+
+  auto At(const Position &position) -> slot_type & {
+    return slots_[Index(position)];
+  }
+
+  auto At(const Position &position) const -> const slot_type & {
+    return slots_[Index(position)];
+  }
+
+  void ReadTags(size_type bucket, uint8_t *tags) const {
+    const std::atomic<uint8_t> *bucket_tags = tags_ + bucket * kCuckooSlots;
+    for (size_type i = 0; i < kCuckooSlots; ++i) {
+      tags[i] = bucket_tags[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  // The slot of key in either bucket of hash
+  template <typename Q, typename KeyEqual>
+  auto Find(size_t hash, const Q &key, const KeyEqual &key_equaler) const
+      -> Position {
+    uint8_t tag = Tag(hash);
+    size_type bucket = Bucket(hash);
+    for (size_type i = 0; i < 2; ++i) {
+      const std::atomic<uint8_t> *tags = tags_ + bucket * kCuckooSlots;
+      for (size_type slot = 0; slot < kCuckooSlots; ++slot) {
+        if (tags[slot].load(std::memory_order_relaxed) == tag &&
+            key_equaler(key, slots_[bucket * kCuckooSlots + slot].first)) {
+          return {bucket, slot};
+        }
+      }
+      bucket = AltBucket(bucket, tag);
+    }
+    return {bucket, kCuckooSlots};
+  }
+
+  // Find() for SeqLock readers that race with writers, if kShared. Copies the
+  // entry of key to entry, which is only valid once the read validates.
+  template <typename Q, typename KeyEqual>
+  auto Load(size_t hash, const Q &key, const KeyEqual &key_equaler,
+            slot_type &entry) const -> bool {
+    static_assert(kShared, "CuckooTable::Load needs kShared.");
+    uint8_t tag = Tag(hash);
+    size_type bucket = Bucket(hash);
+    for (size_type i = 0; i < 2; ++i) {
+      for (size_type slot = 0; slot < kCuckooSlots; ++slot) {
+        size_type index = bucket * kCuckooSlots + slot;
+        if (tags_[index].load(std::memory_order_relaxed) != tag) {
+          continue;
+        }
+        K slot_key = RelaxedLoad(&slots_[index].first);
+        if (key_equaler(key, slot_key)) {
+          entry.first = slot_key;
+          entry.second = RelaxedLoad(&slots_[index].second);
+          return true;
+        }
+      }
+      bucket = AltBucket(bucket, tag);
+    }
+    return false;
+  }
+
+  // An empty slot in either bucket of hash
+  auto FindFree(size_t hash) const -> Position {
+    size_type bucket = Bucket(hash);
+    for (size_type i = 0; i < 2; ++i) {
+      for (size_type slot = 0; slot < kCuckooSlots; ++slot) {
+        if (tags_[bucket * kCuckooSlots + slot].load(
+                std::memory_order_relaxed) == 0) {
+          return {bucket, slot};
+        }
+      }
+      bucket = AltBucket(bucket, Tag(hash));
+    }
+    return {bucket, kCuckooSlots};
+  }
+
+  // position must be empty
+  template <typename... Args>
+  auto Construct(const Position &position, uint8_t tag, Args &&...args)
+      -> slot_type & {
+    slot_type *slot = slots_ + Index(position);
+    if constexpr (kShared) {
+      slot_type entry(std::forward<Args>(args)...);
+      RelaxedStore(&slot->first, entry.first);
+      RelaxedStore(&slot->second, entry.second);
+    } else {
+      new (slot) slot_type(std::forward<Args>(args)...);
+    }
+    tags_[Index(position)].store(tag, std::memory_order_relaxed);
+    return *slot;
+  }
+
+  // Replaces the value at position, which must hold an entry
+  void Assign(const Position &position, const V &value) {
+    if constexpr (kShared) {
+      RelaxedStore(&At(position).second, value);
+    } else {
+      At(position).second = value;
+    }
+  }
+
+  void Destroy(const Position &position) {
+    slots_[Index(position)].~slot_type();
+    tags_[Index(position)].store(0, std::memory_order_relaxed);
+  }
+
+  // Whether the entry at from may move to the empty slot to
+  auto Movable(const Position &from, const Position &to) const -> bool {
+    uint8_t tag = TagAt(from);
+    return tag != 0 && TagAt(to) == 0 &&
+           AltBucket(from.bucket, tag) == to.bucket;
+  }
+
+  void Move(const Position &from, const Position &to) {
+    Construct(to, TagAt(from), std::move(At(from)));
+    Destroy(from);
+  }
+
+  // Searches the shortest path of moves that frees a slot in bucket b1 or
+  // b2. path[0] is in b1 or b2, the entry at path[i] moves to path[i + 1],
+  // and path[length - 1] is empty. read_tags(bucket, tags) copies the tags of
+  // a bucket and may fail. Returns length, 0 if no path was found.
+  template <typename ReadTags>
+  auto SearchPath(size_type b1, size_type b2, Position *path,
+                  ReadTags read_tags) const -> size_type {
+    struct Node {
+      size_type bucket;
+      // Index of the node whose entry moves here, and its slot
+      size_type parent;
+      size_type slot;
+      size_type depth;
+    };
+    constexpr size_type kRoot = kCuckooSearchLimit;
+    Node nodes[kCuckooSearchLimit];
+    size_type size = 0;
+    nodes[size++] = {b1, kRoot, 0, 0};
+    nodes[size++] = {b2, kRoot, 0, 0};
+    uint8_t tags[kCuckooSlots];
+    for (size_type head = 0; head < size; ++head) {
+      const Node &node = nodes[head];
+      if (!read_tags(node.bucket, tags)) {
+        return 0;
+      }
+      for (size_type slot = 0; slot < kCuckooSlots; ++slot) {
+        if (tags[slot] == 0) {
+          path[node.depth] = {node.bucket, slot};
+          for (size_type i = head; nodes[i].parent != kRoot;
+               i = nodes[i].parent) {
+            path[nodes[i].depth - 1] = {nodes[nodes[i].parent].bucket,
+                                        nodes[i].slot};
+          }
+          return node.depth + 1;
+        }
+      }
+      if (node.depth + 1 < kCuckooMaxPath) {
+        for (size_type slot = 0;
+             slot < kCuckooSlots && size < kCuckooSearchLimit; ++slot) {
+          nodes[size++] = {AltBucket(node.bucket, tags[slot]), head, slot,
+                           node.depth + 1};
+        }
+      }
+    }
+    return 0;
+  }
+
+  // Constructs an entry of an absent key from args, moving other entries out
+  // of the way. Returns nullptr if there is no room and args are untouched.
+  template <typename... Args>
+  auto Emplace(size_t hash, Args &&...args) -> slot_type * {
+    Position path[kCuckooMaxPath];
+    size_type b1 = Bucket(hash);
+    size_type length = SearchPath(
+        b1, AltBucket(b1, Tag(hash)), path,
+        [this](size_type bucket, uint8_t *tags) {
+          ReadTags(bucket, tags);
+          return true;
+        });
+    if (length == 0) {
+      return nullptr;
+    }
+    for (size_type i = length - 1; i > 0; --i) {
+      Move(path[i - 1], path[i]);
+    }
+    return &Construct(path[0], Tag(hash), std::forward<Args>(args)...);
+  }
+
+  // Moves every entry into a table of at least bucket_size buckets, which
+  // doubles as long as an entry finds no room. hash_of(key) gives the hash an
+  // entry was inserted with.
+  template <typename HashOf>
+  auto Rehash(size_type bucket_size, HashOf hash_of) -> CuckooTable {
+    CuckooTable table(bucket_size);
+    for (size_type i = 0; i < (mask_ + 1) * kCuckooSlots; ++i) {
+      if (tags_[i].load(std::memory_order_relaxed) != 0) {
+        size_t hash = hash_of(slots_[i].first);
+        while (table.Emplace(hash, std::move(slots_[i])) == nullptr) {
+          table = table.Rehash(table.bucket_size() * 2, hash_of);
+        }
+        slots_[i].~slot_type();
+        tags_[i].store(0, std::memory_order_relaxed);
+      }
+    }
+    return table;
+  }
+};
+
+// Lookups read at most two buckets, so their worst case is bounded
+// regardless of collisions. Inserts may move up to kCuckooMaxPath - 1
+// entries and grow the table when no displacement path exists.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>>
+class CuckooHashMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+  using reference = V &;
+  using const_reference = const V &;
+
+private:
+  using table_type = CuckooTable<key_type, value_type>;
+  using slot_type = typename table_type::slot_type;
+
+  table_type table_;
+
+  size_type size_ = 0;
+
+  Hash hasher_;
+
+  KeyEqual key_equaler_;
+
+  auto HashOf(const key_type &key) const -> size_t {
+    return MixHash(hasher_(key));
+  }
+
+  void Grow(size_type bucket_size) {
+    table_ = table_.Rehash(
+        bucket_size, [this](const key_type &key) { return HashOf(key); });
+  }
+
+  auto FindEntry(const key_type &key) const -> const slot_type * {
+    auto position = table_.Find(HashOf(key), key, key_equaler_);
+    return position.slot == kCuckooSlots ? nullptr : &table_.At(position);
+  }
+
+  // Returns the entry of key and whether it was inserted, the value is
+  // constructed from args only on insertion
+  template <typename... Args>
+  auto FindOrEmplace(const key_type &key, Args &&...args)
+      -> std::pair<slot_type *, bool> {
+    size_t hash = HashOf(key);
+    if (auto position = table_.Find(hash, key, key_equaler_);
+        position.slot != kCuckooSlots) {
+      return {&table_.At(position), false};
+    }
+    slot_type *slot;
+    while ((slot = table_.Emplace(
+                hash, std::piecewise_construct, std::forward_as_tuple(key),
+                std::forward_as_tuple(std::forward<Args>(args)...))) ==
+           nullptr) {
+      Grow(table_.bucket_size() * 2);
+    }
+    ++size_;
+    return {slot, true};
+  }
+
+public:
+  CuckooHashMap(Hash hasher = Hash(), KeyEqual key_equaler = KeyEqual())
+      : hasher_(hasher), key_equaler_(key_equaler) {}
+
+  CuckooHashMap(const CuckooHashMap &) = default;
+
+  // other is left empty
+  CuckooHashMap(CuckooHashMap &&other)
+      : table_(std::move(other.table_)), size_(other.size_),
+        hasher_(other.hasher_), key_equaler_(other.key_equaler_) {
+    other.size_ = 0;
+  }
+
+  ~CuckooHashMap() = default;
+
+  auto operator=(const CuckooHashMap &) -> CuckooHashMap & = default;
+
+  auto operator=(CuckooHashMap &&other) -> CuckooHashMap & {
+    if (this != &other) {
+      table_ = std::move(other.table_);
+      size_ = other.size_;
+      hasher_ = other.hasher_;
+      key_equaler_ = other.key_equaler_;
+      other.size_ = 0;
+    }
+    return *this;
+  }
+
+  auto bucket_size() const -> size_type { return table_.bucket_size(); }
+
+  auto size() const -> size_type { return size_; }
+
+  auto Empty() const -> bool { return size_ == 0; }
+
+  void Clear() {
+    table_ = table_type();
+    size_ = 0;
+  }
+
+  void Reserve(size_type size) {
+    size_type bucket_size = CuckooBucketSize(size);
+    if (bucket_size > table_.bucket_size()) {
+      Grow(bucket_size);
+    }
+  }
+
+  auto Entry(const key_type &key) -> reference { return operator[](key); }
+
+  auto Find(const key_type &key) -> value_type * {
+    auto entry = FindEntry(key);
+    return entry ? const_cast<value_type *>(&entry->second) : nullptr;
+  }
+
+  auto Find(const key_type &key) const -> const value_type * {
+    auto entry = FindEntry(key);
+    return entry ? &entry->second : nullptr;
+  }
+
+  auto Contains(const key_type &key) const -> bool {
+    return FindEntry(key) != nullptr;
+  }
+
+  void Insert(const key_type &key, const value_type &value) {
+    if (auto [slot, inserted] = FindOrEmplace(key, value); !inserted) {
+      slot->second = value;
+    }
+  }
+
+  void Insert(const key_type &key, value_type &&value) {
+    if (auto [slot, inserted] = FindOrEmplace(key, std::move(value));
+        !inserted) {
+      slot->second = std::move(value);
+    }
+  }
+
+  auto Delete(const key_type &key) -> bool {
+    auto position = table_.Find(HashOf(key), key, key_equaler_);
+    if (position.slot == kCuckooSlots) {
+      return false;
+    }
+    table_.Destroy(position);
+    --size_;
+    return true;
+  }
+
+  auto operator[](const key_type &key) -> reference {
+    return FindOrEmplace(key).first->second;
+  }
+
+  auto operator[](const key_type &key) const -> const_reference {
+    static const value_type default_value{};
+    auto entry = FindEntry(key);
+    return entry ? entry->second : default_value;
+  }
+};
+
+// Concurrent CuckooHashMap. Buckets share lock stripes and a key's two
+// buckets are guarded by at most two of them, taken in index order. Mutex
+// may be std::shared_mutex, ts_stl::SpinSharedMutex or ts_stl::SeqLock; with
+// SeqLock, lookups read both buckets without locking and retry if a writer
+// touched either stripe meanwhile. Inserts search a displacement path
+// holding one stripe at a time and then move the entries one by one, each
+// move under the two stripes involved. Growing takes every stripe. Replaced
+// tables are kept until the map is destroyed, together no larger than the
+// current one, so a reader never follows a freed table.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>,
+          typename Mutex = std::shared_mutex>
+class SyncCuckooHashMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+  using reference = V &;
+  using const_reference = const V &;
+
+private:
+  static constexpr bool kOptimistic = std::is_same_v<Mutex, SeqLock>;
+
+  using table_type = CuckooTable<key_type, value_type, kOptimistic>;
+  using slot_type = typename table_type::slot_type;
+  using Position = typename table_type::Position;
+
+  static_assert(!kOptimistic || (std::is_trivially_copyable_v<key_type> &&
+                                 std::is_trivially_copyable_v<value_type>),
+                "SyncCuckooHashMap: SeqLock needs trivially copyable keys and "
+                "values.");
+
+  // Optimistic attempts before a lookup takes the locks
+  static constexpr size_type kOptimisticRetries = 8;
+
+  // A power of two no greater than the bucket size, so the stripes of a key
+  // follow from its hash alone and stay the same when the table grows
+  const size_type stripe_size_;
+
+  mutable ts_stl::Array<CacheLinePadded<Mutex>> m_;
+
+  // Replaced only while holding every stripe
+  std::atomic<table_type *> table_;
+
+  ts_stl::Vector<table_type *> retired_;
+
+  ShardedCounter size_;
+
+  const Hash hasher_;
+
+  const KeyEqual key_equaler_;
+
+  auto HashOf(const key_type &key) const -> size_t {
+    return MixHash(hasher_(key));
+  }
+
+  auto StripeIndex(size_t index) const -> size_type {
+    return index & (stripe_size_ - 1);
+  }
+
+  // Locks stripes a and b in index order, b is left unlocked if equal to a
+  template <typename Lock>
+  auto LockStripes(size_type a, size_type b) const -> std::pair<Lock, Lock> {
+    if (a > b) {
+      std::swap(a, b);
+    }
+    Lock first(m_[a].value);
+    return {std::move(first), a == b ? Lock() : Lock(m_[b].value)};
+  }
+
+  // Locks the stripes of both buckets of hash
+  template <typename Lock>
+  auto LockKey(size_t hash) const -> std::pair<Lock, Lock> {
+    return LockStripes<Lock>(
+        StripeIndex(hash),
+        StripeIndex(table_type::AltIndex(hash, table_type::Tag(hash))));
+  }
+
+  // Copies the tags of bucket, fails if table is no longer current
+  auto ReadTags(const table_type *table, size_type bucket, uint8_t *tags) const
+      -> bool {
+    Mutex &m = m_[StripeIndex(bucket)].value;
+    if constexpr (kOptimistic) {
+      for (;;) {
+        uint64_t version = m.ReadBegin();
+        if (table_.load(std::memory_order_acquire) != table) {
+          return false;
+        }
+        table->ReadTags(bucket, tags);
+        if (m.ReadValidate(version)) {
+          return true;
+        }
+      }
+    } else {
+      std::shared_lock<Mutex> lock(m);
+      if (table_.load(std::memory_order_relaxed) != table) {
+        return false;
+      }
+      table->ReadTags(bucket, tags);
+      return true;
+    }
+  }
+
+  // Called without any lock held when both buckets of hash were full in
+  // table. Frees a slot in one of them, unless another writer takes it
+  // first. Returns false if there is no displacement path.
+  auto MakeRoom(table_type *table, size_t hash) -> bool {
+    Position path[kCuckooMaxPath];
+    size_type b1 = table->Bucket(hash);
+    size_type length = table->SearchPath(
+        b1, table->AltBucket(b1, table_type::Tag(hash)), path,
+        [this, table](size_type bucket, uint8_t *tags) {
+          return ReadTags(table, bucket, tags);
+        });
+    if (length == 0) {
+      return table_.load(std::memory_order_acquire) != table;
+    }
+    // A path that went stale only costs a retry
+    for (size_type i = length - 1; i > 0; --i) {
+      auto locks = LockStripes<std::unique_lock<Mutex>>(
+          StripeIndex(path[i - 1].bucket), StripeIndex(path[i].bucket));
+      if (table_.load(std::memory_order_relaxed) != table ||
+          !table->Movable(path[i - 1], path[i])) {
+        return true;
+      }
+      table->Move(path[i - 1], path[i]);
+    }
+    return true;
+  }
+
+  void Grow(table_type *table) {
+    for (auto &m : m_) {
+      m.value.lock();
+    }
+    if (table_.load(std::memory_order_relaxed) == table) {
+      table_.store(new table_type(table->Rehash(
+                       table->bucket_size() * 2,
+                       [this](const key_type &key) { return HashOf(key); })),
+                   std::memory_order_release);
+      retired_.PushBack(table);
+    }
+    for (auto &m : m_) {
+      m.value.unlock();
+    }
+  }
+
+  // Calls found(entry) if key exists, otherwise inserts make()
+  template <typename F, typename G>
+  auto Write(const key_type &key, F found, G make) -> bool {
+    size_t hash = HashOf(key);
+    for (;;) {
+      table_type *table;
+      {
+        auto locks = LockKey<std::unique_lock<Mutex>>(hash);
+        table = table_.load(std::memory_order_relaxed);
+        if (auto position = table->Find(hash, key, key_equaler_);
+            position.slot != kCuckooSlots) {
+          if constexpr (kOptimistic) {
+            // Readers copy the slot meanwhile, so it is stored whole
+            slot_type entry = table->At(position);
+            found(entry);
+            table->Assign(position, entry.second);
+          } else {
+            found(table->At(position));
+          }
+          return false;
+        }
+        if (auto position = table->FindFree(hash);
+            position.slot != kCuckooSlots) {
+          table->Construct(position, table_type::Tag(hash), key, make());
+          size_.Add(1);
+          return true;
+        }
+      }
+      if (!MakeRoom(table, hash)) {
+        Grow(table);
+      }
+    }
+  }
+
+  // Calls fn(entry) for the entry of key, or fn(nullptr), and returns its
+  // result. fn may run more than once on the optimistic path.
+  template <typename F> auto Read(const key_type &key, F fn) const {
+    size_t hash = HashOf(key);
+    if constexpr (kOptimistic) {
+      const SeqLock &m1 = m_[StripeIndex(hash)].value;
+      const SeqLock &m2 =
+          m_[StripeIndex(table_type::AltIndex(hash, table_type::Tag(hash)))]
+              .value;
+      for (size_type attempt = 0; attempt < kOptimisticRetries; ++attempt) {
+        uint64_t v1 = m1.ReadBegin();
+        uint64_t v2 = m2.ReadBegin();
+        const table_type *table = table_.load(std::memory_order_acquire);
+        slot_type entry;
+        auto result =
+            fn(table->Load(hash, key, key_equaler_, entry) ? &entry : nullptr);
+        if (m1.ReadValidate(v1) && m2.ReadValidate(v2)) {
+          return result;
+        }
+      }
+    }
+    auto locks = LockKey<std::shared_lock<Mutex>>(hash);
+    const table_type *table = table_.load(std::memory_order_relaxed);
+    auto position = table->Find(hash, key, key_equaler_);
+    return fn(position.slot == kCuckooSlots ? nullptr : &table->At(position));
+  }
+
+  // Deletes key if pred(value) holds
+  template <typename P> auto Erase(const key_type &key, P pred) -> bool {
+    size_t hash = HashOf(key);
+    auto locks = LockKey<std::unique_lock<Mutex>>(hash);
+    table_type *table = table_.load(std::memory_order_relaxed);
+    auto position = table->Find(hash, key, key_equaler_);
+    if (position.slot == kCuckooSlots ||
+        !pred(static_cast<const value_type &>(table->At(position).second))) {
+      return false;
+    }
+    table->Destroy(position);
+    size_.Add(-1);
+    return true;
+  }
+
+public:
+  // Sized for capacity entries, stripe_size 0 picks DefaultStripeSize()
+  SyncCuckooHashMap(size_type capacity = 0, size_type stripe_size = 0,
+                    Hash hasher = Hash(), KeyEqual key_equaler = KeyEqual())
+      : stripe_size_(CeilPowerOfTwo(stripe_size == 0 ? DefaultStripeSize()
+                                                     : stripe_size)),
+        m_(stripe_size_),
+        table_(new table_type(
+            Max(CuckooBucketSize(capacity), stripe_size_))),
+        hasher_(hasher), key_equaler_(key_equaler) {}
+
+  SyncCuckooHashMap(const SyncCuckooHashMap &) = delete;
+
+  ~SyncCuckooHashMap() {
+    delete table_.load();
+    for (auto table : retired_) {
+      delete table;
+    }
+  }
+
+  auto operator=(const SyncCuckooHashMap &) -> SyncCuckooHashMap & = delete;
+
+  // Lock-free, exact whenever no write is in flight
+  auto size() const -> size_type {
+    return static_cast<size_type>(Max<int64_t>(size_.Load(), 0));
+  }
+
+  auto stripe_size() const -> size_type { return stripe_size_; }
+
+  auto bucket_size() const -> size_type {
+    std::shared_lock<Mutex> lock(m_[0].value);
+    return table_.load(std::memory_order_relaxed)->bucket_size();
+  }
+
+  auto Contains(const key_type &key) const -> bool {
+    return Read(key, [](const slot_type *entry) { return entry != nullptr; });
+  }
+
+  void Insert(const key_type &key, const value_type &value) {
+    Write(
+        key, [&](slot_type &entry) { entry.second = value; },
+        [&]() -> const value_type & { return value; });
+  }
+
+  void Insert(const key_type &key, value_type &&value) {
+    Write(
+        key, [&](slot_type &entry) { entry.second = std::move(value); },
+        [&]() -> value_type && { return std::move(value); });
+  }
+
+  auto Delete(const key_type &key) -> bool {
+    return Erase(key, [](const value_type &) { return true; });
+  }
+
+  // Calls fn(value) if key exists, otherwise constructs its value from args.
+  // Returns whether the value was inserted.
+  template <typename F, typename... Args>
+  auto Upsert(const key_type &key, F fn, Args &&...args) -> bool {
+    return Write(
+        key, [&](slot_type &entry) { fn(entry.second); },
+        [&] { return value_type(std::forward<Args>(args)...); });
+  }
+
+  // Returns the value of key, inserting factory() first if key is absent
+  template <typename F>
+  auto ComputeIfAbsent(const key_type &key, F factory) -> value_type {
+    value_type result;
+    Write(
+        key, [&](slot_type &entry) { result = entry.second; },
+        [&] { return result = factory(); });
+    return result;
+  }
+
+  // Constructs the value of key from args unless key exists
+  template <typename... Args>
+  auto InsertIfAbsent(const key_type &key, Args &&...args) -> bool {
+    return Write(
+        key, [](slot_type &) {},
+        [&] { return value_type(std::forward<Args>(args)...); });
+  }
+
+  // Deletes key if pred(value) holds
+  template <typename P> auto EraseIf(const key_type &key, P pred) -> bool {
+    return Erase(key, pred);
+  }
+
+  auto operator[](const key_type &key) const -> value_type {
+    return Read(key, [](const slot_type *entry) {
+      return entry != nullptr ? entry->second : value_type();
+    });
+  }
+};
+
+} // namespace ts_stl
+
+#endif
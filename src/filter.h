@@ -0,0 +1,161 @@
+#ifndef TS_STL_FILTER_H_
+#define TS_STL_FILTER_H_
+
+#include "src/array.h"
+#include "src/sync.h"
+#include "src/utils.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ts_stl {
+
+// Approximate membership filters the hash maps put in front of their
+// buckets. A filter sees the raw hash of every key added and removed, and
+// MayContain() may give false positives but never false negatives. Reset()
+// empties the filter and sizes it for about capacity keys.
+
+// Filter of maps without one, every lookup goes to the buckets
+struct NoFilter {
+  void Reset(std::size_t) {}
+
+  void Add(size_t) {}
+
+  void Remove(size_t) {}
+
+  constexpr auto MayContain(size_t) const -> bool { return true; }
+};
+
+// Blocked counting Bloom filter. A key maps to one cache line of 128 4-bit
+// counters and bumps kProbes of them, so a lookup reads a single cache line.
+// Counters are atomic, so threads holding different bucket locks may update
+// the filter together and lookups need no lock. A counter stuck at 15 is
+// never decremented again, which keeps deletes safe.
+class CountingBloomFilter {
+private:
+  static constexpr std::size_t kWords = kCacheLineSize / sizeof(uint64_t);
+
+  static constexpr std::size_t kCounters = kWords * 16;
+
+  static constexpr std::size_t kProbes = 4;
+
+  // About 2% false positives at capacity
+  static constexpr std::size_t kCountersPerKey = 8;
+
+  struct alignas(kCacheLineSize) Block {
+    std::atomic<uint64_t> words[kWords]{};
+  };
+
+  std::size_t block_size_ = 0;
+
+  ts_stl::Array<Block> blocks_;
+
+  // The hash maps index buckets by plain hashes, so the filter mixes its own
+  static auto Mix(size_t hash) -> uint64_t {
+    uint64_t x = hash;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    return x ^ (x >> 33);
+  }
+
+  // The block comes from the high bits, the counters from the low bits
+  auto BlockOf(uint64_t mixed) const -> Block & {
+    return const_cast<Block &>(blocks_[static_cast<std::size_t>(
+        (static_cast<__uint128_t>(mixed) * block_size_) >> 64)]);
+  }
+
+  static auto Counter(uint64_t mixed, std::size_t probe) -> std::size_t {
+    return (mixed >> (probe * 7)) & (kCounters - 1);
+  }
+
+  // Adds delta to a counter unless it is saturated
+  static void Update(Block &block, std::size_t counter, int delta) {
+    std::atomic<uint64_t> &word = block.words[counter / 16];
+    unsigned shift = (counter % 16) * 4;
+    uint64_t old_word = word.load(std::memory_order_relaxed);
+    uint64_t new_word;
+    do {
+      uint64_t count = (old_word >> shift) & 15;
+      if (count == 15 || (delta < 0 && count == 0)) {
+        return;
+      }
+      new_word = delta > 0 ? old_word + (uint64_t(1) << shift)
+                           : old_word - (uint64_t(1) << shift);
+    } while (!word.compare_exchange_weak(old_word, new_word,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+  }
+
+public:
+  explicit CountingBloomFilter(std::size_t capacity = 0) : blocks_(0) {
+    Reset(capacity);
+  }
+
+  CountingBloomFilter(const CountingBloomFilter &other)
+      : block_size_(other.block_size_), blocks_(other.block_size_) {
+    for (std::size_t i = 0; i < block_size_; ++i) {
+      for (std::size_t j = 0; j < kWords; ++j) {
+        blocks_[i].words[j].store(
+            other.blocks_[i].words[j].load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+      }
+    }
+  }
+
+  CountingBloomFilter(CountingBloomFilter &&) = default;
+
+  auto operator=(const CountingBloomFilter &other) -> CountingBloomFilter & {
+    if (this != &other) {
+      CountingBloomFilter copy(other);
+      block_size_ = copy.block_size_;
+      blocks_ = std::move(copy.blocks_);
+    }
+    return *this;
+  }
+
+  auto operator=(CountingBloomFilter &&) -> CountingBloomFilter & = default;
+
+  void Reset(std::size_t capacity) {
+    block_size_ = capacity * kCountersPerKey / kCounters + 1;
+    blocks_ = ts_stl::Array<Block>(block_size_);
+  }
+
+  auto block_size() const -> std::size_t { return block_size_; }
+
+  void Add(size_t hash) {
+    uint64_t mixed = Mix(hash);
+    Block &block = BlockOf(mixed);
+    for (std::size_t i = 0; i < kProbes; ++i) {
+      Update(block, Counter(mixed, i), 1);
+    }
+  }
+
+  // hash must have been added before
+  void Remove(size_t hash) {
+    uint64_t mixed = Mix(hash);
+    Block &block = BlockOf(mixed);
+    for (std::size_t i = 0; i < kProbes; ++i) {
+      Update(block, Counter(mixed, i), -1);
+    }
+  }
+
+  auto MayContain(size_t hash) const -> bool {
+    uint64_t mixed = Mix(hash);
+    Block &block = BlockOf(mixed);
+    for (std::size_t i = 0; i < kProbes; ++i) {
+      std::size_t counter = Counter(mixed, i);
+      uint64_t word =
+          block.words[counter / 16].load(std::memory_order_acquire);
+      if (((word >> ((counter % 16) * 4)) & 15) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+} // namespace ts_stl
+
+#endif
@@ -0,0 +1,303 @@
+#ifndef TS_STL_FROZEN_HASHMAP_H_
+#define TS_STL_FROZEN_HASHMAP_H_
+
+#include "src/array.h"
+#include "src/hashmap.h"
+#include "src/utils.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+namespace ts_stl {
+
+// Image layout, every section starts on a cache line:
+//   FrozenHeader
+//   uint64_t offsets[bucket_size + 1], bucket i holds entries
+//            [offsets[i], offsets[i + 1])
+//   FrozenEntry<K, V> entries[size]
+// Offsets are relative, so the image can be mapped at any address. Buckets
+// are indexed by the low bits of MixHash(Hash()(key)), the Hash must give
+// the same values in the writing and the reading process.
+
+// "TSFROZEN" in file byte order
+inline constexpr uint64_t kFrozenMagic = 0x4e455a4f52465354ull;
+
+inline constexpr uint64_t kFrozenVersion = 1;
+
+struct FrozenHeader {
+  uint64_t magic;
+  uint64_t version;
+  uint64_t key_size;
+  uint64_t value_size;
+  uint64_t entry_size;
+  uint64_t bucket_size;
+  uint64_t size;
+  uint64_t entries_offset;
+};
+
+static_assert(sizeof(FrozenHeader) <= kCacheLineSize);
+
+template <typename K, typename V> struct FrozenEntry {
+  K key;
+  V value;
+};
+
+// Offset of the entries, just after the bucket offsets
+inline auto FrozenEntriesOffset(uint64_t bucket_size) -> uint64_t {
+  uint64_t end = kCacheLineSize + (bucket_size + 1) * sizeof(uint64_t);
+  return (end + kCacheLineSize - 1) / kCacheLineSize * kCacheLineSize;
+}
+
+// Unique name next to path for an image being written
+inline auto FrozenTempPath(const char *path) -> std::string {
+  static std::atomic<uint64_t> count(0);
+  return std::string(path) + "." + std::to_string(::getpid()) + "." +
+         std::to_string(count.fetch_add(1)) + ".tmp";
+}
+
+// Writes map to path as an image FrozenHashMap can map, returns whether it
+// succeeded
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          typename BucketPolicy, template <typename> class Bucket,
+          typename Filter>
+auto Freeze(
+    const HashMap<K, V, Hash, KeyEqual, BucketPolicy, Bucket, Filter> &map,
+    const char *path, Hash hasher = Hash()) -> bool {
+  static_assert(std::is_trivially_copyable_v<K> &&
+                    std::is_trivially_copyable_v<V>,
+                "Freeze(): keys and values must be trivially copyable.");
+  using entry_type = FrozenEntry<K, V>;
+
+  uint64_t size = map.size();
+  uint64_t bucket_size = CeilPowerOfTwo(Max(size, static_cast<uint64_t>(1)));
+  ts_stl::Array<uint64_t> offsets(bucket_size + 1);
+  Fill(offsets.begin(), offsets.end(), static_cast<uint64_t>(0));
+  map.ForEach([&](const K &key, const V &) {
+    ++offsets[(MixHash(hasher(key)) & (bucket_size - 1)) + 1];
+  });
+  for (uint64_t i = 0; i < bucket_size; ++i) {
+    offsets[i + 1] += offsets[i];
+  }
+
+  // Entries are placed bucket by bucket, next[i] is the next free slot of
+  // bucket i
+  ts_stl::Array<uint64_t> next(offsets);
+  // Zeroed, so the padding of the entries and the image are reproducible
+  ts_stl::Array<entry_type> entries(Max(size, static_cast<uint64_t>(1)));
+  std::memset(static_cast<void *>(entries.Data()), 0,
+              entries.size() * sizeof(entry_type));
+  map.ForEach([&](const K &key, const V &value) {
+    entry_type &entry =
+        entries[next[MixHash(hasher(key)) & (bucket_size - 1)]++];
+    std::memcpy(&entry.key, &key, sizeof(K));
+    std::memcpy(&entry.value, &value, sizeof(V));
+  });
+
+  FrozenHeader header{kFrozenMagic,       kFrozenVersion,
+                      sizeof(K),          sizeof(V),
+                      sizeof(entry_type), bucket_size,
+                      size,               FrozenEntriesOffset(bucket_size)};
+  char head[kCacheLineSize] = {};
+  std::memcpy(head, &header, sizeof(header));
+  char padding[kCacheLineSize] = {};
+  uint64_t offsets_end = kCacheLineSize + (bucket_size + 1) * sizeof(uint64_t);
+
+  // The image is written to a new file renamed over path, so processes
+  // mapping the old image keep it intact, and a crash never leaves a partial
+  // image at path
+  std::string temp_path = FrozenTempPath(path);
+  int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+  if (fd < 0) {
+    return false;
+  }
+  std::FILE *file = ::fdopen(fd, "wb");
+  if (file == nullptr) {
+    ::close(fd);
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  bool ok =
+      std::fwrite(head, kCacheLineSize, 1, file) == 1 &&
+      std::fwrite(offsets.Data(), sizeof(uint64_t), bucket_size + 1, file) ==
+          bucket_size + 1 &&
+      (header.entries_offset == offsets_end ||
+       std::fwrite(padding, header.entries_offset - offsets_end, 1, file) ==
+           1) &&
+      (size == 0 ||
+       std::fwrite(entries.Data(), sizeof(entry_type), size, file) == size) &&
+      std::fflush(file) == 0 && ::fsync(fd) == 0;
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok || std::rename(temp_path.c_str(), path) != 0) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Read-only view of an image written by Freeze(). The file is mapped
+// shared, so processes opening the same image share one page cache copy,
+// and lookups neither allocate nor deserialize.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>>
+class FrozenHashMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+  using const_reference = const V &;
+
+private:
+  using entry_type = FrozenEntry<K, V>;
+
+  static_assert(std::is_trivially_copyable_v<K> &&
+                    std::is_trivially_copyable_v<V>,
+                "FrozenHashMap: keys and values must be trivially copyable.");
+
+  void *data_ = nullptr;
+
+  size_type length_ = 0;
+
+  const FrozenHeader *header_ = nullptr;
+
+  const uint64_t *offsets_ = nullptr;
+
+  const entry_type *entries_ = nullptr;
+
+  Hash hasher_;
+
+  KeyEqual key_equaler_;
+
+  // Whether the mapped image holds a table of this key and value type
+  auto Valid() const -> bool {
+    if (length_ < sizeof(FrozenHeader)) {
+      return false;
+    }
+    const FrozenHeader &header = *header_;
+    if (header.magic != kFrozenMagic || header.version != kFrozenVersion ||
+        header.key_size != sizeof(K) || header.value_size != sizeof(V) ||
+        header.entry_size != sizeof(entry_type) || header.bucket_size == 0 ||
+        (header.bucket_size & (header.bucket_size - 1)) != 0 ||
+        header.bucket_size > length_ / sizeof(uint64_t) ||
+        header.entries_offset != FrozenEntriesOffset(header.bucket_size) ||
+        header.entries_offset > length_ ||
+        header.size > (length_ - header.entries_offset) / sizeof(entry_type)) {
+      return false;
+    }
+    const uint64_t *offsets = reinterpret_cast<const uint64_t *>(
+        static_cast<const char *>(data_) + kCacheLineSize);
+    return offsets[0] == 0 && offsets[header.bucket_size] == header.size;
+  }
+
+  auto FindEntry(const key_type &key) const -> const entry_type * {
+    if (header_ == nullptr) {
+      return nullptr;
+    }
+    size_type bucket = MixHash(hasher_(key)) & (header_->bucket_size - 1);
+    // Bounded by size, so a corrupt offset can't read past the image
+    uint64_t end = Min(offsets_[bucket + 1], header_->size);
+    for (uint64_t i = offsets_[bucket]; i < end; ++i) {
+      if (key_equaler_(key, entries_[i].key)) {
+        return entries_ + i;
+      }
+    }
+    return nullptr;
+  }
+
+public:
+  FrozenHashMap(Hash hasher = Hash(), KeyEqual key_equaler = KeyEqual())
+      : hasher_(hasher), key_equaler_(key_equaler) {}
+
+  FrozenHashMap(const FrozenHashMap &) = delete;
+
+  FrozenHashMap(FrozenHashMap &&other)
+      : data_(other.data_), length_(other.length_), header_(other.header_),
+        offsets_(other.offsets_), entries_(other.entries_),
+        hasher_(other.hasher_), key_equaler_(other.key_equaler_) {
+    other.data_ = nullptr;
+    other.header_ = nullptr;
+    other.length_ = 0;
+  }
+
+  ~FrozenHashMap() { Close(); }
+
+  auto operator=(const FrozenHashMap &) -> FrozenHashMap & = delete;
+
+  // Maps the image at path, returns false if it can't be read or doesn't
+  // hold a table of this type
+  auto Open(const char *path) -> bool {
+    Close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+      data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    data_ = data;
+    length_ = info.st_size;
+    header_ = static_cast<const FrozenHeader *>(data_);
+    if (!Valid()) {
+      Close();
+      return false;
+    }
+    offsets_ = reinterpret_cast<const uint64_t *>(
+        static_cast<const char *>(data_) + kCacheLineSize);
+    entries_ = reinterpret_cast<const entry_type *>(
+        static_cast<const char *>(data_) + header_->entries_offset);
+    return true;
+  }
+
+  void Close() {
+    if (data_ != nullptr) {
+      ::munmap(data_, length_);
+    }
+    data_ = nullptr;
+    length_ = 0;
+    header_ = nullptr;
+    offsets_ = nullptr;
+    entries_ = nullptr;
+  }
+
+  auto IsOpen() const -> bool { return header_ != nullptr; }
+
+  auto size() const -> size_type { return header_ ? header_->size : 0; }
+
+  auto bucket_size() const -> size_type {
+    return header_ ? header_->bucket_size : 0;
+  }
+
+  auto Contains(const key_type &key) const -> bool {
+    return FindEntry(key) != nullptr;
+  }
+
+  // The value of key, or nullptr if absent
+  auto Find(const key_type &key) const -> const value_type * {
+    auto entry = FindEntry(key);
+    return entry ? &entry->value : nullptr;
+  }
+
+  auto operator[](const key_type &key) const -> const_reference {
+    static const value_type default_value{};
+    auto entry = FindEntry(key);
+    return entry ? entry->value : default_value;
+  }
+};
+
+} // namespace ts_stl
+
+#endif
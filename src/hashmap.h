@@ -2,16 +2,140 @@
 #define TS_STL_HASHMAP_H_
 
 #include "src/array.h"
+#include "src/filter.h"
+#include "src/sync.h"
 #include "src/vector.h"
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace ts_stl {
 
+// Fibonacci hashing multiplier, 2^64 / golden ratio
+inline constexpr size_t kFibonacciMultiplier = 0x9E3779B97F4A7C15ull;
+
+// Mixes the bits of a hash, std::hash of integers is the identity
+inline auto MixHash(size_t hash) -> size_t {
+  __uint128_t product = static_cast<__uint128_t>(hash) * kFibonacciMultiplier;
+  return static_cast<size_t>(product) ^ static_cast<size_t>(product >> 64);
+}
+
+// Hashes std::string, std::string_view and C strings alike, for maps with
+// transparent lookup (KeyEqual = std::equal_to<>)
+struct StringHash {
+  using is_transparent = void;
+
+  auto operator()(std::string_view s) const -> size_t {
+    return std::hash<std::string_view>()(s);
+  }
+};
+
+// Bucket policies map a hash to a bucket index. Reset() rounds a requested
+// bucket size up to one the policy supports and returns it.
+
+// Plain modulo, any bucket size
+class ModuloBucketPolicy {
+private:
+  std::size_t bucket_size_ = 1;
+
+public:
+  auto Reset(std::size_t bucket_size) -> std::size_t {
+    return bucket_size_ = Max(bucket_size, static_cast<std::size_t>(1));
+  }
+
+  auto Index(size_t hash) const -> std::size_t { return hash % bucket_size_; }
+};
+
+// Power-of-two bucket sizes indexed by the high bits of a fibonacci hash
+class PowerOfTwoBucketPolicy {
+private:
+  unsigned shift_ = 63;
+
+public:
+  auto Reset(std::size_t bucket_size) -> std::size_t {
+    std::size_t result = 2;
+    shift_ = 63;
+    while (result < bucket_size) {
+      result <<= 1;
+      --shift_;
+    }
+    return result;
+  }
+
+  auto Index(size_t hash) const -> std::size_t {
+    return (hash * kFibonacciMultiplier) >> shift_;
+  }
+};
+
+// Any bucket size, reduced from a fibonacci hash by a multiply instead of a
+// division (Lemire's fastrange)
+class FastRangeBucketPolicy {
+private:
+  std::size_t bucket_size_ = 1;
+
+public:
+  auto Reset(std::size_t bucket_size) -> std::size_t {
+    return bucket_size_ = Max(bucket_size, static_cast<std::size_t>(1));
+  }
+
+  auto Index(size_t hash) const -> std::size_t {
+    return static_cast<std::size_t>(
+        (static_cast<__uint128_t>(hash * kFibonacciMultiplier) *
+         bucket_size_) >>
+        64);
+  }
+};
+
+// Default bucket of FixedHashMap and HashMap. At the default load most
+// buckets hold one or two entries, which then live in the bucket array
+// without an allocation. Large entries keep one inline, so that empty
+// buckets stay small.
+template <typename T>
+using InlineBucket = SmallVector<T, (sizeof(T) <= 16 ? 2 : 1)>;
+
+// Keys of a batch hashed and prefetched before any bucket is probed
+inline constexpr std::size_t kPrefetchBatch = 16;
+
+// Runs probe(i, bucket[index_of(keys[i])]) for every key. Each group of
+// kPrefetchBatch keys is hashed first, then the bucket headers and their
+// entries are prefetched, so the cache misses of the group overlap.
+template <typename K, typename Bucket, typename IndexFn, typename ProbeFn>
+void ProbeBatch(Bucket *bucket, const K *keys, std::size_t count,
+                IndexFn index_of, ProbeFn probe) {
+  std::size_t index[kPrefetchBatch];
+  for (std::size_t begin = 0; begin < count; begin += kPrefetchBatch) {
+    std::size_t n = Min(count - begin, kPrefetchBatch);
+    for (std::size_t i = 0; i < n; ++i) {
+      index[i] = index_of(keys[begin + i]);
+      __builtin_prefetch(bucket + index[i]);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      __builtin_prefetch(bucket[index[i]].RawData());
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      probe(begin + i, bucket[index[i]]);
+    }
+  }
+}
+
 template <typename K, typename V, typename Hash = std::hash<K>,
-          typename KeyEqual = std::equal_to<K>>
+          typename KeyEqual = std::equal_to<K>,
+          typename BucketPolicy = PowerOfTwoBucketPolicy,
+          template <typename> class Bucket = InlineBucket>
 class FixedHashMap {
 public:
   using key_type = K;
@@ -21,25 +145,29 @@ public:
   using const_reference = const V &;
 
 private:
+  using bucket_type = Bucket<std::pair<key_type, value_type>>;
+
+  BucketPolicy bucket_policy_;
+
   const size_type bucket_size_;
 
   size_type size_;
 
-  ts_stl::Array<ts_stl::Vector<std::pair<key_type, value_type>>> bucket_;
+  ts_stl::Array<bucket_type> bucket_;
 
   const Hash hasher_;
 
   const KeyEqual key_equaler_;
 
   auto BucketIndex(const key_type &key) const -> size_type {
-    return hasher_(key) % bucket_size_;
+    return bucket_policy_.Index(hasher_(key));
   }
 
 public:
   FixedHashMap(size_type bucket_size, Hash hasher = Hash(),
                KeyEqual key_equaler = KeyEqual())
-      : bucket_size_(bucket_size), size_(0), bucket_(bucket_size),
-        hasher_(hasher), key_equaler_(key_equaler) {}
+      : bucket_size_(bucket_policy_.Reset(bucket_size)), size_(0),
+        bucket_(bucket_size_), hasher_(hasher), key_equaler_(key_equaler) {}
 
   FixedHashMap(const FixedHashMap &) = default;
 
@@ -65,6 +193,40 @@ public:
     return false;
   }
 
+  // results[i] points to the value of keys[i], or is nullptr if absent
+  void FindBatch(const key_type *keys, size_type count,
+                 const value_type **results) const {
+    ProbeBatch(
+        bucket_.Data(), keys, count,
+        [this](const key_type &key) { return BucketIndex(key); },
+        [&](size_type i, const auto &bucket) {
+          results[i] = nullptr;
+          for (auto &[pair_key, pair_value] : bucket) {
+            if (key_equaler_(keys[i], pair_key)) {
+              results[i] = &pair_value;
+              return;
+            }
+          }
+        });
+  }
+
+  void InsertBatch(const key_type *keys, const value_type *values,
+                   size_type count) {
+    ProbeBatch(
+        bucket_.Data(), keys, count,
+        [this](const key_type &key) { return BucketIndex(key); },
+        [&](size_type i, auto &bucket) {
+          for (auto &[pair_key, pair_value] : bucket) {
+            if (key_equaler_(keys[i], pair_key)) {
+              pair_value = values[i];
+              return;
+            }
+          }
+          bucket.PushBack(std::make_pair(keys[i], values[i]));
+          ++size_;
+        });
+  }
+
   void Insert(const key_type &key, const value_type &value) {
     size_type bucket_index = BucketIndex(key);
     for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
@@ -124,8 +286,19 @@ public:
   }
 };
 
+// Buckets share a configurable number of lock stripes, each on its own
+// cache line. Mutex may be std::shared_mutex, ts_stl::SpinSharedMutex or
+// ts_stl::SeqLock. With SeqLock, lookups read without locking and retry if a
+// writer touched the stripe meanwhile; replaced bucket buffers are kept until
+// the map is destroyed, so an optimistic reader never reads freed memory.
+// Such a reader copies entries with RelaxedLoad() and finds the buffer of a
+// bucket through an atomic view, since writers change both meanwhile.
+// A Filter such as CountingBloomFilter answers most lookups of absent keys
+// before any stripe is touched; it is sized for bucket_size entries.
 template <typename K, typename V, typename Hash = std::hash<K>,
-          typename KeyEqual = std::equal_to<K>>
+          typename KeyEqual = std::equal_to<K>,
+          typename BucketPolicy = PowerOfTwoBucketPolicy,
+          typename Mutex = std::shared_mutex, typename Filter = NoFilter>
 class SyncFixedHashMap {
 public:
   using key_type = K;
@@ -135,43 +308,228 @@ public:
   using const_reference = const V &;
 
 private:
+  using entry_type = std::pair<key_type, value_type>;
+
+  using bucket_type = ts_stl::Vector<entry_type>;
+
+  // The buffer and size of a bucket as optimistic readers see them
+  struct BucketView {
+    std::atomic<const entry_type *> data{nullptr};
+
+    std::atomic<size_type> size{0};
+  };
+
+  static constexpr bool kOptimistic = std::is_same_v<Mutex, SeqLock>;
+
+  static_assert(!kOptimistic || (std::is_trivially_copyable_v<key_type> &&
+                                 std::is_trivially_copyable_v<value_type>),
+                "SyncFixedHashMap: SeqLock needs trivially copyable keys and "
+                "values.");
+
+  // Optimistic attempts before a lookup takes the lock
+  static constexpr size_type kOptimisticRetries = 8;
+
+  BucketPolicy bucket_policy_;
+
   const size_type bucket_size_;
 
-  std::atomic<size_type> size_;
+  ShardedCounter size_;
+
+  ts_stl::Array<bucket_type> bucket_;
 
-  ts_stl::Array<ts_stl::Vector<std::pair<key_type, value_type>>> bucket_;
+  // One per bucket with SeqLock, otherwise none
+  ts_stl::Array<BucketView> views_;
 
   const Hash hasher_;
 
   const KeyEqual key_equaler_;
 
-  ts_stl::Array<std::shared_mutex> m_;
+  // A power of two, bucket i is guarded by stripe i % stripe_size_
+  const size_type stripe_size_;
 
-  auto BucketIndex(const key_type &key) const -> size_type {
-    return hasher_(key) % bucket_size_;
+  ts_stl::Array<CacheLinePadded<Mutex>> m_;
+
+  // Bucket buffers replaced while optimistic readers may still use them
+  ts_stl::Vector<bucket_type> retired_;
+
+  std::mutex retired_m_;
+
+  // Updated under the stripe lock of the key, read without locking
+  Filter filter_;
+
+  auto Stripe(size_type bucket_index) -> Mutex & {
+    return m_[bucket_index & (stripe_size_ - 1)].value;
+  }
+
+  // Caller holds the unique lock of the bucket's stripe. Makes room for one
+  // more entry without freeing a buffer an optimistic reader may be using.
+  void ReserveOne(bucket_type &bucket) {
+    if constexpr (kOptimistic) {
+      if (bucket.size() == bucket.capacity()) {
+        bucket_type grown;
+        grown.Reserve(Max(bucket.capacity(), static_cast<size_type>(1)) * 2);
+        for (auto &entry : bucket) {
+          grown.PushBack(entry);
+        }
+        std::lock_guard<std::mutex> lock(retired_m_);
+        retired_.EmplaceBack(std::move(bucket));
+        bucket = std::move(grown);
+      }
+    }
+  }
+
+  // Caller holds the unique lock of the bucket's stripe and has changed its
+  // buffer or size
+  void Publish(size_type bucket_index) {
+    if constexpr (kOptimistic) {
+      views_[bucket_index].data.store(bucket_[bucket_index].RawData(),
+                                      std::memory_order_relaxed);
+      views_[bucket_index].size.store(bucket_[bucket_index].size(),
+                                      std::memory_order_relaxed);
+    }
+  }
+
+  // Caller holds the unique lock of the entry's stripe
+  void Assign(entry_type *entry, const value_type &value) {
+    if constexpr (kOptimistic) {
+      RelaxedStore(&entry->second, value);
+    } else {
+      entry->second = value;
+    }
+  }
+
+  // Caller holds the unique lock of the bucket's stripe
+  void DeleteIn(size_type bucket_index, size_type index) {
+    bucket_type &bucket = bucket_[bucket_index];
+    if constexpr (kOptimistic) {
+      for (size_type i = index; i + 1 < bucket.size(); ++i) {
+        RelaxedStore(&bucket[i].first, bucket[i + 1].first);
+        RelaxedStore(&bucket[i].second, bucket[i + 1].second);
+      }
+      bucket.Resize(bucket.size() - 1);
+      Publish(bucket_index);
+    } else {
+      bucket.Delete(index);
+    }
+  }
+
+  // Caller holds a lock of the bucket's stripe
+  auto FindIn(bucket_type &bucket, const key_type &key)
+      -> std::pair<key_type, value_type> * {
+    for (auto &entry : bucket) {
+      if (key_equaler_(key, entry.first)) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  // Caller holds the unique lock of the bucket's stripe, hash is hasher_(key)
+  template <typename... Args>
+  auto EmplaceIn(size_type bucket_index, size_t hash, const key_type &key,
+                 Args &&...args) -> value_type & {
+    bucket_type &bucket = bucket_[bucket_index];
+    // Added first, so the filter never hides a key that can be read
+    filter_.Add(hash);
+    ReserveOne(bucket);
+    if constexpr (kOptimistic) {
+      // A reader that saw a longer bucket may still read the slot past the
+      // end, so it is stored word by word
+      entry_type entry(std::piecewise_construct, std::forward_as_tuple(key),
+                       std::forward_as_tuple(std::forward<Args>(args)...));
+      entry_type *slot = bucket.RawData() + bucket.size();
+      RelaxedStore(&slot->first, entry.first);
+      RelaxedStore(&slot->second, entry.second);
+      bucket.Resize(bucket.size() + 1);
+      Publish(bucket_index);
+    } else {
+      bucket.EmplaceBack(std::piecewise_construct, std::forward_as_tuple(key),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+    size_.Add(1);
+    return bucket.Back().second;
+  }
+
+  // Calls fn(entry) for the entry of key, or fn(nullptr), and returns its
+  // result. fn may run more than once on the optimistic path.
+  template <typename F> auto Read(const key_type &key, F fn) {
+    size_t hash = hasher_(key);
+    if (!filter_.MayContain(hash)) {
+      return fn(nullptr);
+    }
+    size_type bucket_index = bucket_policy_.Index(hash);
+    const bucket_type &bucket = bucket_[bucket_index];
+    if constexpr (kOptimistic) {
+      const SeqLock &lock = Stripe(bucket_index);
+      const BucketView &view = views_[bucket_index];
+      for (size_type attempt = 0; attempt < kOptimisticRetries; ++attempt) {
+        uint64_t version = lock.ReadBegin();
+        const entry_type *data = view.data.load(std::memory_order_relaxed);
+        size_type size = view.size.load(std::memory_order_relaxed);
+        // data and size must come from the same write before being used
+        if (!lock.ReadValidate(version)) {
+          continue;
+        }
+        entry_type copy;
+        const entry_type *entry = nullptr;
+        for (size_type i = 0; i < size; ++i) {
+          key_type entry_key = RelaxedLoad(&data[i].first);
+          if (key_equaler_(key, entry_key)) {
+            copy.first = entry_key;
+            copy.second = RelaxedLoad(&data[i].second);
+            entry = &copy;
+            break;
+          }
+        }
+        auto result = fn(entry);
+        if (lock.ReadValidate(version)) {
+          return result;
+        }
+      }
+    }
+    std::shared_lock<Mutex> lock(Stripe(bucket_index));
+    for (auto &entry : bucket) {
+      if (key_equaler_(key, entry.first)) {
+        return fn(&entry);
+      }
+    }
+    return fn(nullptr);
   }
 
 public:
+  // stripe_size 0 picks DefaultStripeSize()
   SyncFixedHashMap(size_type bucket_size, Hash hasher = Hash(),
-                   KeyEqual key_equaler = KeyEqual())
-      : bucket_size_(bucket_size), size_(0), bucket_(bucket_size),
-        hasher_(hasher), key_equaler_(key_equaler), m_(bucket_size) {}
+                   KeyEqual key_equaler = KeyEqual(), size_type stripe_size = 0)
+      : bucket_size_(bucket_policy_.Reset(bucket_size)), bucket_(bucket_size_),
+        views_(kOptimistic ? bucket_size_ : 0), hasher_(hasher),
+        key_equaler_(key_equaler),
+        stripe_size_(CeilPowerOfTwo(stripe_size == 0 ? DefaultStripeSize()
+                                                     : stripe_size)),
+        m_(stripe_size_) {
+    filter_.Reset(bucket_size_);
+  }
 
-  auto size() -> size_type { return size_; }
+  // Lock-free, exact whenever no write is in flight
+  auto size() const -> size_type {
+    return static_cast<size_type>(Max<int64_t>(size_.Load(), 0));
+  }
+
+  auto bucket_size() const -> size_type { return bucket_size_; }
+
+  auto stripe_size() const -> size_type { return stripe_size_; }
 
   auto Contains(const key_type &key) -> bool {
-    size_type bucket_index = BucketIndex(key);
-    std::shared_lock<std::shared_mutex> lock(m_[bucket_index]);
-    for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
-      if (key_equaler_(key, pair_key)) {
-        return true;
-      }
-    }
-    return false;
+    return Read(key, [](const std::pair<key_type, value_type> *entry) {
+      return entry != nullptr;
+    });
   }
 
   auto Contains(const key_type &key) const -> bool {
-    size_type bucket_index = BucketIndex(key);
+    size_t hash = hasher_(key);
+    if (!filter_.MayContain(hash)) {
+      return false;
+    }
+    size_type bucket_index = bucket_policy_.Index(hash);
     for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
       if (key_equaler_(key, pair_key)) {
         return true;
@@ -181,46 +539,124 @@ public:
   }
 
   void Insert(const key_type &key, const value_type &value) {
-    size_type bucket_index = BucketIndex(key);
-    std::unique_lock<std::shared_mutex> lock(m_[bucket_index]);
-    for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
-      if (key_equaler_(key, pair_key)) {
-        pair_value = value;
-        return;
-      }
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
+    std::unique_lock<Mutex> lock(Stripe(bucket_index));
+    if (auto entry = FindIn(bucket_[bucket_index], key)) {
+      Assign(entry, value);
+      return;
     }
-    ++size_;
-    bucket_[bucket_index].Pushback(std::make_pair(key, value));
+    EmplaceIn(bucket_index, hash, key, value);
   }
 
   void Insert(const key_type &key, value_type &&value) {
-    size_type bucket_index = BucketIndex(key);
-    std::unique_lock<std::shared_mutex> lock(m_[bucket_index]);
-    for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
-      if (key_equaler_(key, pair_key)) {
-        pair_value = std::move(value);
-        return;
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
+    std::unique_lock<Mutex> lock(Stripe(bucket_index));
+    if (auto entry = FindIn(bucket_[bucket_index], key)) {
+      if constexpr (kOptimistic) {
+        Assign(entry, value);
+      } else {
+        entry->second = std::move(value);
       }
+      return;
     }
-    ++size_;
-    bucket_[bucket_index].EmplaceBack(std::make_pair(key, std::move(value)));
+    EmplaceIn(bucket_index, hash, key, std::move(value));
   }
 
   auto Delete(const key_type &key) -> bool {
-    size_type bucket_index = BucketIndex(key);
-    std::unique_lock<std::shared_mutex> lock(m_[bucket_index]);
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
+    std::unique_lock<Mutex> lock(Stripe(bucket_index));
     for (size_t index = 0; index < bucket_[bucket_index].size(); ++index) {
       if (key_equaler_(key, bucket_[bucket_index][index].first)) {
-        bucket_[bucket_index].Delete(index);
-        --size_;
+        DeleteIn(bucket_index, index);
+        filter_.Remove(hash);
+        size_.Add(-1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Calls fn(value) if key exists, otherwise constructs its value from args.
+  // Returns whether the value was inserted.
+  template <typename F, typename... Args>
+  auto Upsert(const key_type &key, F fn, Args &&...args) -> bool {
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
+    std::unique_lock<Mutex> lock(Stripe(bucket_index));
+    if (auto entry = FindIn(bucket_[bucket_index], key)) {
+      if constexpr (kOptimistic) {
+        value_type value = entry->second;
+        fn(value);
+        Assign(entry, value);
+      } else {
+        fn(entry->second);
+      }
+      return false;
+    }
+    EmplaceIn(bucket_index, hash, key, std::forward<Args>(args)...);
+    return true;
+  }
+
+  // Returns the value of key, inserting factory() first if key is absent
+  template <typename F>
+  auto ComputeIfAbsent(const key_type &key, F factory) -> value_type {
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
+    std::unique_lock<Mutex> lock(Stripe(bucket_index));
+    if (auto entry = FindIn(bucket_[bucket_index], key)) {
+      return entry->second;
+    }
+    return EmplaceIn(bucket_index, hash, key, factory());
+  }
+
+  // Constructs the value of key from args unless key exists
+  template <typename... Args>
+  auto InsertIfAbsent(const key_type &key, Args &&...args) -> bool {
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
+    std::unique_lock<Mutex> lock(Stripe(bucket_index));
+    if (FindIn(bucket_[bucket_index], key) != nullptr) {
+      return false;
+    }
+    EmplaceIn(bucket_index, hash, key, std::forward<Args>(args)...);
+    return true;
+  }
+
+  // Deletes key if pred(value) holds
+  template <typename P> auto EraseIf(const key_type &key, P pred) -> bool {
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
+    std::unique_lock<Mutex> lock(Stripe(bucket_index));
+    auto &bucket = bucket_[bucket_index];
+    for (size_t index = 0; index < bucket.size(); ++index) {
+      if (key_equaler_(key, bucket[index].first)) {
+        if (!pred(static_cast<const value_type &>(bucket[index].second))) {
+          return false;
+        }
+        DeleteIn(bucket_index, index);
+        filter_.Remove(hash);
+        size_.Add(-1);
         return true;
       }
     }
     return false;
   }
 
+  auto operator[](const key_type &key) -> value_type {
+    return Read(key, [](const std::pair<key_type, value_type> *entry) {
+      return entry != nullptr ? entry->second : value_type();
+    });
+  }
+
   auto operator[](const key_type &key) const -> value_type {
-    size_type bucket_index = BucketIndex(key);
+    size_t hash = hasher_(key);
+    if (!filter_.MayContain(hash)) {
+      return value_type();
+    }
+    size_type bucket_index = bucket_policy_.Index(hash);
     for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
       if (key_equaler_(key, pair_key)) {
         return pair_value;
@@ -230,8 +666,24 @@ public:
   }
 };
 
+// Entries or buckets below which a thread of HashMap::BulkBuild() or
+// HashMap::ForEachParallel() is not worth starting
+inline constexpr std::size_t kParallelGrain = 1 << 14;
+
+// Threads used when a parallel operation is passed 0
+inline auto DefaultThreadCount() -> std::size_t {
+  return Max(static_cast<std::size_t>(std::thread::hardware_concurrency()),
+             static_cast<std::size_t>(1));
+}
+
+// A Filter such as CountingBloomFilter answers most lookups of absent keys
+// from one cache line. It pays off when a bucket walk costs more than that,
+// e.g. for string keys; small inline buckets are about as cheap.
 template <typename K, typename V, typename Hash = std::hash<K>,
-          typename KeyEqual = std::equal_to<K>>
+          typename KeyEqual = std::equal_to<K>,
+          typename BucketPolicy = PowerOfTwoBucketPolicy,
+          template <typename> class Bucket = InlineBucket,
+          typename Filter = NoFilter>
 class HashMap {
 public:
   using key_type = K;
@@ -241,10 +693,14 @@ public:
   using const_reference = const V &;
 
 private:
-  ts_stl::Array<ts_stl::Vector<std::pair<key_type, value_type>>> bucket_;
+  using bucket_type = Bucket<std::pair<key_type, value_type>>;
+
+  BucketPolicy bucket_policy_;
 
   size_type bucket_size_;
 
+  ts_stl::Array<bucket_type> bucket_;
+
   size_type size_;
 
   const double expand_factor_;
@@ -253,17 +709,108 @@ private:
 
   const KeyEqual key_equaler_;
 
-  auto BucketIndex(const key_type &key) const -> size_type {
-    return hasher_(key) % bucket_size_;
+  // Holds the hash of every entry
+  Filter filter_;
+
+  template <typename Q> auto BucketIndex(const Q &key) const -> size_type {
+    return bucket_policy_.Index(hasher_(key));
+  }
+
+  // Entries the table holds before it grows
+  auto FilterCapacity() const -> size_type {
+    return static_cast<size_type>(bucket_size_ * expand_factor_) + 1;
+  }
+
+  // Lookups by other key types need a transparent Hash and KeyEqual
+  template <typename Q>
+  using transparent_key_t =
+      std::enable_if_t<is_transparent<Hash>::value &&
+                           is_transparent<KeyEqual>::value,
+                       Q>;
+
+  template <typename Q>
+  auto FindEntry(const Q &key) const
+      -> const std::pair<key_type, value_type> * {
+    size_t hash = hasher_(key);
+    if (!filter_.MayContain(hash)) {
+      return nullptr;
+    }
+    for (auto &entry : bucket_[bucket_policy_.Index(hash)]) {
+      if (key_equaler_(key, entry.first)) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  template <typename Q> auto DeleteKey(const Q &key) -> bool {
+    bool deleted = false;
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
+    for (size_t index = 0; index < bucket_[bucket_index].size(); ++index) {
+      if (key_equaler_(key, bucket_[bucket_index][index].first)) {
+        bucket_[bucket_index].Delete(index);
+        filter_.Remove(hash);
+        --size_;
+        deleted = true;
+        break;
+      }
+    }
+    if (size_ * expand_factor_ * expand_factor_ < bucket_size_ && size_ > 4) {
+      Resize(size_ * expand_factor_);
+    }
+    return deleted;
+  }
+
+  // Calls fn(bucket) for every bucket, chunks of buckets handed out to
+  // threads from a shared cursor
+  template <typename Buckets, typename F>
+  static void ForEachBucketParallel(Buckets &bucket, size_type threads,
+                                    F fn) {
+    size_type bucket_size = bucket.size();
+    threads = Min(threads == 0 ? DefaultThreadCount() : threads,
+                  Max(bucket_size / kParallelGrain, static_cast<size_type>(1)));
+    // A few chunks per thread, so that threads finishing early take more
+    size_type chunk =
+        Max(bucket_size / (threads * 8), static_cast<size_type>(1));
+    std::atomic<size_type> next(0);
+    ParallelFor(threads, [&](size_type) {
+      for (size_type begin; (begin = next.fetch_add(chunk)) < bucket_size;) {
+        size_type end = Min(begin + chunk, bucket_size);
+        for (size_type i = begin; i < end; ++i) {
+          fn(bucket[i]);
+        }
+      }
+    });
+  }
+
+  // The key is only converted to key_type when it is inserted
+  template <typename Q> auto EntryOf(const Q &key) -> reference {
+    size_t hash = hasher_(key);
+    for (auto &[pair_key, pair_value] : bucket_[bucket_policy_.Index(hash)]) {
+      if (key_equaler_(key, pair_key)) {
+        return pair_value;
+      }
+    }
+    ++size_;
+    if (size_ > bucket_size_ * expand_factor_) {
+      Resize(size_);
+    }
+    size_type bucket_index = bucket_policy_.Index(hash);
+    bucket_[bucket_index].EmplaceBack(key_type(key), value_type());
+    filter_.Add(hash);
+    return bucket_[bucket_index].Back().second;
   }
 
 public:
   HashMap(double expand_factor = 2.0, Hash hasher = Hash(),
           KeyEqual key_equaler = KeyEqual())
-      : bucket_(1), bucket_size_(1), size_(0), expand_factor_(expand_factor),
+      : bucket_size_(bucket_policy_.Reset(1)), bucket_(bucket_size_), size_(0),
+        expand_factor_(expand_factor),
         hasher_(hasher), key_equaler_(key_equaler) {
     Assert(expand_factor > 1.0,
            "HashMap: expand_factor must be greater than 1.0.");
+    filter_.Reset(FilterCapacity());
   }
 
   HashMap(const HashMap &) = default;
@@ -277,36 +824,222 @@ public:
   auto operator=(HashMap &&) -> HashMap & = default;
 
   void Resize(size_type new_bucket_size) {
-    ts_stl::Array<ts_stl::Vector<std::pair<key_type, value_type>>> new_bucket(
-        new_bucket_size);
+    BucketPolicy new_bucket_policy;
+    new_bucket_size = new_bucket_policy.Reset(new_bucket_size);
+    ts_stl::Array<bucket_type> new_bucket(new_bucket_size);
+
+    // Size every new bucket exactly, so entries are moved once and no bucket
+    // reallocates while filling
+    ts_stl::Array<size_type> count(new_bucket_size);
+    Fill(count.begin(), count.end(), static_cast<size_type>(0));
+    for (auto &bucket : bucket_) {
+      for (auto &[pair_key, pair_value] : bucket) {
+        ++count[new_bucket_policy.Index(hasher_(pair_key))];
+      }
+    }
+    for (size_type i = 0; i < new_bucket_size; ++i) {
+      if (count[i] != 0) {
+        new_bucket[i].Reserve(count[i]);
+      }
+    }
 
+    bucket_size_ = new_bucket_size;
+    filter_.Reset(FilterCapacity());
     for (auto &bucket : bucket_) {
       for (auto &[pair_key, pair_value] : bucket) {
-        new_bucket[hasher_(pair_key) % new_bucket_size].EmplaceBack(
+        size_t hash = hasher_(pair_key);
+        new_bucket[new_bucket_policy.Index(hash)].EmplaceBack(
             std::move(pair_key), std::move(pair_value));
+        filter_.Add(hash);
       }
     }
 
-    bucket_ = new_bucket;
-    bucket_size_ = new_bucket_size;
+    bucket_ = std::move(new_bucket);
+    bucket_policy_ = new_bucket_policy;
+  }
+
+  // Sizes the table once for size entries, so inserting up to size entries
+  // does not rehash
+  void Reserve(size_type size) {
+    if (size > bucket_size_ * expand_factor_) {
+      Resize(static_cast<size_type>(size / expand_factor_) + 1);
+    }
   }
 
   auto bucket_size() const -> size_type { return bucket_size_; }
 
   auto size() const -> size_type { return size_; }
 
-  auto Contains(const key_type &key) const -> bool {
-    size_type bucket_index = BucketIndex(key);
-    for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
-      if (key_equaler_(key, pair_key)) {
-        return true;
+  void Clear() {
+    bucket_size_ = bucket_policy_.Reset(1);
+    bucket_ = ts_stl::Array<bucket_type>(bucket_size_);
+    size_ = 0;
+    filter_.Reset(FilterCapacity());
+  }
+
+  // Calls fn(key, value) for every entry
+  template <typename F> void ForEach(F fn) {
+    for (auto &bucket : bucket_) {
+      for (auto &[pair_key, pair_value] : bucket) {
+        fn(static_cast<const key_type &>(pair_key), pair_value);
       }
     }
-    return false;
+  }
+
+  template <typename F> void ForEach(F fn) const {
+    for (auto &bucket : bucket_) {
+      for (auto &[pair_key, pair_value] : bucket) {
+        fn(pair_key, pair_value);
+      }
+    }
+  }
+
+  // Calls fn(key, value) for every entry from up to threads threads at
+  // once, so fn must be safe to call concurrently. Threads take chunks of
+  // the bucket array in turn. threads 0 picks DefaultThreadCount().
+  template <typename F>
+  void ForEachParallel(F fn, size_type threads = 0) {
+    ForEachBucketParallel(bucket_, threads, [&fn](bucket_type &bucket) {
+      for (auto &[pair_key, pair_value] : bucket) {
+        fn(static_cast<const key_type &>(pair_key), pair_value);
+      }
+    });
+  }
+
+  template <typename F>
+  void ForEachParallel(F fn, size_type threads = 0) const {
+    ForEachBucketParallel(bucket_, threads,
+                          [&fn](const bucket_type &bucket) {
+                            for (auto &[pair_key, pair_value] : bucket) {
+                              fn(pair_key, pair_value);
+                            }
+                          });
+  }
+
+  // Inserts every pair of a random access range of (key, value) pairs, as
+  // Insert() in order would. The table grows once up front. Then each
+  // thread splits a slice of the input by the bucket range its keys fall
+  // in, and each bucket range is filled by one thread without locks, taking
+  // the slices in input order so that the last value of a key wins.
+  // threads 0 picks DefaultThreadCount().
+  template <typename Range>
+  void BulkBuild(const Range &range, size_type threads = 0) {
+    auto first = std::begin(range);
+    size_type count = static_cast<size_type>(std::end(range) - first);
+    Reserve(size_ + count);
+    threads = Min(threads == 0 ? DefaultThreadCount() : threads,
+                  Max(count / kParallelGrain, static_cast<size_type>(1)));
+    if (threads == 1) {
+      for (size_type i = 0; i < count; ++i) {
+        Insert(first[i].first, first[i].second);
+      }
+      return;
+    }
+
+    // Input positions of slice s whose buckets fall in range r, at
+    // s * threads + r
+    ts_stl::Array<ts_stl::Vector<size_type>> positions(threads * threads);
+    ParallelFor(threads, [&](size_type slice) {
+      size_type begin = count * slice / threads;
+      size_type end = count * (slice + 1) / threads;
+      for (size_type i = begin; i < end; ++i) {
+        size_type range_index =
+            BucketIndex(first[i].first) * threads / bucket_size_;
+        positions[slice * threads + range_index].PushBack(i);
+      }
+    });
+
+    ts_stl::Array<size_type> inserted(threads);
+    ParallelFor(threads, [&](size_type range_index) {
+      size_type n = 0;
+      for (size_type slice = 0; slice < threads; ++slice) {
+        for (size_type i : positions[slice * threads + range_index]) {
+          const auto &key = first[i].first;
+          size_t hash = hasher_(key);
+          auto &bucket = bucket_[bucket_policy_.Index(hash)];
+          bool found = false;
+          for (auto &[pair_key, pair_value] : bucket) {
+            if (key_equaler_(key, pair_key)) {
+              pair_value = first[i].second;
+              found = true;
+              break;
+            }
+          }
+          if (!found) {
+            bucket.PushBack(std::make_pair(key, first[i].second));
+            // Filters update atomically
+            filter_.Add(hash);
+            ++n;
+          }
+        }
+      }
+      inserted[range_index] = n;
+    });
+    for (size_type n : inserted) {
+      size_ += n;
+    }
+  }
+
+  // The value of key, or nullptr if absent
+  auto Find(const key_type &key) -> value_type * {
+    auto entry = FindEntry(key);
+    return entry ? const_cast<value_type *>(&entry->second) : nullptr;
+  }
+
+  auto Find(const key_type &key) const -> const value_type * {
+    auto entry = FindEntry(key);
+    return entry ? &entry->second : nullptr;
+  }
+
+  auto Contains(const key_type &key) const -> bool {
+    return FindEntry(key) != nullptr;
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto Contains(const Q &key) const -> bool {
+    return FindEntry(key) != nullptr;
+  }
+
+  // results[i] points to the value of keys[i], or is nullptr if absent
+  void FindBatch(const key_type *keys, size_type count,
+                 const value_type **results) const {
+    ProbeBatch(
+        bucket_.Data(), keys, count,
+        [this](const key_type &key) { return BucketIndex(key); },
+        [&](size_type i, const auto &bucket) {
+          results[i] = nullptr;
+          for (auto &[pair_key, pair_value] : bucket) {
+            if (key_equaler_(keys[i], pair_key)) {
+              results[i] = &pair_value;
+              return;
+            }
+          }
+        });
+  }
+
+  void InsertBatch(const key_type *keys, const value_type *values,
+                   size_type count) {
+    // Grow once up front, so buckets stay put while the batch is probed
+    Reserve(size_ + count);
+    ProbeBatch(
+        bucket_.Data(), keys, count,
+        [this](const key_type &key) { return BucketIndex(key); },
+        [&](size_type i, auto &bucket) {
+          for (auto &[pair_key, pair_value] : bucket) {
+            if (key_equaler_(keys[i], pair_key)) {
+              pair_value = values[i];
+              return;
+            }
+          }
+          bucket.PushBack(std::make_pair(keys[i], values[i]));
+          filter_.Add(hasher_(keys[i]));
+          ++size_;
+        });
   }
 
   void Insert(const key_type &key, const value_type &value) {
-    size_type bucket_index = BucketIndex(key);
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
     for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
       if (key_equaler_(key, pair_key)) {
         pair_value = value;
@@ -314,6 +1047,7 @@ public:
       }
     }
     bucket_[bucket_index].PushBack(std::make_pair(key, value));
+    filter_.Add(hash);
     ++size_;
     if (size_ > bucket_size_ * expand_factor_) {
       Resize(size_);
@@ -321,7 +1055,8 @@ public:
   }
 
   void Insert(const key_type &key, value_type &&value) {
-    size_type bucket_index = BucketIndex(key);
+    size_t hash = hasher_(key);
+    size_type bucket_index = bucket_policy_.Index(hash);
     for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
       if (key_equaler_(key, pair_key)) {
         pair_value = std::move(value);
@@ -329,60 +1064,369 @@ public:
       }
     }
     bucket_[bucket_index].EmplaceBack(std::make_pair(key, std::move(value)));
+    filter_.Add(hash);
     ++size_;
     if (size_ > bucket_size_ * expand_factor_) {
       Resize(size_);
     }
   }
 
-  auto Delete(const key_type &key) -> bool {
-    bool deleted = false;
-    size_type bucket_index = BucketIndex(key);
-    for (size_t index = 0; index < bucket_[bucket_index].size(); ++index) {
-      if (key_equaler_(key, bucket_[bucket_index][index].first)) {
-        bucket_[bucket_index].Delete(index);
-        --size_;
-        deleted = true;
-        break;
-      }
-    }
-    if (size_ * expand_factor_ * expand_factor_ < bucket_size_ && size_ > 4) {
-      Resize(size_ * expand_factor_);
-    }
-    return deleted;
+  auto Delete(const key_type &key) -> bool { return DeleteKey(key); }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto Delete(const Q &key) -> bool {
+    return DeleteKey(key);
   }
 
-  auto operator[](const key_type &key) -> reference {
-    size_type bucket_index = BucketIndex(key);
-    for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
-      if (key_equaler_(key, pair_key)) {
-        return pair_value;
+  auto operator[](const key_type &key) -> reference { return EntryOf(key); }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto operator[](const Q &key) -> reference {
+    return EntryOf(key);
+  }
+
+  auto operator[](const key_type &key) const -> const_reference {
+    static const value_type default_value{};
+    auto entry = FindEntry(key);
+    return entry ? entry->second : default_value;
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto operator[](const Q &key) const -> const_reference {
+    static const value_type default_value{};
+    auto entry = FindEntry(key);
+    return entry ? entry->second : default_value;
+  }
+};
+
+// Open addressing hash map in the SwissTable layout: one control byte per
+// slot, probed 16 slots at a time.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>>
+class FlatHashMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+  using reference = V &;
+  using const_reference = const V &;
+
+private:
+  using slot_type = std::pair<key_type, value_type>;
+
+  static constexpr size_type kGroupWidth = 16;
+
+  // Full slots store the low 7 bits of the hash
+  static constexpr int8_t kEmpty = -128;
+
+  static constexpr int8_t kDeleted = -2;
+
+  class Group {
+  private:
+#ifdef __SSE2__
+    __m128i ctrl_;
+#else
+    const int8_t *ctrl_;
+#endif
+
+  public:
+#ifdef __SSE2__
+    explicit Group(const int8_t *ctrl)
+        : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl))) {}
+
+    auto Match(int8_t h2) const -> uint32_t {
+      return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_));
+    }
+
+    auto MatchEmpty() const -> uint32_t { return Match(kEmpty); }
+
+    auto MatchEmptyOrDeleted() const -> uint32_t {
+      return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl_));
+    }
+#else
+    explicit Group(const int8_t *ctrl) : ctrl_(ctrl) {}
+
+    auto Match(int8_t h2) const -> uint32_t {
+      uint32_t mask = 0;
+      for (size_type i = 0; i < kGroupWidth; ++i) {
+        mask |= static_cast<uint32_t>(ctrl_[i] == h2) << i;
       }
+      return mask;
     }
+
+    auto MatchEmpty() const -> uint32_t { return Match(kEmpty); }
+
+    auto MatchEmptyOrDeleted() const -> uint32_t {
+      uint32_t mask = 0;
+      for (size_type i = 0; i < kGroupWidth; ++i) {
+        mask |= static_cast<uint32_t>(ctrl_[i] < -1) << i;
+      }
+      return mask;
+    }
+#endif
+  };
+
+  // capacity_ + kGroupWidth bytes, the tail mirrors the first group so that
+  // a group can be loaded at any slot
+  int8_t *ctrl_ = nullptr;
+
+  slot_type *slots_ = nullptr;
+
+  // 0 or a power of two no less than kGroupWidth
+  size_type capacity_ = 0;
+
+  size_type size_ = 0;
+
+  // Insertions into empty slots left before a rehash
+  size_type growth_left_ = 0;
+
+  Hash hasher_;
+
+  KeyEqual key_equaler_;
+
+  static auto MaxSize(size_type capacity) -> size_type {
+    return capacity - capacity / 8;
+  }
+
+  static auto H1(size_t hash) -> size_type { return hash >> 7; }
+
+  static auto H2(size_t hash) -> int8_t {
+    return static_cast<int8_t>(hash & 0x7F);
+  }
+
+  auto HashOf(const key_type &key) const -> size_t {
+    return MixHash(hasher_(key));
+  }
+
+  void SetCtrl(size_type index, int8_t h) {
+    ctrl_[index] = h;
+    if (index < kGroupWidth) {
+      ctrl_[capacity_ + index] = h;
+    }
+  }
+
+  auto FindIndex(const key_type &key, size_t hash) const -> size_type {
+    if (capacity_ == 0) {
+      return capacity_;
+    }
+    size_type mask = capacity_ - 1;
+    size_type offset = H1(hash) & mask;
+    for (size_type step = kGroupWidth;; step += kGroupWidth) {
+      Group group(ctrl_ + offset);
+      for (uint32_t m = group.Match(H2(hash)); m; m &= m - 1) {
+        size_type index = (offset + __builtin_ctz(m)) & mask;
+        if (key_equaler_(key, slots_[index].first)) {
+          return index;
+        }
+      }
+      if (group.MatchEmpty()) {
+        return capacity_;
+      }
+      offset = (offset + step) & mask;
+    }
+  }
+
+  auto FindInsertIndex(size_t hash) const -> size_type {
+    size_type mask = capacity_ - 1;
+    size_type offset = H1(hash) & mask;
+    for (size_type step = kGroupWidth;; step += kGroupWidth) {
+      if (uint32_t m = Group(ctrl_ + offset).MatchEmptyOrDeleted(); m) {
+        return (offset + __builtin_ctz(m)) & mask;
+      }
+      offset = (offset + step) & mask;
+    }
+  }
+
+  void Rehash(size_type new_capacity) {
+    int8_t *old_ctrl = ctrl_;
+    slot_type *old_slots = slots_;
+    size_type old_capacity = capacity_;
+
+    capacity_ = new_capacity;
+    ctrl_ = new int8_t[capacity_ + kGroupWidth];
+    Fill(ctrl_, ctrl_ + capacity_ + kGroupWidth, kEmpty);
+    slots_ = std::allocator<slot_type>().allocate(capacity_);
+    growth_left_ = MaxSize(capacity_) - size_;
+
+    for (size_type i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] >= 0) {
+        size_t hash = HashOf(old_slots[i].first);
+        size_type index = FindInsertIndex(hash);
+        SetCtrl(index, H2(hash));
+        new (slots_ + index) slot_type(std::move(old_slots[i]));
+        old_slots[i].~slot_type();
+      }
+    }
+    delete[] old_ctrl;
+    if (old_slots) {
+      std::allocator<slot_type>().deallocate(old_slots, old_capacity);
+    }
+  }
+
+  // Returns the slot of key and whether it was inserted, the value is
+  // constructed from args only on insertion
+  template <typename... Args>
+  auto FindOrEmplace(const key_type &key, Args &&...args)
+      -> std::pair<slot_type *, bool> {
+    size_t hash = HashOf(key);
+    if (size_type index = FindIndex(key, hash); index != capacity_) {
+      return {slots_ + index, false};
+    }
+    if (growth_left_ == 0) {
+      // Reuse the capacity if most of the used slots are tombstones
+      Rehash(size_ * 2 < MaxSize(capacity_) ? Max(capacity_, kGroupWidth)
+                                            : Max(capacity_ * 2, kGroupWidth));
+    }
+    size_type index = FindInsertIndex(hash);
+    if (ctrl_[index] == kEmpty) {
+      --growth_left_;
+    }
+    SetCtrl(index, H2(hash));
+    new (slots_ + index) slot_type(key, value_type(std::forward<Args>(args)...));
     ++size_;
-    if (size_ > bucket_size_ * expand_factor_) {
-      Resize(size_);
+    return {slots_ + index, true};
+  }
+
+  void Destroy() {
+    for (size_type i = 0; i < capacity_; ++i) {
+      if (ctrl_[i] >= 0) {
+        slots_[i].~slot_type();
+      }
     }
-    bucket_index = BucketIndex(key);
-    bucket_[bucket_index].EmplaceBack(std::make_pair(key, value_type()));
-    return bucket_[bucket_index].Back().second;
+    delete[] ctrl_;
+    if (slots_) {
+      std::allocator<slot_type>().deallocate(slots_, capacity_);
+    }
+    ctrl_ = nullptr;
+    slots_ = nullptr;
+    capacity_ = size_ = growth_left_ = 0;
   }
 
-  auto operator[](const key_type &key) const -> const_reference {
-    size_type bucket_index = BucketIndex(key);
-    for (auto &[pair_key, pair_value] : bucket_[bucket_index]) {
-      if (key_equaler_(key, pair_key)) {
-        return pair_value;
+public:
+  FlatHashMap(Hash hasher = Hash(), KeyEqual key_equaler = KeyEqual())
+      : hasher_(hasher), key_equaler_(key_equaler) {}
+
+  FlatHashMap(const FlatHashMap &other)
+      : capacity_(other.capacity_), size_(other.size_),
+        growth_left_(other.growth_left_), hasher_(other.hasher_),
+        key_equaler_(other.key_equaler_) {
+    if (capacity_ != 0) {
+      ctrl_ = new int8_t[capacity_ + kGroupWidth];
+      Copy(ctrl_, other.ctrl_, other.ctrl_ + capacity_ + kGroupWidth);
+      slots_ = std::allocator<slot_type>().allocate(capacity_);
+      for (size_type i = 0; i < capacity_; ++i) {
+        if (ctrl_[i] >= 0) {
+          new (slots_ + i) slot_type(other.slots_[i]);
+        }
       }
     }
-    return value_type();
+  }
+
+  FlatHashMap(FlatHashMap &&other)
+      : ctrl_(other.ctrl_), slots_(other.slots_), capacity_(other.capacity_),
+        size_(other.size_), growth_left_(other.growth_left_),
+        hasher_(other.hasher_), key_equaler_(other.key_equaler_) {
+    other.ctrl_ = nullptr;
+    other.slots_ = nullptr;
+    other.capacity_ = other.size_ = other.growth_left_ = 0;
+  }
+
+  ~FlatHashMap() { Destroy(); }
+
+  auto operator=(const FlatHashMap &other) -> FlatHashMap & {
+    if (this != &other) {
+      FlatHashMap copy(other);
+      *this = std::move(copy);
+    }
+    return *this;
+  }
+
+  auto operator=(FlatHashMap &&other) -> FlatHashMap & {
+    if (this != &other) {
+      Destroy();
+      ctrl_ = other.ctrl_;
+      slots_ = other.slots_;
+      capacity_ = other.capacity_;
+      size_ = other.size_;
+      growth_left_ = other.growth_left_;
+      hasher_ = other.hasher_;
+      key_equaler_ = other.key_equaler_;
+      other.ctrl_ = nullptr;
+      other.slots_ = nullptr;
+      other.capacity_ = other.size_ = other.growth_left_ = 0;
+    }
+    return *this;
+  }
+
+  auto bucket_size() const -> size_type { return capacity_; }
+
+  auto size() const -> size_type { return size_; }
+
+  auto Empty() const -> bool { return size_ == 0; }
+
+  void Clear() { Destroy(); }
+
+  void Reserve(size_type size) {
+    size_type capacity = kGroupWidth;
+    while (MaxSize(capacity) < size) {
+      capacity <<= 1;
+    }
+    if (capacity > capacity_) {
+      Rehash(capacity);
+    }
+  }
+
+  auto Entry(const key_type &key) -> reference { return operator[](key); }
+
+  auto Contains(const key_type &key) const -> bool {
+    return FindIndex(key, HashOf(key)) != capacity_;
+  }
+
+  void Insert(const key_type &key, const value_type &value) {
+    if (auto [slot, inserted] = FindOrEmplace(key, value); !inserted) {
+      slot->second = value;
+    }
+  }
+
+  void Insert(const key_type &key, value_type &&value) {
+    if (auto [slot, inserted] = FindOrEmplace(key, std::move(value));
+        !inserted) {
+      slot->second = std::move(value);
+    }
+  }
+
+  auto Delete(const key_type &key) -> bool {
+    size_type index = FindIndex(key, HashOf(key));
+    if (index == capacity_) {
+      return false;
+    }
+    slots_[index].~slot_type();
+    SetCtrl(index, kDeleted);
+    --size_;
+    return true;
+  }
+
+  auto operator[](const key_type &key) -> reference {
+    return FindOrEmplace(key).first->second;
+  }
+
+  auto operator[](const key_type &key) const -> const_reference {
+    static const value_type default_value{};
+    size_type index = FindIndex(key, HashOf(key));
+    return index == capacity_ ? default_value : slots_[index].second;
   }
 };
 
+// HashMap guarded by lock stripes, resized incrementally by the writers.
+// Buckets use the Bucket layout of HashMap and are indexed by the high bits
+// of a fibonacci hash like PowerOfTwoBucketPolicy. A stripe owns the
+// buckets sharing the top bits of its index, which stay the same when the
+// table doubles, so a key is guarded by one stripe in the old and new table.
 template <typename K, typename V, typename Hash = std::hash<K>,
-          typename KeyEqual = std::equal_to<K>>
+          typename KeyEqual = std::equal_to<K>,
+          typename Mutex = std::shared_mutex,
+          template <typename> class Bucket = InlineBucket>
 class SyncHashMap {
-
 public:
   using key_type = K;
   using value_type = V;
@@ -391,10 +1435,880 @@ public:
   using const_reference = const V &;
 
 private:
+  using bucket_type = Bucket<std::pair<key_type, value_type>>;
+
+  struct alignas(kCacheLineSize) Stripe {
+    Mutex m;
+
+    // Entries in the buckets of this stripe, drives resizing without a
+    // shared counter
+    size_type size = 0;
+  };
+
+  // Old buckets moved by a writer after each write during a resize
+  static constexpr size_type kMigrateBatch = 2;
+
+  // Indexes the stripes by the top bits of the bucket index
+  PowerOfTwoBucketPolicy stripe_policy_;
+
+  const size_type stripe_size_;
+
+  // Resized only while holding every stripe lock, never smaller than
+  // stripe_size_
+  PowerOfTwoBucketPolicy bucket_policy_;
+
+  size_type bucket_size_;
+
+  ts_stl::Array<bucket_type> bucket_;
+
+  // The table being migrated from, old_bucket_size_ is 0 if not resizing
+  PowerOfTwoBucketPolicy old_bucket_policy_;
+
+  size_type old_bucket_size_;
+
+  ts_stl::Array<bucket_type> old_bucket_;
+
+  // Next old bucket to migrate for each stripe
+  ts_stl::Array<size_type> migrate_index_;
+
+  std::atomic<size_type> migrated_stripes_;
+
+  std::atomic<size_type> help_index_;
+
+  ShardedCounter size_;
+
+  const double expand_factor_;
+
+  const Hash hasher_;
+
+  const KeyEqual key_equaler_;
+
+  mutable ts_stl::Array<Stripe> stripe_;
+
+  auto StripeIndex(size_t hash) const -> size_type {
+    return stripe_policy_.Index(hash);
+  }
+
+  // The old buckets of a stripe are [stripe, stripe + 1) * OldStripeBuckets()
+  auto OldStripeBuckets() const -> size_type {
+    return old_bucket_size_ / stripe_size_;
+  }
+
+  void LockAll() {
+    for (auto &stripe : stripe_) {
+      stripe.m.lock();
+    }
+  }
+
+  void UnlockAll() {
+    for (auto &stripe : stripe_) {
+      stripe.m.unlock();
+    }
+  }
+
+  // Caller holds the unique lock of the bucket's stripe
+  void MigrateBucket(size_type old_index) {
+    for (auto &entry : old_bucket_[old_index]) {
+      bucket_[bucket_policy_.Index(hasher_(entry.first))].EmplaceBack(
+          std::move(entry));
+    }
+    old_bucket_[old_index].Clear();
+  }
+
+  // Caller holds the unique lock of the stripe. Returns true if the call
+  // migrated the last old bucket of the whole table.
+  auto MigrateStripe(size_type stripe) -> bool {
+    size_type end = (stripe + 1) * OldStripeBuckets();
+    if (old_bucket_size_ == 0 || migrate_index_[stripe] >= end) {
+      return false;
+    }
+    for (size_type i = 0; i < kMigrateBatch && migrate_index_[stripe] < end;
+         ++i) {
+      MigrateBucket(migrate_index_[stripe]++);
+    }
+    return migrate_index_[stripe] >= end &&
+           migrated_stripes_.fetch_add(1) + 1 == stripe_size_;
+  }
+
+  // Caller holds the unique lock of the key's stripe
+  auto WriteBucket(size_t hash) -> bucket_type & {
+    if (old_bucket_size_ != 0) {
+      size_type old_index = old_bucket_policy_.Index(hash);
+      if (!old_bucket_[old_index].Empty()) {
+        MigrateBucket(old_index);
+      }
+    }
+    return bucket_[bucket_policy_.Index(hash)];
+  }
+
+  // Caller holds a lock of the bucket's stripe
+  auto FindIn(bucket_type &bucket, const key_type &key)
+      -> std::pair<key_type, value_type> * {
+    for (auto &entry : bucket) {
+      if (key_equaler_(key, entry.first)) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  // Caller holds a lock of the key's stripe
+  auto FindEntry(const key_type &key, size_t hash) const
+      -> const std::pair<key_type, value_type> * {
+    if (old_bucket_size_ != 0) {
+      for (auto &entry : old_bucket_[old_bucket_policy_.Index(hash)]) {
+        if (key_equaler_(key, entry.first)) {
+          return &entry;
+        }
+      }
+    }
+    for (auto &entry : bucket_[bucket_policy_.Index(hash)]) {
+      if (key_equaler_(key, entry.first)) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  void FinishResize() {
+    ts_stl::Array<bucket_type> retired;
+    LockAll();
+    if (old_bucket_size_ != 0 && migrated_stripes_ == stripe_size_) {
+      retired = std::move(old_bucket_);
+      old_bucket_size_ = 0;
+    }
+    UnlockAll();
+    // The old table is freed outside of the locks
+  }
+
+  void Expand(size_type observed_bucket_size) {
+    PowerOfTwoBucketPolicy new_bucket_policy;
+    size_type new_bucket_size =
+        new_bucket_policy.Reset(observed_bucket_size * 2);
+    ts_stl::Array<bucket_type> new_bucket(new_bucket_size);
+    LockAll();
+    if (bucket_size_ == observed_bucket_size && old_bucket_size_ == 0) {
+      old_bucket_ = std::move(bucket_);
+      old_bucket_policy_ = bucket_policy_;
+      old_bucket_size_ = bucket_size_;
+      bucket_ = std::move(new_bucket);
+      bucket_policy_ = new_bucket_policy;
+      bucket_size_ = new_bucket_size;
+      for (size_type i = 0; i < stripe_size_; ++i) {
+        migrate_index_[i] = i * OldStripeBuckets();
+      }
+      migrated_stripes_ = 0;
+    }
+    UnlockAll();
+  }
+
+  // Called without any lock held after a write
+  void Rebalance(size_type observed_bucket_size, bool resizing,
+                 bool overloaded) {
+    if (resizing) {
+      size_type stripe = help_index_.fetch_add(1) % stripe_size_;
+      bool finished;
+      {
+        std::unique_lock<Mutex> lock(stripe_[stripe].m);
+        finished = MigrateStripe(stripe);
+      }
+      if (finished) {
+        FinishResize();
+      }
+    } else if (overloaded) {
+      Expand(observed_bucket_size);
+    }
+  }
+
+  // fn(bucket) returns the change in the number of entries
+  template <typename F> void Write(const key_type &key, F fn) {
+    size_t hash = hasher_(key);
+    size_type stripe = StripeIndex(hash);
+    size_type observed_bucket_size;
+    bool resizing;
+    bool overloaded;
+    bool finished;
+    {
+      std::unique_lock<Mutex> lock(stripe_[stripe].m);
+      int delta = fn(WriteBucket(hash));
+      if (delta != 0) {
+        stripe_[stripe].size += delta;
+        size_.Add(delta);
+      }
+      finished = MigrateStripe(stripe);
+      observed_bucket_size = bucket_size_;
+      resizing = old_bucket_size_ != 0;
+      overloaded = stripe_[stripe].size >
+                   bucket_size_ / stripe_size_ * expand_factor_;
+    }
+    if (finished) {
+      FinishResize();
+    } else {
+      Rebalance(observed_bucket_size, resizing, overloaded);
+    }
+  }
+
 public:
-  SyncHashMap() { Assert(false, "SyncHashMap: Unimplemented!"); }
+  // stripe_size 0 picks DefaultStripeSize(), it is rounded up to a power of
+  // two no smaller than 2
+  SyncHashMap(size_type stripe_size = 0, double expand_factor = 2.0,
+              Hash hasher = Hash(), KeyEqual key_equaler = KeyEqual())
+      : stripe_size_(stripe_policy_.Reset(
+            stripe_size == 0 ? DefaultStripeSize() : stripe_size)),
+        bucket_size_(bucket_policy_.Reset(stripe_size_)),
+        bucket_(bucket_size_), old_bucket_size_(0), old_bucket_(0),
+        migrate_index_(stripe_size_), migrated_stripes_(0), help_index_(0),
+        expand_factor_(expand_factor), hasher_(hasher),
+        key_equaler_(key_equaler), stripe_(stripe_size_) {
+    Assert(expand_factor > 0.0,
+           "SyncHashMap: expand_factor must be greater than 0.0.");
+  }
+
+  SyncHashMap(const SyncHashMap &) = delete;
 
   ~SyncHashMap() = default;
+
+  auto operator=(const SyncHashMap &) -> SyncHashMap & = delete;
+
+  // Lock-free, exact whenever no write is in flight
+  auto size() const -> size_type {
+    return static_cast<size_type>(Max<int64_t>(size_.Load(), 0));
+  }
+
+  auto stripe_size() const -> size_type { return stripe_size_; }
+
+  auto bucket_size() const -> size_type {
+    std::shared_lock<Mutex> lock(stripe_[0].m);
+    return bucket_size_;
+  }
+
+  auto Contains(const key_type &key) const -> bool {
+    size_t hash = hasher_(key);
+    std::shared_lock<Mutex> lock(stripe_[StripeIndex(hash)].m);
+    return FindEntry(key, hash) != nullptr;
+  }
+
+  void Insert(const key_type &key, const value_type &value) {
+    Write(key, [&](bucket_type &bucket) {
+      for (auto &[pair_key, pair_value] : bucket) {
+        if (key_equaler_(key, pair_key)) {
+          pair_value = value;
+          return 0;
+        }
+      }
+      bucket.PushBack(std::make_pair(key, value));
+      return 1;
+    });
+  }
+
+  void Insert(const key_type &key, value_type &&value) {
+    Write(key, [&](bucket_type &bucket) {
+      for (auto &[pair_key, pair_value] : bucket) {
+        if (key_equaler_(key, pair_key)) {
+          pair_value = std::move(value);
+          return 0;
+        }
+      }
+      bucket.EmplaceBack(std::make_pair(key, std::move(value)));
+      return 1;
+    });
+  }
+
+  auto Delete(const key_type &key) -> bool {
+    bool deleted = false;
+    Write(key, [&](bucket_type &bucket) {
+      for (size_t index = 0; index < bucket.size(); ++index) {
+        if (key_equaler_(key, bucket[index].first)) {
+          bucket.Delete(index);
+          deleted = true;
+          return -1;
+        }
+      }
+      return 0;
+    });
+    return deleted;
+  }
+
+  // Calls fn(value) if key exists, otherwise constructs its value from args.
+  // Returns whether the value was inserted.
+  template <typename F, typename... Args>
+  auto Upsert(const key_type &key, F fn, Args &&...args) -> bool {
+    bool inserted = false;
+    Write(key, [&](bucket_type &bucket) {
+      if (auto entry = FindIn(bucket, key)) {
+        fn(entry->second);
+        return 0;
+      }
+      bucket.EmplaceBack(std::piecewise_construct, std::forward_as_tuple(key),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+      inserted = true;
+      return 1;
+    });
+    return inserted;
+  }
+
+  // Returns the value of key, inserting factory() first if key is absent
+  template <typename F>
+  auto ComputeIfAbsent(const key_type &key, F factory) -> value_type {
+    value_type result;
+    Write(key, [&](bucket_type &bucket) {
+      if (auto entry = FindIn(bucket, key)) {
+        result = entry->second;
+        return 0;
+      }
+      bucket.EmplaceBack(std::piecewise_construct, std::forward_as_tuple(key),
+                         std::forward_as_tuple(factory()));
+      result = bucket.Back().second;
+      return 1;
+    });
+    return result;
+  }
+
+  // Constructs the value of key from args unless key exists
+  template <typename... Args>
+  auto InsertIfAbsent(const key_type &key, Args &&...args) -> bool {
+    bool inserted = false;
+    Write(key, [&](bucket_type &bucket) {
+      if (FindIn(bucket, key) != nullptr) {
+        return 0;
+      }
+      bucket.EmplaceBack(std::piecewise_construct, std::forward_as_tuple(key),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+      inserted = true;
+      return 1;
+    });
+    return inserted;
+  }
+
+  // Deletes key if pred(value) holds
+  template <typename P> auto EraseIf(const key_type &key, P pred) -> bool {
+    bool deleted = false;
+    Write(key, [&](bucket_type &bucket) {
+      for (size_t index = 0; index < bucket.size(); ++index) {
+        if (key_equaler_(key, bucket[index].first)) {
+          if (!pred(static_cast<const value_type &>(bucket[index].second))) {
+            return 0;
+          }
+          bucket.Delete(index);
+          deleted = true;
+          return -1;
+        }
+      }
+      return 0;
+    });
+    return deleted;
+  }
+
+  auto operator[](const key_type &key) const -> value_type {
+    size_t hash = hasher_(key);
+    std::shared_lock<Mutex> lock(stripe_[StripeIndex(hash)].m);
+    auto entry = FindEntry(key, hash);
+    return entry ? entry->second : value_type();
+  }
+};
+
+// Lock-free hash map over a split-ordered list (Shalev and Shavit). All
+// entries live in one Harris-Michael list sorted by bit-reversed hash, and
+// buckets are shortcuts into it, so doubling the bucket count never moves an
+// entry. Deleted entries and replaced values are freed through
+// EpochReclaimer.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>>
+class LockFreeHashMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+  using reference = V &;
+  using const_reference = const V &;
+
+private:
+  struct Node {
+    // Bit-reversed hash, odd for entries and even for bucket heads
+    const size_t order;
+
+    // The lowest bit marks this node as deleted
+    std::atomic<uintptr_t> next{0};
+
+    explicit Node(size_t order) : order(order) {}
+  };
+
+  struct Entry : Node {
+    const key_type key;
+
+    std::atomic<value_type *> value;
+
+    Entry(size_t order, const key_type &key, value_type *value)
+        : Node(order), key(key), value(value) {}
+
+    ~Entry() { delete value.load(std::memory_order_relaxed); }
+  };
+
+  static constexpr size_t kEntryBit = static_cast<size_t>(1) << 63;
+
+  // Segment 0 holds buckets [0, 2), segment s > 0 holds [2^s, 2^(s+1))
+  static constexpr size_type kSegmentCount = 63;
+
+  static constexpr size_type kMaxBucketSize = static_cast<size_type>(1) << 62;
+
+  // Inserts check the load factor once per this many on average, since
+  // summing the size is not free
+  static constexpr size_t kGrowCheckMask = 15;
+
+  mutable FixedArray<std::atomic<std::atomic<Node *> *>, kSegmentCount>
+      segments_;
+
+  std::atomic<size_type> bucket_size_;
+
+  ShardedCounter size_;
+
+  const double expand_factor_;
+
+  const Hash hasher_;
+
+  const KeyEqual key_equaler_;
+
+  static auto PointerOf(uintptr_t next) -> Node * {
+    return reinterpret_cast<Node *>(next & ~static_cast<uintptr_t>(1));
+  }
+
+  static auto WordOf(Node *node) -> uintptr_t {
+    return reinterpret_cast<uintptr_t>(node);
+  }
+
+  static void DeleteNode(Node *node) {
+    if (node->order & 1) {
+      delete static_cast<Entry *>(node);
+    } else {
+      delete node;
+    }
+  }
+
+  auto HashOf(const key_type &key) const -> size_t {
+    return MixHash(hasher_(key));
+  }
+
+  // Directory slot of bucket, allocating its segment on first use
+  auto Slot(size_type bucket) const -> std::atomic<Node *> & {
+    size_type segment = bucket < 2 ? 0 : FloorLog2(bucket);
+    size_type first = segment == 0 ? 0 : static_cast<size_type>(1) << segment;
+    std::atomic<Node *> *slots =
+        segments_[segment].load(std::memory_order_acquire);
+    if (slots == nullptr) {
+      auto *fresh = new std::atomic<Node *>[segment == 0 ? 2 : first]();
+      if (segments_[segment].compare_exchange_strong(
+              slots, fresh, std::memory_order_acq_rel,
+              std::memory_order_acquire)) {
+        slots = fresh;
+      } else {
+        delete[] fresh;
+      }
+    }
+    return slots[bucket - first];
+  }
+
+  // Head node of bucket, linked after the head of its parent bucket on
+  // first use. The parent drops the highest set bit of bucket, it is the
+  // bucket whose entries split into this one.
+  auto BucketHead(size_type bucket) const -> Node * {
+    std::atomic<Node *> &slot = Slot(bucket);
+    Node *head = slot.load(std::memory_order_acquire);
+    if (head != nullptr) {
+      return head;
+    }
+    size_type parent =
+        bucket & ~(static_cast<size_type>(1) << FloorLog2(bucket));
+    Node *fresh = new Node(ReverseBits(bucket));
+    std::atomic<uintptr_t> *prev;
+    Node *curr;
+    for (;;) {
+      if (Find(BucketHead(parent), fresh->order, nullptr, prev, curr)) {
+        delete fresh;
+        head = curr;
+        break;
+      }
+      uintptr_t expected = WordOf(curr);
+      fresh->next.store(expected, std::memory_order_relaxed);
+      if (prev->compare_exchange_strong(expected, WordOf(fresh),
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+        head = fresh;
+        break;
+      }
+    }
+    slot.store(head, std::memory_order_release);
+    return head;
+  }
+
+  auto HeadOf(size_t hash) const -> Node * {
+    size_type bucket_size = bucket_size_.load(std::memory_order_acquire);
+    return BucketHead(hash & (bucket_size - 1));
+  }
+
+  // Caller is inside an EpochGuard. Walks the list after head, unlinking
+  // deleted nodes on the way, to the node with order and key (a null key
+  // matches the bucket head of order). On return prev is the link in front
+  // of curr, and curr is the match or the first node ordered after it.
+  auto Find(Node *head, size_t order, const key_type *key,
+            std::atomic<uintptr_t> *&prev, Node *&curr) const -> bool {
+    for (;;) {
+      prev = &head->next;
+      curr = PointerOf(prev->load(std::memory_order_acquire));
+      bool restart = false;
+      while (curr != nullptr) {
+        uintptr_t next = curr->next.load(std::memory_order_acquire);
+        if (next & 1) {
+          uintptr_t expected = WordOf(curr);
+          if (!prev->compare_exchange_strong(expected, next & ~1,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_relaxed)) {
+            restart = true;
+            break;
+          }
+          // Only entries are ever deleted
+          Retire(static_cast<Entry *>(curr));
+          curr = PointerOf(next);
+          continue;
+        }
+        if (curr->order > order) {
+          return false;
+        }
+        if (curr->order == order &&
+            (key == nullptr ||
+             key_equaler_(*key, static_cast<Entry *>(curr)->key))) {
+          return true;
+        }
+        prev = &curr->next;
+        curr = PointerOf(next);
+      }
+      if (!restart) {
+        return false;
+      }
+    }
+  }
+
+  // Caller is inside an EpochGuard
+  auto FindEntry(const key_type &key) const -> Entry * {
+    size_t hash = HashOf(key);
+    std::atomic<uintptr_t> *prev;
+    Node *curr;
+    return Find(HeadOf(hash), ReverseBits(hash | kEntryBit), &key, prev, curr)
+               ? static_cast<Entry *>(curr)
+               : nullptr;
+  }
+
+  void Store(const key_type &key, value_type *value) {
+    EpochGuard guard;
+    size_t hash = HashOf(key);
+    size_t order = ReverseBits(hash | kEntryBit);
+    Node *head = HeadOf(hash);
+    Entry *entry = nullptr;
+    std::atomic<uintptr_t> *prev;
+    Node *curr;
+    for (;;) {
+      if (Find(head, order, &key, prev, curr)) {
+        auto found = static_cast<Entry *>(curr);
+        value_type *old =
+            found->value.exchange(value, std::memory_order_seq_cst);
+        // A Delete that marked the entry first would drop value with it. Take
+        // value back and insert a new entry instead, unless a later Insert
+        // has already replaced it.
+        if ((found->next.load(std::memory_order_seq_cst) & 1) &&
+            found->value.compare_exchange_strong(value, old,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_relaxed)) {
+          continue;
+        }
+        Retire(old);
+        if (entry != nullptr) {
+          entry->value.store(nullptr, std::memory_order_relaxed);
+          delete entry;
+        }
+        return;
+      }
+      if (entry == nullptr) {
+        entry = new Entry(order, key, value);
+      }
+      uintptr_t expected = WordOf(curr);
+      entry->next.store(expected, std::memory_order_relaxed);
+      if (prev->compare_exchange_strong(expected, WordOf(entry),
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    size_.Add(1);
+    if ((hash >> 56 & kGrowCheckMask) == 0) {
+      size_type bucket_size = bucket_size_.load(std::memory_order_relaxed);
+      if (bucket_size < kMaxBucketSize &&
+          static_cast<double>(size_.Load()) > bucket_size * expand_factor_) {
+        bucket_size_.compare_exchange_strong(bucket_size, bucket_size * 2,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed);
+      }
+    }
+  }
+
+public:
+  explicit LockFreeHashMap(double expand_factor = 2.0, Hash hasher = Hash(),
+                           KeyEqual key_equaler = KeyEqual())
+      : bucket_size_(2), expand_factor_(expand_factor), hasher_(hasher),
+        key_equaler_(key_equaler) {
+    Assert(expand_factor > 0.0,
+           "LockFreeHashMap: expand_factor must be greater than 0.0.");
+    for (auto &segment : segments_) {
+      segment.store(nullptr, std::memory_order_relaxed);
+    }
+    Slot(0).store(new Node(0), std::memory_order_release);
+  }
+
+  LockFreeHashMap(const LockFreeHashMap &) = delete;
+
+  // No thread may access the map any more, unlinked nodes already belong to
+  // the reclaimer
+  ~LockFreeHashMap() {
+    Node *node = Slot(0).load(std::memory_order_relaxed);
+    while (node != nullptr) {
+      Node *next = PointerOf(node->next.load(std::memory_order_relaxed));
+      DeleteNode(node);
+      node = next;
+    }
+    for (auto &segment : segments_) {
+      delete[] segment.load(std::memory_order_relaxed);
+    }
+  }
+
+  auto operator=(const LockFreeHashMap &) -> LockFreeHashMap & = delete;
+
+  // Lock-free, exact whenever no write is in flight
+  auto size() const -> size_type {
+    return static_cast<size_type>(Max<int64_t>(size_.Load(), 0));
+  }
+
+  auto bucket_size() const -> size_type {
+    return bucket_size_.load(std::memory_order_relaxed);
+  }
+
+  auto Contains(const key_type &key) const -> bool {
+    EpochGuard guard;
+    return FindEntry(key) != nullptr;
+  }
+
+  void Insert(const key_type &key, const value_type &value) {
+    Store(key, new value_type(value));
+  }
+
+  void Insert(const key_type &key, value_type &&value) {
+    Store(key, new value_type(std::move(value)));
+  }
+
+  auto Delete(const key_type &key) -> bool {
+    EpochGuard guard;
+    size_t hash = HashOf(key);
+    size_t order = ReverseBits(hash | kEntryBit);
+    Node *head = HeadOf(hash);
+    std::atomic<uintptr_t> *prev;
+    Node *curr;
+    for (;;) {
+      if (!Find(head, order, &key, prev, curr)) {
+        return false;
+      }
+      uintptr_t next = curr->next.load(std::memory_order_acquire);
+      if ((next & 1) ||
+          !curr->next.compare_exchange_strong(next, next | 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+        continue;
+      }
+      size_.Add(-1);
+      uintptr_t expected = WordOf(curr);
+      if (prev->compare_exchange_strong(expected, next,
+                                        std::memory_order_acq_rel,
+                                        std::memory_order_relaxed)) {
+        Retire(static_cast<Entry *>(curr));
+      } else {
+        // Whoever walks past the marked node unlinks it
+        Find(head, order, &key, prev, curr);
+      }
+      return true;
+    }
+  }
+
+  auto operator[](const key_type &key) const -> value_type {
+    EpochGuard guard;
+    Entry *entry = FindEntry(key);
+    return entry ? *entry->value.load(std::memory_order_acquire)
+                 : value_type();
+  }
+};
+
+// Default Merge of ShardedHashMap, adds values up
+template <typename V> struct AddMerge {
+  void operator()(V &into, const V &value) const { into += value; }
+};
+
+// Write-heavy aggregation map. Every thread adds into its own HashMap
+// shard, whose lock is only contended while a reader merges that shard, so
+// writers never wait for each other. Readers merge the shards on demand,
+// Fold() moves the shards into a merged map and can run periodically from a
+// background thread. Merge(into, value) combines two values of a key.
+template <typename K, typename V, typename Merge = AddMerge<V>,
+          typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class ShardedHashMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+  using map_type = HashMap<K, V, Hash, KeyEqual>;
+
+private:
+  struct alignas(kCacheLineSize) Shard {
+    SpinLock m;
+
+    map_type map;
+  };
+
+  using shard_table = ts_stl::Vector<Shard *>;
+
+  // Guards shards_, tables_ and merged_
+  mutable std::mutex m_;
+
+  ts_stl::Vector<Shard *> shards_;
+
+  // Shard of every thread by ThreadIndex(), nullptr until it writes. Grown
+  // into a copy under m_; a writer may still read a replaced table, so all
+  // of them are kept in tables_ until the map is destroyed.
+  std::atomic<shard_table *> local_;
+
+  ts_stl::Vector<shard_table *> tables_;
+
+  map_type merged_;
+
+  const Merge merge_;
+
+  static void MergeInto(map_type &into, const key_type &key,
+                        const value_type &value, const Merge &merge) {
+    if (auto existing = into.Find(key)) {
+      merge(*existing, value);
+    } else {
+      into.Insert(key, value);
+    }
+  }
+
+  // Shard of the calling thread, created on its first write. Only that
+  // thread writes its entry, so reading it needs no lock.
+  auto LocalShard() -> Shard & {
+    size_type index = ThreadIndex();
+    shard_table *table = local_.load(std::memory_order_acquire);
+    if (index < table->size() && (*table)[index] != nullptr) {
+      return *(*table)[index];
+    }
+    std::lock_guard<std::mutex> lock(m_);
+    table = local_.load(std::memory_order_relaxed);
+    if (index >= table->size()) {
+      auto grown = new shard_table;
+      grown->Reserve(Max(table->size() * 2, index + 1));
+      grown->Resize(grown->capacity());
+      Copy(grown->begin(), table->begin(), table->end());
+      Fill(grown->begin() + table->size(), grown->end(), nullptr);
+      tables_.PushBack(grown);
+      local_.store(grown, std::memory_order_release);
+      table = grown;
+    }
+    Shard *&shard = (*table)[index];
+    if (shard == nullptr) {
+      shard = new Shard;
+      shards_.PushBack(shard);
+    }
+    return *shard;
+  }
+
+public:
+  explicit ShardedHashMap(Merge merge = Merge())
+      : local_(new shard_table()), merge_(merge) {
+    tables_.PushBack(local_.load(std::memory_order_relaxed));
+  }
+
+  ShardedHashMap(const ShardedHashMap &) = delete;
+
+  // No thread may write to the map any more
+  ~ShardedHashMap() {
+    for (auto shard : shards_) {
+      delete shard;
+    }
+    for (auto table : tables_) {
+      delete table;
+    }
+  }
+
+  auto operator=(const ShardedHashMap &) -> ShardedHashMap & = delete;
+
+  // Number of threads that have written to the map
+  auto shard_size() const -> size_type {
+    std::lock_guard<std::mutex> lock(m_);
+    return shards_.size();
+  }
+
+  void Add(const key_type &key, const value_type &value) {
+    Shard &shard = LocalShard();
+    std::lock_guard<SpinLock> lock(shard.m);
+    MergeInto(shard.map, key, value, merge_);
+  }
+
+  // Merged value of key, or value_type() if no thread added it
+  auto Get(const key_type &key) const -> value_type {
+    std::lock_guard<std::mutex> lock(m_);
+    value_type result{};
+    bool found = false;
+    auto merge = [&](const value_type &value) {
+      if (found) {
+        merge_(result, value);
+      } else {
+        result = value;
+        found = true;
+      }
+    };
+    if (auto value = merged_.Find(key)) {
+      merge(*value);
+    }
+    for (auto shard : shards_) {
+      std::lock_guard<SpinLock> shard_lock(shard->m);
+      if (auto value = shard->map.Find(key)) {
+        merge(*value);
+      }
+    }
+    return result;
+  }
+
+  // Merged copy of every key
+  auto Snapshot() const -> map_type {
+    std::lock_guard<std::mutex> lock(m_);
+    map_type result(merged_);
+    for (auto shard : shards_) {
+      std::lock_guard<SpinLock> shard_lock(shard->m);
+      shard->map.ForEach([&](const key_type &key, const value_type &value) {
+        MergeInto(result, key, value, merge_);
+      });
+    }
+    return result;
+  }
+
+  // Moves the shards into the merged map, so later reads merge less. Each
+  // shard is only locked while it is taken.
+  void Fold() {
+    std::lock_guard<std::mutex> lock(m_);
+    for (auto shard : shards_) {
+      map_type taken = [shard] {
+        std::lock_guard<SpinLock> shard_lock(shard->m);
+        map_type taken(std::move(shard->map));
+        shard->map.Clear();
+        return taken;
+      }();
+      taken.ForEach([&](const key_type &key, const value_type &value) {
+        MergeInto(merged_, key, value, merge_);
+      });
+    }
+  }
 };
 } // namespace ts_stl
 
@@ -1,13 +1,26 @@
 #ifndef TS_STL_MAP_H_
 #define TS_STL_MAP_H_
 
+#include "src/allocator.h"
+#include "src/sync.h"
 #include "src/utils.h"
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
 #include <utility>
 
 namespace ts_stl {
 
-template <typename K, typename V, typename Compare = std::less<K>> class Map {
+// Ordered map as a treap. Nodes come from Allocator, which is rebound to the
+// node type; the default pool keeps them together and lets Clear() and the
+// destructor drop them whole.
+template <typename K, typename V, typename Compare = std::less<K>,
+          typename Allocator = PoolAllocator<std::pair<const K, V>>>
+class Map {
 public:
   using key_type = K;
   using value_type = V;
@@ -28,7 +41,7 @@ private:
 
     size_type size_ = 1;
 
-    size_type random_value_ = Random();
+    size_type random_value_ = ThreadRandom();
 
     key_type key_;
 
@@ -40,11 +53,6 @@ private:
     Node(const key_type &key, value_type &&value)
         : key_(key), value_(std::move(value)) {}
 
-    ~Node() {
-      delete left_child_;
-      delete right_child_;
-    }
-
     void PushUp() {
       size_ = 1;
       if (left_child_) {
@@ -57,66 +65,91 @@ private:
       }
     }
 
+    // Updates node and its ancestors after the subtree of node changed
+    static void PushUpPath(Node *node) {
+      for (; node; node = node->parent_) {
+        node->PushUp();
+      }
+    }
+
+    // The split and merge below walk down one path without recursion, so a
+    // degenerate tree costs time but no stack. Every node taken on the way
+    // points its parent_ at the node taken before it on the same side, which
+    // is the path PushUpPath walks back.
     static void SplitL(Node *node, const key_type &key, Node *&left_tree,
                        Node *&right_tree) {
-      if (!node) {
-        left_tree = nullptr;
-        right_tree = nullptr;
-        return;
-      }
-      if (Compare()(node->key_, key)) {
-        left_tree = node;
-        SplitL(node->right_child_, key, left_tree->right_child_, right_tree);
-      } else {
-        right_tree = node;
-        SplitL(node->left_child_, key, left_tree, right_tree->left_child_);
+      Node **left = &left_tree, **right = &right_tree;
+      Node *left_last = nullptr, *right_last = nullptr;
+      while (node) {
+        if (Compare()(node->key_, key)) {
+          *left = node;
+          node->parent_ = left_last;
+          left_last = node;
+          left = &node->right_child_;
+          node = node->right_child_;
+        } else {
+          *right = node;
+          node->parent_ = right_last;
+          right_last = node;
+          right = &node->left_child_;
+          node = node->left_child_;
+        }
       }
-      node->PushUp();
+      *left = nullptr;
+      *right = nullptr;
+      PushUpPath(left_last);
+      PushUpPath(right_last);
     }
 
     static void SplitLE(Node *node, const key_type &key, Node *&left_tree,
                         Node *&right_tree) {
-      if (!node) {
-        left_tree = nullptr;
-        right_tree = nullptr;
-        return;
-      }
-      if (Compare()(key, node->key_)) {
-        right_tree = node;
-        SplitLE(node->left_child_, key, left_tree, right_tree->left_child_);
-      } else {
-        left_tree = node;
-        SplitLE(node->right_child_, key, left_tree->right_child_, right_tree);
+      Node **left = &left_tree, **right = &right_tree;
+      Node *left_last = nullptr, *right_last = nullptr;
+      while (node) {
+        if (Compare()(key, node->key_)) {
+          *right = node;
+          node->parent_ = right_last;
+          right_last = node;
+          right = &node->left_child_;
+          node = node->left_child_;
+        } else {
+          *left = node;
+          node->parent_ = left_last;
+          left_last = node;
+          left = &node->right_child_;
+          node = node->right_child_;
+        }
       }
-      node->PushUp();
+      *left = nullptr;
+      *right = nullptr;
+      PushUpPath(left_last);
+      PushUpPath(right_last);
     }
 
     static auto Merge(Node *left_tree, Node *right_tree) -> Node * {
-      if (!left_tree) {
-        return right_tree;
-      }
-      if (!right_tree) {
-        return left_tree;
-      }
-      if (left_tree->random_value_ < right_tree->random_value_) {
-        left_tree->right_child_ = Merge(left_tree->right_child_, right_tree);
-        left_tree->PushUp();
-        return left_tree;
+      Node *root = nullptr, *last = nullptr;
+      Node **link = &root;
+      while (left_tree && right_tree) {
+        if (left_tree->random_value_ < right_tree->random_value_) {
+          *link = left_tree;
+          left_tree->parent_ = last;
+          last = left_tree;
+          link = &left_tree->right_child_;
+          left_tree = left_tree->right_child_;
+        } else {
+          *link = right_tree;
+          right_tree->parent_ = last;
+          last = right_tree;
+          link = &right_tree->left_child_;
+          right_tree = right_tree->left_child_;
+        }
       }
-      right_tree->left_child_ = Merge(left_tree, right_tree->left_child_);
-      right_tree->PushUp();
-      return right_tree;
-    }
-
-    static auto Clone(Node *node) -> Node * {
-      if (!node) {
-        return nullptr;
+      *link = left_tree ? left_tree : right_tree;
+      if (*link) {
+        (*link)->parent_ = last;
       }
-      Node *new_node = new Node(node->key_, node->value_);
-      new_node->left_child_ = Clone(node->left_child_);
-      new_node->right_child_ = Clone(node->right_child_);
-      new_node->PushUp();
-      return new_node;
+      PushUpPath(last);
+      return root;
     }
 
     static void Debug(Node *node) {
@@ -139,8 +172,94 @@ private:
     }
   };
 
+  using NodeAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
   Node *root_ = nullptr;
 
+  NodeAllocator allocator_;
+
+  template <typename... Args> auto NewNode(Args &&...args) -> Node * {
+    Node *node = NodeTraits::allocate(allocator_, 1);
+    NodeTraits::construct(allocator_, node, std::forward<Args>(args)...);
+    return node;
+  }
+
+  void DeleteNode(Node *node) {
+    NodeTraits::destroy(allocator_, node);
+    NodeTraits::deallocate(allocator_, node, 1);
+  }
+
+  // Rotates left children up until the top node has none, then hands it to
+  // fn and continues with its right subtree, in constant space. The tree is
+  // left in pieces.
+  template <typename F> static void Dismantle(Node *node, F fn) {
+    while (node) {
+      if (Node *left = node->left_child_) {
+        node->left_child_ = left->right_child_;
+        left->right_child_ = node;
+        node = left;
+      } else {
+        Node *right = node->right_child_;
+        fn(node);
+        node = right;
+      }
+    }
+  }
+
+  // Frees every node. A pool the tree has to itself is dropped whole, its
+  // nodes are only destroyed, if they need to be at all.
+  void DestroyAll() {
+    Node *root = root_;
+    root_ = nullptr;
+    if constexpr (has_release<NodeAllocator>::value) {
+      if (allocator_.Unique()) {
+        if constexpr (!std::is_trivially_destructible_v<Node>) {
+          Dismantle(root,
+                      [this](Node *p) { NodeTraits::destroy(allocator_, p); });
+        }
+        allocator_.Release();
+        return;
+      }
+    }
+    Dismantle(root, [this](Node *p) { DeleteNode(p); });
+  }
+
+  auto CopyNode(const Node *node, Node *parent) -> Node * {
+    Node *new_node = NewNode(node->key_, node->value_);
+    new_node->parent_ = parent;
+    new_node->size_ = node->size_;
+    new_node->random_value_ = node->random_value_;
+    return new_node;
+  }
+
+  // Copies in preorder, climbing back through parent_ once both children
+  // of a node have been copied. Priorities are kept, so is the shape.
+  auto Clone(const Node *node) -> Node * {
+    if (!node) {
+      return nullptr;
+    }
+    Node *root = CopyNode(node, nullptr);
+    const Node *from = node;
+    Node *to = root;
+    while (true) {
+      if (from->left_child_ && !to->left_child_) {
+        from = from->left_child_;
+        to = to->left_child_ = CopyNode(from, to);
+      } else if (from->right_child_ && !to->right_child_) {
+        from = from->right_child_;
+        to = to->right_child_ = CopyNode(from, to);
+      } else if (from == node) {
+        return root;
+      } else {
+        from = from->parent_;
+        to = to->parent_;
+      }
+    }
+  }
+
 public:
   class iterator {
   private:
@@ -241,36 +360,36 @@ public:
 
     const Node *position_;
 
-    auto Previous() -> Node * {
+    auto Previous() -> const Node * {
       if (!position_) {
         return map_->back().position_;
       }
       if (position_->left_child_) {
-        Node *p = position_->left_child_;
+        const Node *p = position_->left_child_;
         while (p->right_child_) {
           p = p->right_child_;
         }
         return p;
       }
-      Node *p = position_;
+      const Node *p = position_;
       while (p->parent_ && p->parent_->left_child_ == p) {
         p = p->parent_;
       }
       return p->parent_;
     }
 
-    auto Next() -> Node * {
+    auto Next() -> const Node * {
       if (!position_) {
         return map_->begin().position_;
       }
       if (position_->right_child_) {
-        Node *p = position_->right_child_;
+        const Node *p = position_->right_child_;
         while (p->left_child_) {
           p = p->left_child_;
         }
         return p;
       }
-      Node *p = position_;
+      const Node *p = position_;
       while (p->parent_ && p->parent_->right_child_ == p) {
         p = p->parent_;
       }
@@ -280,7 +399,8 @@ public:
   public:
     const_iterator() = delete;
 
-    const_iterator(Map *map, Node *position) : map_(map), position_(position) {}
+    const_iterator(const Map *map, const Node *position)
+        : map_(map), position_(position) {}
 
     const_iterator(const const_iterator &) = default;
 
@@ -332,14 +452,115 @@ private:
   // Todo
   // iterator begin_, back_, end_;
 
+  // Lookups by other key types need a transparent Compare
+  template <typename Q>
+  using transparent_key_t = std::enable_if_t<is_transparent<Compare>::value, Q>;
+
+  template <typename Q> auto FindNode(const Q &key) const -> Node * {
+    Node *p = root_;
+    while (p) {
+      if (Compare()(key, p->key_)) {
+        p = p->left_child_;
+      } else if (Compare()(p->key_, key)) {
+        p = p->right_child_;
+      } else {
+        return p;
+      }
+    }
+    return nullptr;
+  }
+
+  template <typename Q> auto FindLNode(const Q &key) const -> Node * {
+    Node *p = root_, *result = nullptr;
+    while (p) {
+      if (Compare()(p->key_, key)) {
+        result = p;
+        p = p->right_child_;
+      } else {
+        p = p->left_child_;
+      }
+    }
+    return result;
+  }
+
+  template <typename Q> auto FindLENode(const Q &key) const -> Node * {
+    Node *p = root_, *result = nullptr;
+    while (p) {
+      if (!Compare()(key, p->key_)) {
+        result = p;
+        p = p->right_child_;
+      } else {
+        p = p->left_child_;
+      }
+    }
+    return result;
+  }
+
+  template <typename Q> auto FindGNode(const Q &key) const -> Node * {
+    Node *p = root_, *result = nullptr;
+    while (p) {
+      if (Compare()(key, p->key_)) {
+        result = p;
+        p = p->left_child_;
+      } else {
+        p = p->right_child_;
+      }
+    }
+    return result;
+  }
+
+  template <typename Q> auto FindGENode(const Q &key) const -> Node * {
+    Node *p = root_, *result = nullptr;
+    while (p) {
+      if (!Compare()(p->key_, key)) {
+        result = p;
+        p = p->left_child_;
+      } else {
+        p = p->right_child_;
+      }
+    }
+    return result;
+  }
+
+  // Keeps left_tree and returns a map of right_tree. Unless all allocators
+  // are equal, the halves must not share one, since a map may be used on
+  // another thread than its other half: the smaller half is copied into a
+  // new allocator and the map holding it takes that allocator.
+  auto Divide(Node *left_tree, Node *right_tree) -> Map {
+    Map other_map;
+    if constexpr (NodeTraits::is_always_equal::value) {
+      root_ = left_tree;
+      other_map.root_ = right_tree;
+      return other_map;
+    }
+    bool left_smaller = (left_tree ? left_tree->size_ : 0) <=
+                        (right_tree ? right_tree->size_ : 0);
+    Node *smaller = left_smaller ? left_tree : right_tree;
+    other_map.root_ = other_map.Clone(smaller);
+    Dismantle(smaller, [this](Node *p) { DeleteNode(p); });
+    root_ = left_smaller ? right_tree : left_tree;
+    if (left_smaller) {
+      std::swap(root_, other_map.root_);
+      std::swap(allocator_, other_map.allocator_);
+    }
+    return other_map;
+  }
+
 public:
   Map() = default;
 
-  ~Map() { delete root_; }
+  ~Map() { DestroyAll(); }
 
-  Map(const Map &other) : root_(Node::Clone(other.root_)) {}
+  Map(const Map &other)
+      : allocator_(NodeTraits::select_on_container_copy_construction(
+            other.allocator_)) {
+    root_ = Clone(other.root_);
+  }
 
-  Map(Map &&other) : root_(other.root_) { other.root_ = nullptr; }
+  Map(Map &&other)
+      : root_(other.root_), allocator_(std::move(other.allocator_)) {
+    other.root_ = nullptr;
+  }
 
   auto begin() -> iterator {
     if (!root_) {
@@ -397,16 +618,17 @@ public:
 
   auto operator=(const Map &other) -> Map & {
     if (this != &other) {
-      delete root_;
-      root_ = Node::Clone(other.root_);
+      DestroyAll();
+      root_ = Clone(other.root_);
     }
     return *this;
   }
 
   auto operator=(Map &&other) -> Map & {
     if (this != &other) {
-      delete root_;
+      DestroyAll();
       root_ = other.root_;
+      allocator_ = std::move(other.allocator_);
       other.root_ = nullptr;
     }
     return *this;
@@ -415,8 +637,7 @@ public:
   auto Empty() const -> bool { return !root_; }
 
   void Clear() {
-    delete root_;
-    root_ = nullptr;
+    DestroyAll();
   }
 
   void Insert(const key_type &key, const value_type &value) {
@@ -431,7 +652,7 @@ public:
         return;
       }
     }
-    Node *middle_tree = new Node(key, value);
+    Node *middle_tree = NewNode(key, value);
     Node *right_tree;
     Node::SplitL(root_, key, root_, right_tree);
     root_ = Node::Merge(root_, middle_tree);
@@ -450,7 +671,7 @@ public:
         return;
       }
     }
-    Node *middle_tree = new Node(key, std::move(value));
+    Node *middle_tree = NewNode(key, std::move(value));
     Node *right_tree;
     Node::SplitL(root_, key, root_, right_tree);
     root_ = Node::Merge(root_, middle_tree);
@@ -485,36 +706,31 @@ public:
 
     root_ = Node::Merge(root_, right_tree);
     if (middle_tree) {
-      delete middle_tree;
+      DeleteNode(middle_tree);
       return true;
     }
     return false;
   }
 
   auto Contains(const key_type &key) const -> bool {
-    Node *p = root_;
-    while (p) {
-      if (Compare()(key, p->key_)) {
-        p = p->left_child_;
-      } else if (Compare()(p->key_, key)) {
-        p = p->right_child_;
-      } else {
-        return true;
-      }
-    }
-    return false;
+    return FindNode(key) != nullptr;
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto Contains(const Q &key) const -> bool {
+    return FindNode(key) != nullptr;
   }
 
   auto SplitL(const key_type &key) -> Map {
-    Map other_map;
-    Node::SplitL(root_, key, root_, other_map.root_);
-    return other_map;
+    Node *left_tree, *right_tree;
+    Node::SplitL(root_, key, left_tree, right_tree);
+    return Divide(left_tree, right_tree);
   }
 
   auto SplitLE(const key_type &key) -> Map {
-    Map other_map;
-    Node::SplitLE(root_, key, root_, other_map.root_);
-    return other_map;
+    Node *left_tree, *right_tree;
+    Node::SplitLE(root_, key, left_tree, right_tree);
+    return Divide(left_tree, right_tree);
   }
 
   void Merge(Map &&other_map) {
@@ -524,138 +740,96 @@ public:
 
   // Less than
   auto FindL(const key_type &key) -> iterator {
-    Node *p = root_, *result = nullptr;
-    while (p) {
-      if (Compare()(p->key_, key)) {
-        result = p;
-        p = p->right_child_;
-      } else {
-        p = p->left_child_;
-      }
-    }
-    return iterator(this, result);
+    return iterator(this, FindLNode(key));
   }
 
   auto FindL(const key_type &key) const -> const_iterator {
-    Node *p = root_, *result = nullptr;
-    while (p) {
-      if (Compare()(p->key_, key)) {
-        result = p;
-        p = p->right_child_;
-      } else {
-        p = p->left_child_;
-      }
-    }
-    return const_iterator(this, result);
+    return const_iterator(this, FindLNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindL(const Q &key) -> iterator {
+    return iterator(this, FindLNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindL(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindLNode(key));
   }
 
   // Less than or equal to
   auto FindLE(const key_type &key) -> iterator {
-    Node *p = root_, *result = nullptr;
-    while (p) {
-      if (!Compare()(key, p->key_)) {
-        result = p;
-        p = p->right_child_;
-      } else {
-        p = p->left_child_;
-      }
-    }
-    return iterator(this, result);
+    return iterator(this, FindLENode(key));
   }
 
   auto FindLE(const key_type &key) const -> const_iterator {
-    Node *p = root_, *result = nullptr;
-    while (p) {
-      if (!Compare()(key, p->key_)) {
-        result = p;
-        p = p->right_child_;
-      } else {
-        p = p->left_child_;
-      }
-    }
-    return const_iterator(this, result);
+    return const_iterator(this, FindLENode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindLE(const Q &key) -> iterator {
+    return iterator(this, FindLENode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindLE(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindLENode(key));
   }
 
   // Greater than
   auto FindG(const key_type &key) -> iterator {
-    Node *p = root_, *result = nullptr;
-    while (p) {
-      if (Compare()(key, p->key_)) {
-        result = p;
-        p = p->left_child_;
-      } else {
-        p = p->right_child_;
-      }
-    }
-    return iterator(this, result);
+    return iterator(this, FindGNode(key));
   }
 
   auto FindG(const key_type &key) const -> const_iterator {
-    Node *p = root_, *result = nullptr;
-    while (p) {
-      if (Compare()(key, p->key_)) {
-        result = p;
-        p = p->left_child_;
-      } else {
-        p = p->right_child_;
-      }
-    }
-    return const_iterator(this, result);
+    return const_iterator(this, FindGNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindG(const Q &key) -> iterator {
+    return iterator(this, FindGNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindG(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindGNode(key));
   }
 
   // Greater than or equal to
   auto FindGE(const key_type &key) -> iterator {
-    Node *p = root_, *result = nullptr;
-    while (p) {
-      if (!Compare()(p->key_, key)) {
-        result = p;
-        p = p->left_child_;
-      } else {
-        p = p->right_child_;
-      }
-    }
-    return iterator(this, result);
+    return iterator(this, FindGENode(key));
   }
 
   auto FindGE(const key_type &key) const -> const_iterator {
-    Node *p = root_, *result = nullptr;
-    while (p) {
-      if (!Compare()(p->key_, key)) {
-        result = p;
-        p = p->left_child_;
-      } else {
-        p = p->right_child_;
-      }
-    }
-    return const_iterator(this, result);
+    return const_iterator(this, FindGENode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindGE(const Q &key) -> iterator {
+    return iterator(this, FindGENode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto FindGE(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindGENode(key));
   }
 
   auto Find(const key_type &key) -> iterator {
-    Node *p = root_;
-    while (p) {
-      if (Compare()(key, p->key_)) {
-        p = p->left_child_;
-      } else if (Compare()(p->key_, key)) {
-        p = p->right_child_;
-      } else {
-        return iterator(this, p);
-      }
-    }
-    return end();
+    return iterator(this, FindNode(key));
   }
 
   auto Find(const key_type &key) const -> const_iterator {
-    Node *p = root_;
-    while (p) {
-      if (Compare()(key, p->key_)) {
-        p = p->left_child_;
-      } else if (Compare()(p->key_, key)) {
-        p = p->right_child_;
-      } else {
-        return const_iterator(this, p);
-      }
-    }
-    return end();
+    return const_iterator(this, FindNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto Find(const Q &key) -> iterator {
+    return iterator(this, FindNode(key));
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto Find(const Q &key) const -> const_iterator {
+    return const_iterator(this, FindNode(key));
   }
 
   auto operator[](const key_type &key) -> reference {
@@ -686,8 +860,35 @@ public:
     }
     Assert(false, "Map::operator[](): Invalid key!");
   }
+
+  // The key is only converted to key_type when it is inserted
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto operator[](const Q &key) -> reference {
+    if (Node *p = FindNode(key)) {
+      return p->value_;
+    }
+    key_type new_key(key);
+    Insert(new_key, value_type());
+    return FindNode(new_key)->value_;
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto operator[](const Q &key) const -> const_reference {
+    Node *p = FindNode(key);
+    Assert(p, "Map::operator[](): Invalid key!");
+    return p->value_;
+  }
 };
 
+// Concurrent ordered map, a lazy skip list (Herlihy, Lev, Luchangco and
+// Shavit). Lookups and scans take no locks: they walk the levels inside an
+// EpochGuard and skip nodes that are being inserted or deleted. A writer
+// locks the predecessors of a key, bottom level first so that locks are
+// always taken from larger keys to smaller ones, checks they are still
+// unmarked and adjacent, and links or unlinks the node on every level. An
+// unlinked node keeps its links, so a scan standing on it still moves
+// forward, and is freed once every guard that could reach it has been left.
+// Values are replaced by swapping a pointer, readers copy them out.
 template <typename K, typename V, typename Compare = std::less<K>>
 class SyncMap {
 public:
@@ -696,14 +897,405 @@ public:
   using size_type = std::size_t;
   using difference_type = std::ptrdiff_t;
   using key_compare = Compare;
-  using reference = value_type &;
-  using const_reference = const value_type &;
+  using entry_type = std::pair<key_type, value_type>;
 
 private:
+  // Enough for 4^16 entries at one node in four per level
+  static constexpr size_type kMaxHeight = 16;
+
+  struct Node;
+
+  // Head of the list, or the part of a node the list is built from
+  struct Link {
+    SpinLock lock;
+
+    // Set once a delete owns the node
+    std::atomic<bool> marked{false};
+
+    // Set once the node is linked on every level
+    std::atomic<bool> fully_linked{false};
+
+    const size_type height;
+
+    std::atomic<Node *> *const next;
+
+    Link(size_type height, std::atomic<Node *> *next)
+        : height(height), next(next) {}
+  };
+
+  // Allocated with its height links right behind it
+  struct Node : Link {
+    const key_type key;
+
+    std::atomic<value_type *> value;
+
+    Node(size_type height, std::atomic<Node *> *next, const key_type &key,
+         value_type *value)
+        : Link(height, next), key(key), value(value) {}
+
+    ~Node() { delete value.load(std::memory_order_relaxed); }
+  };
+
+  std::atomic<Node *> head_next_[kMaxHeight];
+
+  Link head_;
+
+  ShardedCounter size_;
+
+  static auto NewNode(size_type height, const key_type &key,
+                      value_type *value) -> Node * {
+    void *memory =
+        ::operator new(sizeof(Node) + height * sizeof(std::atomic<Node *>));
+    auto *next = reinterpret_cast<std::atomic<Node *> *>(
+        static_cast<char *>(memory) + sizeof(Node));
+    for (size_type level = 0; level < height; ++level) {
+      new (next + level) std::atomic<Node *>(nullptr);
+    }
+    return new (memory) Node(height, next, key, value);
+  }
+
+  static void DeleteNode(void *pointer) {
+    Node *node = static_cast<Node *>(pointer);
+    node->~Node();
+    ::operator delete(node);
+  }
+
+  // One level more with probability 1/4
+  static auto RandomHeight() -> size_type {
+    size_type height =
+        1 + __builtin_ctzll(ThreadRandom() | (uint64_t(1) << 63)) / 2;
+    return Min(height, kMaxHeight);
+  }
+
+  static auto Live(const Node *node) -> bool {
+    return node->fully_linked.load(std::memory_order_acquire) &&
+           !node->marked.load(std::memory_order_acquire);
+  }
+
+  // Lookups by other key types need a transparent Compare
+  template <typename Q>
+  using transparent_key_t = std::enable_if_t<is_transparent<Compare>::value, Q>;
+
+  // Caller is inside an EpochGuard. Fills the last link before key and the
+  // first node not before it on every level, and returns the highest level
+  // on which that node has key, or -1.
+  template <typename Q>
+  auto Search(const Q &key, Link **preds, Node **succs) const -> int {
+    Link *pred = const_cast<Link *>(&head_);
+    int found = -1;
+    for (int level = kMaxHeight - 1; level >= 0; --level) {
+      Node *curr = pred->next[level].load(std::memory_order_acquire);
+      while (curr != nullptr && Compare()(curr->key, key)) {
+        pred = curr;
+        curr = pred->next[level].load(std::memory_order_acquire);
+      }
+      if (found == -1 && curr != nullptr && !Compare()(key, curr->key)) {
+        found = level;
+      }
+      preds[level] = pred;
+      succs[level] = curr;
+    }
+    return found;
+  }
+
+  // Caller is inside an EpochGuard. The node of key, or nullptr.
+  template <typename Q> auto FindNode(const Q &key) const -> Node * {
+    const Link *pred = &head_;
+    for (int level = kMaxHeight - 1; level >= 0; --level) {
+      Node *curr = pred->next[level].load(std::memory_order_acquire);
+      while (curr != nullptr && Compare()(curr->key, key)) {
+        pred = curr;
+        curr = pred->next[level].load(std::memory_order_acquire);
+      }
+      if (curr != nullptr && !Compare()(key, curr->key)) {
+        return Live(curr) ? curr : nullptr;
+      }
+    }
+    return nullptr;
+  }
+
+  // Caller is inside an EpochGuard. The first live node at or after node.
+  static auto SkipDead(Node *node) -> Node * {
+    while (node != nullptr && !Live(node)) {
+      node = node->next[0].load(std::memory_order_acquire);
+    }
+    return node;
+  }
+
+  // Caller is inside an EpochGuard. The first live node with a key not
+  // before key, or after it if strict.
+  template <typename Q>
+  auto FindGNode(const Q &key, bool strict) const -> Node * {
+    const Link *pred = &head_;
+    Node *curr = nullptr;
+    for (int level = kMaxHeight - 1; level >= 0; --level) {
+      curr = pred->next[level].load(std::memory_order_acquire);
+      while (curr != nullptr && (strict ? !Compare()(key, curr->key)
+                                        : Compare()(curr->key, key))) {
+        pred = curr;
+        curr = pred->next[level].load(std::memory_order_acquire);
+      }
+    }
+    return SkipDead(curr);
+  }
+
+  // Caller is inside an EpochGuard. The last live node with a key before
+  // key, or not after it unless strict.
+  template <typename Q>
+  auto FindLNode(const Q &key, bool strict) const -> Node * {
+    const Link *pred = &head_;
+    for (int level = kMaxHeight - 1; level >= 0; --level) {
+      Node *curr = pred->next[level].load(std::memory_order_acquire);
+      while (curr != nullptr && (strict ? Compare()(curr->key, key)
+                                        : !Compare()(key, curr->key))) {
+        pred = curr;
+        curr = pred->next[level].load(std::memory_order_acquire);
+      }
+    }
+    if (pred == &head_) {
+      return nullptr;
+    }
+    // A dead predecessor is skipped by searching again below its key
+    Node *node = static_cast<Node *>(const_cast<Link *>(pred));
+    return Live(node) ? node : FindLNode(node->key, true);
+  }
+
+  static auto Copy(const Node *node, entry_type &entry) -> bool {
+    if (node == nullptr) {
+      return false;
+    }
+    entry.first = node->key;
+    entry.second = *node->value.load(std::memory_order_acquire);
+    return true;
+  }
+
+  static void Unlock(Link **locked, size_type count) {
+    for (size_type i = 0; i < count; ++i) {
+      locked[i]->lock.unlock();
+    }
+  }
+
+  // Locks preds[0, height) bottom up, each once, into locked. Returns
+  // whether each is unmarked and still links to succs on its level.
+  static auto LockPreds(Link **preds, Node **succs, size_type height,
+                        Link **locked, size_type &count) -> bool {
+    count = 0;
+    for (size_type level = 0; level < height; ++level) {
+      Link *pred = preds[level];
+      if (count == 0 || locked[count - 1] != pred) {
+        pred->lock.lock();
+        locked[count++] = pred;
+      }
+      Node *succ = succs[level];
+      if (pred->marked.load(std::memory_order_relaxed) ||
+          pred->next[level].load(std::memory_order_relaxed) != succ) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Store(const key_type &key, value_type *value) {
+    EpochGuard guard;
+    size_type height = RandomHeight();
+    Link *preds[kMaxHeight];
+    Node *succs[kMaxHeight];
+    for (Backoff backoff;; backoff.Pause()) {
+      int found = Search(key, preds, succs);
+      if (found != -1) {
+        Node *node = succs[found];
+        if (node->marked.load(std::memory_order_acquire)) {
+          // Unlinked shortly, then inserted anew
+          continue;
+        }
+        while (!node->fully_linked.load(std::memory_order_acquire)) {
+          backoff.Pause();
+        }
+        Retire(node->value.exchange(value, std::memory_order_acq_rel));
+        return;
+      }
+      Link *locked[kMaxHeight];
+      size_type count;
+      bool valid = LockPreds(preds, succs, height, locked, count);
+      for (size_type level = 0; valid && level < height; ++level) {
+        valid = succs[level] == nullptr ||
+                !succs[level]->marked.load(std::memory_order_relaxed);
+      }
+      if (!valid) {
+        Unlock(locked, count);
+        continue;
+      }
+      Node *node = NewNode(height, key, value);
+      for (size_type level = 0; level < height; ++level) {
+        node->next[level].store(succs[level], std::memory_order_relaxed);
+      }
+      for (size_type level = 0; level < height; ++level) {
+        preds[level]->next[level].store(node, std::memory_order_release);
+      }
+      node->fully_linked.store(true, std::memory_order_release);
+      Unlock(locked, count);
+      size_.Add(1);
+      return;
+    }
+  }
+
 public:
-  SyncMap() { Assert(false, "SyncMap: Unimplemented!"); }
+  SyncMap() : head_(kMaxHeight, head_next_) {
+    for (auto &next : head_next_) {
+      next.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  SyncMap(const SyncMap &) = delete;
+
+  // No thread may access the map any more, unlinked nodes already belong to
+  // the reclaimer
+  ~SyncMap() {
+    Node *node = head_next_[0].load(std::memory_order_relaxed);
+    while (node != nullptr) {
+      Node *next = node->next[0].load(std::memory_order_relaxed);
+      DeleteNode(node);
+      node = next;
+    }
+  }
+
+  auto operator=(const SyncMap &) -> SyncMap & = delete;
 
-  ~SyncMap() = default;
+  // Lock-free, exact whenever no write is in flight
+  auto Size() const -> size_type {
+    return static_cast<size_type>(Max<int64_t>(size_.Load(), 0));
+  }
+
+  auto Empty() const -> bool { return Size() == 0; }
+
+  void Insert(const key_type &key, const value_type &value) {
+    Store(key, new value_type(value));
+  }
+
+  void Insert(const key_type &key, value_type &&value) {
+    Store(key, new value_type(std::move(value)));
+  }
+
+  auto Delete(const key_type &key) -> bool {
+    EpochGuard guard;
+    Link *preds[kMaxHeight];
+    Node *succs[kMaxHeight];
+    Node *victim = nullptr;
+    for (Backoff backoff;; backoff.Pause()) {
+      int found = Search(key, preds, succs);
+      if (victim == nullptr) {
+        // A node not linked on every level yet is not inserted yet
+        if (found == -1) {
+          return false;
+        }
+        Node *node = succs[found];
+        if (!node->fully_linked.load(std::memory_order_acquire) ||
+            node->height != static_cast<size_type>(found) + 1) {
+          return false;
+        }
+        node->lock.lock();
+        if (node->marked.load(std::memory_order_relaxed)) {
+          node->lock.unlock();
+          return false;
+        }
+        node->marked.store(true, std::memory_order_release);
+        victim = node;
+      }
+      Link *locked[kMaxHeight];
+      size_type count;
+      if (!LockPreds(preds, succs, victim->height, locked, count)) {
+        Unlock(locked, count);
+        continue;
+      }
+      for (size_type level = victim->height; level-- > 0;) {
+        preds[level]->next[level].store(
+            victim->next[level].load(std::memory_order_relaxed),
+            std::memory_order_release);
+      }
+      victim->lock.unlock();
+      Unlock(locked, count);
+      size_.Add(-1);
+      EpochReclaimer::Instance().Retire(victim, DeleteNode);
+      return true;
+    }
+  }
+
+  auto Contains(const key_type &key) const -> bool {
+    EpochGuard guard;
+    return FindNode(key) != nullptr;
+  }
+
+  template <typename Q, typename = transparent_key_t<Q>>
+  auto Contains(const Q &key) const -> bool {
+    EpochGuard guard;
+    return FindNode(key) != nullptr;
+  }
+
+  // Copies the value of key into value unless key is absent
+  auto Get(const key_type &key, value_type &value) const -> bool {
+    EpochGuard guard;
+    Node *node = FindNode(key);
+    if (node == nullptr) {
+      return false;
+    }
+    value = *node->value.load(std::memory_order_acquire);
+    return true;
+  }
+
+  // Find* copy the matching key and value into entry unless there is none.
+  // Less than
+  auto FindL(const key_type &key, entry_type &entry) const -> bool {
+    EpochGuard guard;
+    return Copy(FindLNode(key, true), entry);
+  }
+
+  // Less than or equal to
+  auto FindLE(const key_type &key, entry_type &entry) const -> bool {
+    EpochGuard guard;
+    return Copy(FindLNode(key, false), entry);
+  }
+
+  // Greater than
+  auto FindG(const key_type &key, entry_type &entry) const -> bool {
+    EpochGuard guard;
+    return Copy(FindGNode(key, true), entry);
+  }
+
+  // Greater than or equal to
+  auto FindGE(const key_type &key, entry_type &entry) const -> bool {
+    EpochGuard guard;
+    return Copy(FindGNode(key, false), entry);
+  }
+
+  // Calls fn(key, value) in key order for every key in [from, to). Keys
+  // inserted or deleted meanwhile may or may not be seen, no key is seen
+  // twice. fn runs inside an EpochGuard and must not block for long.
+  template <typename F>
+  void ForEachRange(const key_type &from, const key_type &to, F fn) const {
+    EpochGuard guard;
+    for (Node *node = FindGNode(from, false);
+         node != nullptr && Compare()(node->key, to);
+         node = SkipDead(node->next[0].load(std::memory_order_acquire))) {
+      fn(node->key, *node->value.load(std::memory_order_acquire));
+    }
+  }
+
+  // Calls fn(key, value) in key order for every key, as ForEachRange()
+  template <typename F> void ForEach(F fn) const {
+    EpochGuard guard;
+    for (Node *node = SkipDead(head_next_[0].load(std::memory_order_acquire));
+         node != nullptr;
+         node = SkipDead(node->next[0].load(std::memory_order_acquire))) {
+      fn(node->key, *node->value.load(std::memory_order_acquire));
+    }
+  }
+
+  // The value of key, or value_type() if absent
+  auto operator[](const key_type &key) const -> value_type {
+    value_type value{};
+    Get(key, value);
+    return value;
+  }
 };
 
 } // namespace ts_stl
@@ -0,0 +1,378 @@
+#ifndef TS_STL_STATIC_HASHMAP_H_
+#define TS_STL_STATIC_HASHMAP_H_
+
+#include "src/array.h"
+#include "src/hashmap.h"
+#include "src/utils.h"
+#include "src/vector.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace ts_stl {
+
+// Minimal perfect hashing in the style of PTHash: keys are split into small
+// buckets by their hash, and every bucket gets a pilot, found by trial, that
+// sends its keys to free, distinct positions in [0, size). A lookup reads
+// one pilot and probes one entry.
+
+// Keys per bucket on average. Fewer buckets mean fewer pilots but slower
+// searches for the large buckets.
+inline constexpr std::size_t kPerfectHashBucketLoad = 4;
+
+// A bucket larger than this makes the build retry with another seed
+inline constexpr std::size_t kPerfectHashMaxBucket = 32;
+
+// Seeds tried before the keys are given up on, only keys with equal hashes
+// fail every seed
+inline constexpr uint64_t kPerfectHashMaxSeeds = 16;
+
+// splitmix64 finalizer
+constexpr auto PerfectHashMix(uint64_t x) -> uint64_t {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+constexpr auto PerfectHashBucketSize(std::size_t size) -> std::size_t {
+  return size / kPerfectHashBucketLoad + 1;
+}
+
+// Buckets come from the high bits of the hash
+constexpr auto PerfectHashBucket(uint64_t hash, std::size_t bucket_size)
+    -> std::size_t {
+  return static_cast<std::size_t>(
+      (static_cast<__uint128_t>(hash) * bucket_size) >> 64);
+}
+
+constexpr auto PerfectHashPosition(uint64_t hash, uint64_t pilot,
+                                   std::size_t size) -> std::size_t {
+  return static_cast<std::size_t>(
+      (static_cast<__uint128_t>(
+           PerfectHashMix(hash ^ (pilot * kFibonacciMultiplier))) *
+       size) >>
+      64);
+}
+
+// Searches a pilot for every bucket, largest buckets first, such that
+// PerfectHashPosition() is distinct for all size hashes. start, order and
+// taken are scratch arrays of bucket_size + 1, size and size elements.
+// Returns false if the hashes need another seed.
+template <typename Hashes, typename Pilots, typename Start, typename Order,
+          typename Taken>
+constexpr auto FindPilots(const Hashes &hashes, std::size_t size,
+                          Pilots &pilots, std::size_t bucket_size,
+                          Start &start, Order &order, Taken &taken) -> bool {
+  // Counting sort of the keys by bucket
+  for (std::size_t b = 0; b <= bucket_size; ++b) {
+    start[b] = 0;
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    ++start[PerfectHashBucket(hashes[i], bucket_size) + 1];
+    taken[i] = false;
+  }
+  std::size_t max_bucket = 0;
+  for (std::size_t b = 0; b < bucket_size; ++b) {
+    max_bucket = start[b + 1] > max_bucket ? start[b + 1] : max_bucket;
+    start[b + 1] += start[b];
+  }
+  if (max_bucket > kPerfectHashMaxBucket) {
+    return false;
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    order[start[PerfectHashBucket(hashes[i], bucket_size)]++] = i;
+  }
+  for (std::size_t b = bucket_size; b > 0; --b) {
+    start[b] = start[b - 1];
+  }
+  start[0] = 0;
+
+  // The last buckets see a nearly full table, so expect about size tries
+  const uint64_t max_pilot = static_cast<uint64_t>(size) * 64 + 1024;
+  std::size_t positions[kPerfectHashMaxBucket] = {};
+  for (std::size_t s = max_bucket; s > 0; --s) {
+    for (std::size_t b = 0; b < bucket_size; ++b) {
+      if (start[b + 1] - start[b] != s) {
+        continue;
+      }
+      const std::size_t first = start[b];
+      // Equal hashes never separate
+      for (std::size_t i = 0; i < s; ++i) {
+        for (std::size_t j = 0; j < i; ++j) {
+          if (hashes[order[first + i]] == hashes[order[first + j]]) {
+            return false;
+          }
+        }
+      }
+      bool placed = false;
+      for (uint64_t pilot = 0; pilot < max_pilot && !placed; ++pilot) {
+        placed = true;
+        for (std::size_t i = 0; i < s && placed; ++i) {
+          positions[i] =
+              PerfectHashPosition(hashes[order[first + i]], pilot, size);
+          placed = !taken[positions[i]];
+          for (std::size_t j = 0; j < i && placed; ++j) {
+            placed = positions[i] != positions[j];
+          }
+        }
+        if (placed) {
+          for (std::size_t i = 0; i < s; ++i) {
+            taken[positions[i]] = true;
+          }
+          pilots[b] = pilot;
+        }
+      }
+      if (!placed) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Immutable map over a minimal perfect hash, built once from a HashMap or a
+// range of key-value pairs. Keys must be distinct and hash differently.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>>
+class StaticHashMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+  using const_reference = const V &;
+
+private:
+  uint64_t seed_ = 0;
+
+  size_type size_ = 0;
+
+  size_type bucket_size_ = 0;
+
+  ts_stl::Array<uint64_t> pilots_;
+
+  // entries_[i] holds the key whose position is i
+  ts_stl::Array<std::pair<key_type, value_type>> entries_;
+
+  const Hash hasher_;
+
+  const KeyEqual key_equaler_;
+
+  auto HashOf(const key_type &key) const -> uint64_t {
+    return PerfectHashMix(hasher_(key) ^ seed_);
+  }
+
+  void Build(ts_stl::Vector<std::pair<key_type, value_type>> &entries) {
+    size_type size = entries.size();
+    bucket_size_ = PerfectHashBucketSize(size);
+    pilots_ = ts_stl::Array<uint64_t>(bucket_size_);
+    ts_stl::Array<uint64_t> hashes(size);
+    ts_stl::Array<size_type> start(bucket_size_ + 1);
+    ts_stl::Array<size_type> order(size);
+    ts_stl::Array<bool> taken(size);
+    for (uint64_t attempt = 0;; ++attempt) {
+      if (attempt == kPerfectHashMaxSeeds) {
+        Assert(false, "StaticHashMap: keys must be distinct and hash "
+                      "differently.");
+        return;
+      }
+      seed_ = PerfectHashMix(attempt);
+      for (size_type i = 0; i < size; ++i) {
+        hashes[i] = HashOf(entries[i].first);
+      }
+      // Empty buckets keep pilot 0, not what the allocation held
+      Fill(pilots_.begin(), pilots_.end(), uint64_t(0));
+      if (FindPilots(hashes, size, pilots_, bucket_size_, start, order,
+                     taken)) {
+        break;
+      }
+    }
+    entries_ = ts_stl::Array<std::pair<key_type, value_type>>(size);
+    for (size_type i = 0; i < size; ++i) {
+      uint64_t hash = hashes[i];
+      entries_[PerfectHashPosition(
+          hash, pilots_[PerfectHashBucket(hash, bucket_size_)], size)] =
+          std::move(entries[i]);
+    }
+    size_ = size;
+  }
+
+  auto FindEntry(const key_type &key) const
+      -> const std::pair<key_type, value_type> * {
+    if (size_ == 0) {
+      return nullptr;
+    }
+    uint64_t hash = HashOf(key);
+    auto &entry = entries_[PerfectHashPosition(
+        hash, pilots_[PerfectHashBucket(hash, bucket_size_)], size_)];
+    return key_equaler_(key, entry.first) ? &entry : nullptr;
+  }
+
+public:
+  // [first, last) yields key-value pairs
+  template <typename Iter>
+  StaticHashMap(Iter first, Iter last, Hash hasher = Hash(),
+                KeyEqual key_equaler = KeyEqual())
+      : pilots_(0), entries_(0), hasher_(hasher), key_equaler_(key_equaler) {
+    ts_stl::Vector<std::pair<key_type, value_type>> entries;
+    for (; first != last; ++first) {
+      entries.PushBack(std::pair<key_type, value_type>(*first));
+    }
+    Build(entries);
+  }
+
+  template <typename BucketPolicy, template <typename> class Bucket,
+            typename Filter>
+  explicit StaticHashMap(
+      const HashMap<K, V, Hash, KeyEqual, BucketPolicy, Bucket, Filter> &map,
+      Hash hasher = Hash(), KeyEqual key_equaler = KeyEqual())
+      : pilots_(0), entries_(0), hasher_(hasher), key_equaler_(key_equaler) {
+    ts_stl::Vector<std::pair<key_type, value_type>> entries;
+    entries.Reserve(map.size());
+    map.ForEach([&](const key_type &key, const value_type &value) {
+      entries.PushBack(std::make_pair(key, value));
+    });
+    Build(entries);
+  }
+
+  auto size() const -> size_type { return size_; }
+
+  auto bucket_size() const -> size_type { return bucket_size_; }
+
+  auto Contains(const key_type &key) const -> bool {
+    return FindEntry(key) != nullptr;
+  }
+
+  // The value of key, or nullptr if absent
+  auto Find(const key_type &key) const -> const value_type * {
+    auto entry = FindEntry(key);
+    return entry ? &entry->second : nullptr;
+  }
+
+  auto operator[](const key_type &key) const -> const_reference {
+    static const value_type default_value{};
+    auto entry = FindEntry(key);
+    return entry ? entry->second : default_value;
+  }
+};
+
+// Hash usable in constant expressions, splitmix64 for integers and FNV-1a
+// for strings
+struct ConstexprHash {
+  template <typename T,
+            typename = std::enable_if_t<std::is_integral_v<T> ||
+                                        std::is_enum_v<T>>>
+  constexpr auto operator()(T value) const -> uint64_t {
+    return PerfectHashMix(static_cast<uint64_t>(value));
+  }
+
+  constexpr auto operator()(std::string_view s) const -> uint64_t {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : s) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    }
+    return hash;
+  }
+};
+
+// StaticHashMap of N entries known at compile time, built by
+// MakeStaticHashMap() in a constant expression. Keys and values must be
+// literal types, e.g. integers or std::string_view.
+template <typename K, typename V, std::size_t N, typename Hash = ConstexprHash,
+          typename KeyEqual = std::equal_to<K>>
+class ConstexprStaticHashMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+
+private:
+  static constexpr size_type kBucketSize = PerfectHashBucketSize(N);
+
+  uint64_t seed_ = 0;
+
+  std::array<uint64_t, kBucketSize> pilots_{};
+
+  std::array<key_type, N> keys_{};
+
+  std::array<value_type, N> values_{};
+
+  Hash hasher_;
+
+  KeyEqual key_equaler_;
+
+  constexpr auto HashOf(const key_type &key) const -> uint64_t {
+    return PerfectHashMix(hasher_(key) ^ seed_);
+  }
+
+  constexpr auto PositionOf(const key_type &key) const -> size_type {
+    uint64_t hash = HashOf(key);
+    return PerfectHashPosition(
+        hash, pilots_[PerfectHashBucket(hash, kBucketSize)], N);
+  }
+
+public:
+  constexpr explicit ConstexprStaticHashMap(
+      const std::pair<K, V> (&entries)[N], Hash hasher = Hash(),
+      KeyEqual key_equaler = KeyEqual())
+      : hasher_(hasher), key_equaler_(key_equaler) {
+    std::array<uint64_t, N> hashes{};
+    std::array<size_type, kBucketSize + 1> start{};
+    std::array<size_type, N> order{};
+    std::array<bool, N> taken{};
+    for (uint64_t attempt = 0;; ++attempt) {
+      if (attempt == kPerfectHashMaxSeeds) {
+        // Not a constant expression, so this fails the build
+        Assert(false, "ConstexprStaticHashMap: keys must be distinct and "
+                      "hash differently.");
+        return;
+      }
+      seed_ = PerfectHashMix(attempt);
+      for (size_type i = 0; i < N; ++i) {
+        hashes[i] = HashOf(entries[i].first);
+      }
+      if (FindPilots(hashes, N, pilots_, kBucketSize, start, order, taken)) {
+        break;
+      }
+    }
+    for (size_type i = 0; i < N; ++i) {
+      size_type position = PositionOf(entries[i].first);
+      keys_[position] = entries[i].first;
+      values_[position] = entries[i].second;
+    }
+  }
+
+  constexpr auto size() const -> size_type { return N; }
+
+  constexpr auto Contains(const key_type &key) const -> bool {
+    return key_equaler_(key, keys_[PositionOf(key)]);
+  }
+
+  // The value of key, or nullptr if absent
+  constexpr auto Find(const key_type &key) const -> const value_type * {
+    size_type position = PositionOf(key);
+    return key_equaler_(key, keys_[position]) ? &values_[position] : nullptr;
+  }
+
+  // The value of key, or value_type() if absent
+  constexpr auto operator[](const key_type &key) const -> value_type {
+    size_type position = PositionOf(key);
+    return key_equaler_(key, keys_[position]) ? values_[position]
+                                              : value_type();
+  }
+};
+
+template <typename K, typename V, std::size_t N>
+constexpr auto MakeStaticHashMap(const std::pair<K, V> (&entries)[N])
+    -> ConstexprStaticHashMap<K, V, N> {
+  return ConstexprStaticHashMap<K, V, N>(entries);
+}
+
+} // namespace ts_stl
+
+#endif
@@ -0,0 +1,511 @@
+#ifndef TS_STL_SYNC_H_
+#define TS_STL_SYNC_H_
+
+#include "src/array.h"
+#include "src/utils.h"
+#include "src/vector.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace ts_stl {
+
+inline constexpr std::size_t kCacheLineSize = 64;
+
+// Gives T its own cache line, so neighbours in an array never false-share
+template <typename T> struct alignas(kCacheLineSize) CacheLinePadded {
+  T value{};
+};
+
+// Busy-waits for a while, then yields the CPU to other threads
+class Backoff {
+private:
+  static constexpr std::size_t kSpinLimit = 64;
+
+  std::size_t spins_ = 0;
+
+public:
+  void Pause() {
+    if (spins_ < kSpinLimit) {
+      ++spins_;
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    } else {
+      std::this_thread::yield();
+    }
+  }
+};
+
+// Reader/writer lock in a single 32-bit word, usable wherever
+// std::shared_mutex is. Waiters spin and then yield instead of sleeping in
+// the kernel. A waiting writer blocks new readers, so writers don't starve.
+class SpinSharedMutex {
+private:
+  static constexpr uint32_t kWriter = 1u << 31;
+
+  static constexpr uint32_t kWriterWaiting = 1u << 30;
+
+  // Reader count in the low bits
+  std::atomic<uint32_t> state_{0};
+
+public:
+  SpinSharedMutex() = default;
+
+  SpinSharedMutex(const SpinSharedMutex &) = delete;
+
+  auto operator=(const SpinSharedMutex &) -> SpinSharedMutex & = delete;
+
+  auto try_lock() -> bool {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    return (state & ~kWriterWaiting) == 0 &&
+           state_.compare_exchange_strong(state, kWriter,
+                                          std::memory_order_acquire);
+  }
+
+  void lock() {
+    for (Backoff backoff;; backoff.Pause()) {
+      uint32_t state = state_.load(std::memory_order_relaxed);
+      if ((state & ~kWriterWaiting) == 0) {
+        if (state_.compare_exchange_weak(state, kWriter,
+                                         std::memory_order_acquire)) {
+          return;
+        }
+      } else if (!(state & kWriterWaiting)) {
+        state_.fetch_or(kWriterWaiting, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void unlock() { state_.fetch_and(~kWriter, std::memory_order_release); }
+
+  auto try_lock_shared() -> bool {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    return !(state & (kWriter | kWriterWaiting)) &&
+           state_.compare_exchange_strong(state, state + 1,
+                                          std::memory_order_acquire);
+  }
+
+  void lock_shared() {
+    for (Backoff backoff;; backoff.Pause()) {
+      uint32_t state = state_.load(std::memory_order_relaxed);
+      if (!(state & (kWriter | kWriterWaiting)) &&
+          state_.compare_exchange_weak(state, state + 1,
+                                       std::memory_order_acquire)) {
+        return;
+      }
+    }
+  }
+
+  void unlock_shared() { state_.fetch_sub(1, std::memory_order_release); }
+};
+
+// Test-and-test-and-set lock for short, mostly uncontended sections
+class SpinLock {
+private:
+  std::atomic<bool> locked_{false};
+
+public:
+  SpinLock() = default;
+
+  SpinLock(const SpinLock &) = delete;
+
+  auto operator=(const SpinLock &) -> SpinLock & = delete;
+
+  auto try_lock() -> bool {
+    return !locked_.load(std::memory_order_relaxed) &&
+           !locked_.exchange(true, std::memory_order_acquire);
+  }
+
+  void lock() {
+    for (Backoff backoff; !try_lock(); backoff.Pause()) {
+    }
+  }
+
+  void unlock() { locked_.store(false, std::memory_order_release); }
+};
+
+// Sequence lock: writers lock exclusively and bump a version, readers read
+// without writing shared memory and retry if the version moved. The data a
+// reader touches must stay allocated and be trivially copyable, since it may
+// be read mid-write. lock_shared() falls back to the exclusive lock, so it
+// can also serve as a plain Mutex.
+class SeqLock {
+private:
+  // Odd while a writer holds the lock
+  std::atomic<uint64_t> version_{0};
+
+public:
+  SeqLock() = default;
+
+  SeqLock(const SeqLock &) = delete;
+
+  auto operator=(const SeqLock &) -> SeqLock & = delete;
+
+  auto try_lock() -> bool {
+    uint64_t version = version_.load(std::memory_order_relaxed);
+    return !(version & 1) &&
+           version_.compare_exchange_strong(version, version + 1,
+                                            std::memory_order_acq_rel);
+  }
+
+  void lock() {
+    for (Backoff backoff; !try_lock(); backoff.Pause()) {
+    }
+  }
+
+  void unlock() { version_.fetch_add(1, std::memory_order_release); }
+
+  auto try_lock_shared() -> bool { return try_lock(); }
+
+  void lock_shared() { lock(); }
+
+  void unlock_shared() { unlock(); }
+
+  // Waits until no writer holds the lock and returns the version to validate
+  auto ReadBegin() const -> uint64_t {
+    Backoff backoff;
+    uint64_t version = version_.load(std::memory_order_acquire);
+    while (version & 1) {
+      backoff.Pause();
+      version = version_.load(std::memory_order_acquire);
+    }
+    return version;
+  }
+
+  // Whether nothing was written since ReadBegin() returned version
+  auto ReadValidate(uint64_t version) const -> bool {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
+};
+
+// The widest word that evenly divides T, for copying it word by word
+template <typename T>
+using relaxed_word_t = std::conditional_t<
+    alignof(T) % 8 == 0, uint64_t,
+    std::conditional_t<alignof(T) % 4 == 0, uint32_t,
+                       std::conditional_t<alignof(T) % 2 == 0, uint16_t,
+                                          uint8_t>>>;
+
+// Copies *from with relaxed atomic loads of its words. A SeqLock reader may
+// race with a RelaxedStore() this way; the copy may be torn, so it is only
+// valid once ReadValidate() succeeds.
+template <typename T> auto RelaxedLoad(const T *from) -> T {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "RelaxedLoad needs a trivially copyable type.");
+  using word_type = relaxed_word_t<T>;
+  word_type words[sizeof(T) / sizeof(word_type)];
+  auto source = reinterpret_cast<const word_type *>(from);
+  for (std::size_t i = 0; i < sizeof(T) / sizeof(word_type); ++i) {
+    words[i] = __atomic_load_n(source + i, __ATOMIC_RELAXED);
+  }
+  T value;
+  std::memcpy(&value, words, sizeof(T));
+  return value;
+}
+
+// Writes value to *to with relaxed atomic stores of its words, for objects
+// that SeqLock readers copy with RelaxedLoad()
+template <typename T> void RelaxedStore(T *to, const T &value) {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "RelaxedStore needs a trivially copyable type.");
+  using word_type = relaxed_word_t<T>;
+  word_type words[sizeof(T) / sizeof(word_type)];
+  std::memcpy(words, &value, sizeof(T));
+  auto target = reinterpret_cast<word_type *>(to);
+  for (std::size_t i = 0; i < sizeof(T) / sizeof(word_type); ++i) {
+    __atomic_store_n(target + i, words[i], __ATOMIC_RELAXED);
+  }
+}
+
+// Default lock stripe count of the Sync containers, a few per hardware thread
+inline auto DefaultStripeSize() -> std::size_t {
+  std::size_t threads =
+      Max(static_cast<std::size_t>(std::thread::hardware_concurrency()),
+          static_cast<std::size_t>(1));
+  return CeilPowerOfTwo(threads * 4);
+}
+
+// Small per-thread index, threads are numbered in order of first use
+inline auto ThreadIndex() -> std::size_t {
+  static std::atomic<std::size_t> next_index(0);
+  thread_local const std::size_t index = next_index.fetch_add(1);
+  return index;
+}
+
+// Fast pseudo random numbers (wyrand) for randomized structures, not for
+// statistics. Every thread has its own state, so there is nothing to race on.
+inline auto ThreadRandom() -> uint64_t {
+  thread_local uint64_t state = (ThreadIndex() + 1) * 0x9E3779B97F4A7C15ull;
+  state += 0xa0761d6478bd642full;
+  __uint128_t product =
+      static_cast<__uint128_t>(state) * (state ^ 0xe7037ed1a0b428dbull);
+  return static_cast<uint64_t>(product >> 64) ^ static_cast<uint64_t>(product);
+}
+
+// Runs fn(i) for every i below threads, fn(0) on the calling thread
+template <typename F> void ParallelFor(std::size_t threads, F fn) {
+  Vector<std::thread> workers;
+  for (std::size_t i = 1; i < threads; ++i) {
+    workers.EmplaceBack([&fn, i] { fn(i); });
+  }
+  fn(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+// Counter split into cache-line padded shards. Add() only touches the shard
+// of the calling thread, Load() sums every shard. A shard may go negative
+// when one thread adds and another subtracts, only the sum is meaningful.
+class ShardedCounter {
+private:
+  const std::size_t shard_size_;
+
+  Array<CacheLinePadded<std::atomic<int64_t>>> shards_;
+
+public:
+  // shard_size 0 picks DefaultStripeSize()
+  explicit ShardedCounter(std::size_t shard_size = 0)
+      : shard_size_(CeilPowerOfTwo(shard_size == 0 ? DefaultStripeSize()
+                                                   : shard_size)),
+        shards_(shard_size_) {}
+
+  ShardedCounter(const ShardedCounter &) = delete;
+
+  auto operator=(const ShardedCounter &) -> ShardedCounter & = delete;
+
+  void Add(int64_t delta) {
+    shards_[ThreadIndex() & (shard_size_ - 1)].value.fetch_add(
+        delta, std::memory_order_relaxed);
+  }
+
+  auto Load() const -> int64_t {
+    int64_t result = 0;
+    for (auto &shard : shards_) {
+      result += shard.value.load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  void Reset() {
+    for (auto &shard : shards_) {
+      shard.value.store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+// Epoch-based reclamation shared by the lock-free containers. Threads read
+// shared nodes inside an EpochGuard; a node unlinked from a structure is
+// passed to Retire() and freed once every guard that might still reach it
+// has been left. A thread pins the global epoch when it enters, the epoch
+// only advances past threads pinned to it, and memory retired in epoch e is
+// freed from epoch e + 2 on.
+class EpochReclaimer {
+private:
+  static constexpr uint64_t kInactive = ~static_cast<uint64_t>(0);
+
+  // Retired pointers a thread collects between attempts to free them
+  static constexpr std::size_t kReclaimThreshold = 64;
+
+  struct Retired {
+    void *pointer = nullptr;
+    void (*deleter)(void *) = nullptr;
+    uint64_t epoch = 0;
+  };
+
+  // One per thread, reused after the thread exits
+  struct alignas(kCacheLineSize) Record {
+    std::atomic<uint64_t> epoch{kInactive};
+
+    std::atomic<bool> in_use{true};
+
+    Record *next = nullptr;
+
+    // Only touched by the owning thread
+    std::size_t depth = 0;
+
+    Vector<Retired> retired;
+  };
+
+  // Gives the record back when its thread exits
+  struct Handle {
+    Record *record = nullptr;
+
+    ~Handle() {
+      if (record != nullptr) {
+        Instance().Release(record);
+      }
+    }
+  };
+
+  std::atomic<uint64_t> epoch_{0};
+
+  std::atomic<Record *> records_{nullptr};
+
+  // Retired by threads that have exited
+  Vector<Retired> orphans_;
+
+  std::mutex orphans_m_;
+
+  EpochReclaimer() = default;
+
+  auto Acquire() -> Record * {
+    for (Record *record = records_.load(std::memory_order_acquire);
+         record != nullptr; record = record->next) {
+      bool in_use = false;
+      if (!record->in_use.load(std::memory_order_relaxed) &&
+          record->in_use.compare_exchange_strong(in_use, true,
+                                                 std::memory_order_acquire)) {
+        return record;
+      }
+    }
+    Record *record = new Record;
+    Record *head = records_.load(std::memory_order_relaxed);
+    do {
+      record->next = head;
+    } while (!records_.compare_exchange_weak(head, record,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+    return record;
+  }
+
+  void Release(Record *record) {
+    {
+      std::lock_guard<std::mutex> lock(orphans_m_);
+      for (auto &retired : record->retired) {
+        orphans_.PushBack(retired);
+      }
+    }
+    record->retired.Clear();
+    record->in_use.store(false, std::memory_order_release);
+  }
+
+  auto Local() -> Record & {
+    thread_local Handle handle;
+    if (handle.record == nullptr) {
+      handle.record = Acquire();
+    }
+    return *handle.record;
+  }
+
+  // Advances the global epoch if every active thread has pinned it
+  auto TryAdvance() -> uint64_t {
+    uint64_t epoch = epoch_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Acquiring each pinned epoch orders the reads of that thread's past
+    // guards before anything freed in a later epoch
+    for (Record *record = records_.load(std::memory_order_acquire);
+         record != nullptr; record = record->next) {
+      uint64_t pinned = record->epoch.load(std::memory_order_acquire);
+      if (pinned != kInactive && pinned != epoch) {
+        return epoch;
+      }
+    }
+    if (epoch_.compare_exchange_strong(epoch, epoch + 1,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_acquire)) {
+      return epoch + 1;
+    }
+    return epoch;
+  }
+
+  // Frees what was retired at least two epochs before epoch
+  static void Reclaim(Vector<Retired> &retired, uint64_t epoch) {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < retired.size(); ++i) {
+      if (retired[i].epoch + 2 <= epoch) {
+        retired[i].deleter(retired[i].pointer);
+      } else {
+        retired[kept++] = retired[i];
+      }
+    }
+    while (retired.size() > kept) {
+      retired.PopBack();
+    }
+  }
+
+public:
+  EpochReclaimer(const EpochReclaimer &) = delete;
+
+  auto operator=(const EpochReclaimer &) -> EpochReclaimer & = delete;
+
+  static auto Instance() -> EpochReclaimer & {
+    // Never destroyed, exiting threads still hand their records back
+    static EpochReclaimer *instance = new EpochReclaimer;
+    return *instance;
+  }
+
+  // Guards nest, only the outermost pins the epoch
+  void Enter() {
+    Record &record = Local();
+    if (record.depth++ == 0) {
+      // The pin only counts once the epoch is seen unchanged after it was
+      // published, a stale pin would let older retirements be freed
+      uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+      while (true) {
+        record.epoch.store(epoch, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t current = epoch_.load(std::memory_order_acquire);
+        if (current == epoch) {
+          break;
+        }
+        epoch = current;
+      }
+    }
+  }
+
+  void Exit() {
+    Record &record = Local();
+    if (--record.depth == 0) {
+      record.epoch.store(kInactive, std::memory_order_release);
+    }
+  }
+
+  // Calls deleter(pointer) once no guard can still reach pointer. pointer
+  // must already be unreachable for threads entering a guard from now on.
+  void Retire(void *pointer, void (*deleter)(void *)) {
+    Enter();
+    Record &record = Local();
+    // Stamped with the global epoch after the unlink, guards that could
+    // still reach pointer have pinned it or the one before
+    record.retired.PushBack(
+        {pointer, deleter, epoch_.load(std::memory_order_acquire)});
+    if (record.retired.size() % kReclaimThreshold == 0) {
+      uint64_t epoch = TryAdvance();
+      Reclaim(record.retired, epoch);
+      std::unique_lock<std::mutex> lock(orphans_m_, std::try_to_lock);
+      if (lock.owns_lock()) {
+        Reclaim(orphans_, epoch);
+      }
+    }
+    Exit();
+  }
+};
+
+// Pins the epoch of the calling thread for its lifetime
+class EpochGuard {
+public:
+  EpochGuard() { EpochReclaimer::Instance().Enter(); }
+
+  EpochGuard(const EpochGuard &) = delete;
+
+  ~EpochGuard() { EpochReclaimer::Instance().Exit(); }
+
+  auto operator=(const EpochGuard &) -> EpochGuard & = delete;
+};
+
+// Deletes pointer once no EpochGuard can still reach it
+template <typename T> void Retire(T *pointer) {
+  EpochReclaimer::Instance().Retire(
+      pointer, [](void *p) { delete static_cast<T *>(p); });
+}
+
+} // namespace ts_stl
+
+#endif
@@ -0,0 +1,469 @@
+#ifndef TS_STL_TTL_HASHMAP_H_
+#define TS_STL_TTL_HASHMAP_H_
+
+#include "src/array.h"
+#include "src/hashmap.h"
+#include "src/sync.h"
+#include "src/utils.h"
+#include "src/vector.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+namespace ts_stl {
+
+// Hierarchical timer wheel over integer ticks. Level l has 64 slots of 64^l
+// ticks each. An item sits in the level of the highest 6-bit group in which
+// its deadline differs from the current tick, and moves down a level when
+// the wheel reaches its slot, so it is touched at most once per level.
+// Advancing jumps over empty slots with one bitmap per level. Deadlines past
+// the top level are parked in the top slot reached last and placed again
+// from there. Items live in a pool and each slot links its items into a
+// list, so Schedule() returns a handle that Reschedule() and Cancel() use to
+// move or unlink the item in constant time.
+template <typename T> class TimerWheel {
+public:
+  using size_type = std::size_t;
+
+  // Valid from Schedule() until the item is cancelled or handed out
+  using handle_type = size_type;
+
+private:
+  static constexpr size_type kSlotBits = 6;
+
+  static constexpr size_type kSlots = 1 << kSlotBits;
+
+  // 2^36 ticks, over two years at 1ms
+  static constexpr size_type kLevels = 6;
+
+  static constexpr size_type kNone = static_cast<size_type>(-1);
+
+  struct Item {
+    T value;
+
+    uint64_t deadline;
+
+    // Neighbours in the list of a slot, or the next free item
+    size_type prev;
+
+    size_type next;
+
+    // level * kSlots + slot
+    size_type slot;
+  };
+
+  uint64_t current_ = 0;
+
+  // Bit s of occupied_[l] is set if slot s of level l holds items
+  uint64_t occupied_[kLevels] = {};
+
+  // The first item of every slot, level by level
+  ts_stl::Array<size_type> heads_;
+
+  ts_stl::Vector<Item> items_;
+
+  size_type free_ = kNone;
+
+  size_type size_ = 0;
+
+  void Link(size_type index, size_type level, size_type slot) {
+    Item &item = items_[index];
+    size_type &head = heads_[level * kSlots + slot];
+    item.slot = level * kSlots + slot;
+    item.prev = kNone;
+    item.next = head;
+    if (head != kNone) {
+      items_[head].prev = index;
+    }
+    head = index;
+    occupied_[level] |= uint64_t(1) << slot;
+  }
+
+  // Clears the bit of the slot once it is empty
+  void Unlink(size_type index) {
+    Item &item = items_[index];
+    if (item.prev != kNone) {
+      items_[item.prev].next = item.next;
+    } else {
+      heads_[item.slot] = item.next;
+    }
+    if (item.next != kNone) {
+      items_[item.next].prev = item.prev;
+    }
+    if (heads_[item.slot] == kNone) {
+      occupied_[item.slot / kSlots] &= ~(uint64_t(1) << item.slot % kSlots);
+    }
+  }
+
+  void Free(size_type index) {
+    items_[index].next = free_;
+    free_ = index;
+  }
+
+  void Place(size_type index) {
+    uint64_t tick = Max(items_[index].deadline, current_);
+    size_type level =
+        tick == current_ ? 0 : FloorLog2(tick ^ current_) / kSlotBits;
+    if (level >= kLevels - 1) {
+      // The top level wraps around. Deadlines a rotation or more away are
+      // parked in the top slot reached last.
+      level = kLevels - 1;
+      size_type shift = level * kSlotBits;
+      if ((tick >> shift) - (current_ >> shift) >= kSlots) {
+        tick = ((current_ >> shift) - 1) << shift;
+      }
+    }
+    Link(index, level, (tick >> (level * kSlotBits)) & (kSlots - 1));
+  }
+
+  // Unlinks the first item of slot
+  auto Pop(size_type level, size_type slot) -> size_type {
+    size_type index = heads_[level * kSlots + slot];
+    Unlink(index);
+    return index;
+  }
+
+  // The first tick after current_ at which an occupied slot is reached, at
+  // most now. Everything due at current_ has been handled.
+  auto NextTick(uint64_t now) const -> uint64_t {
+    for (size_type level = 0; level < kLevels; ++level) {
+      size_type shift = level * kSlotBits;
+      size_type slot = (current_ >> shift) & (kSlots - 1);
+      uint64_t later = slot == kSlots - 1 ? 0 : occupied_[level] >> (slot + 1);
+      if (level == kLevels - 1) {
+        // Parked items sit in the next rotation of the top level
+        uint64_t others = occupied_[level] & ~(uint64_t(1) << slot);
+        size_type r = (slot + 1) & (kSlots - 1);
+        later = r == 0 ? others : others >> r | others << (kSlots - r);
+      }
+      if (later != 0) {
+        uint64_t tick = ((current_ >> shift) + 1 + __builtin_ctzll(later))
+                        << shift;
+        return Min(now, tick);
+      }
+    }
+    return now;
+  }
+
+public:
+  TimerWheel() : heads_(kLevels * kSlots) {
+    for (auto &head : heads_) {
+      head = kNone;
+    }
+  }
+
+  // Items scheduled and not yet handed out
+  auto size() const -> size_type { return size_; }
+
+  auto current() const -> uint64_t { return current_; }
+
+  // An item due at or before current() is handed out by the next Advance()
+  auto Schedule(const T &value, uint64_t deadline) -> handle_type {
+    size_type index = free_;
+    if (index != kNone) {
+      free_ = items_[index].next;
+      items_[index].value = value;
+      items_[index].deadline = deadline;
+    } else {
+      index = items_.size();
+      items_.EmplaceBack(Item{value, deadline, kNone, kNone, 0});
+    }
+    Place(index);
+    ++size_;
+    return index;
+  }
+
+  // Moves the item of handle to a new deadline
+  void Reschedule(handle_type handle, uint64_t deadline) {
+    Unlink(handle);
+    items_[handle].deadline = deadline;
+    Place(handle);
+  }
+
+  // Drops the item of handle without handing it out
+  void Cancel(handle_type handle) {
+    Unlink(handle);
+    Free(handle);
+    --size_;
+  }
+
+  // Whether Advance(now) has nothing left to do
+  auto CaughtUp(uint64_t now) const -> bool {
+    if (current_ < now || occupied_[0] >> (current_ & (kSlots - 1)) & 1) {
+      return false;
+    }
+    for (size_type level = 1; level < kLevels; ++level) {
+      size_type shift = level * kSlotBits;
+      if ((current_ & ((uint64_t(1) << shift) - 1)) == 0 &&
+          occupied_[level] >> ((current_ >> shift) & (kSlots - 1)) & 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Moves towards tick now, calling due(value, deadline) for every item
+  // whose deadline is reached. Stops after budget items were handed out or
+  // moved between levels and returns the number handed out.
+  template <typename F>
+  auto Advance(uint64_t now, size_type budget, F due) -> size_type {
+    size_type handed_out = 0;
+    for (;;) {
+      // Higher levels first, their items may land in lower slots of this
+      // tick
+      for (size_type level = kLevels - 1; level > 0; --level) {
+        size_type shift = level * kSlotBits;
+        if ((current_ & ((uint64_t(1) << shift) - 1)) != 0) {
+          continue;
+        }
+        size_type slot = (current_ >> shift) & (kSlots - 1);
+        while (occupied_[level] >> slot & 1) {
+          if (budget == 0) {
+            return handed_out;
+          }
+          --budget;
+          Place(Pop(level, slot));
+        }
+      }
+      size_type slot = current_ & (kSlots - 1);
+      while (occupied_[0] >> slot & 1) {
+        if (budget == 0) {
+          return handed_out;
+        }
+        --budget;
+        size_type index = Pop(0, slot);
+        // Copied first, due may schedule items and move the pool
+        T value = items_[index].value;
+        uint64_t deadline = items_[index].deadline;
+        Free(index);
+        --size_;
+        ++handed_out;
+        due(value, deadline);
+      }
+      if (current_ >= now) {
+        return handed_out;
+      }
+      current_ = NextTick(now);
+    }
+  }
+};
+
+// Concurrent hash map whose entries expire a given time after they were
+// inserted. Keys are split into shards by hash, each with a lock, a HashMap
+// and a TimerWheel of deadlines. Every write to a shard first advances its
+// wheel by at most kExpireBudget items, so expired entries are removed a few
+// at a time without any scan of the table; Expire() drives the same work
+// for idle shards. Lookups treat an expired entry as absent whether or not
+// it was removed yet. Every entry keeps the handle of its wheel item, so
+// reinserting a key moves the item and deleting it cancels the item; a wheel
+// holds exactly one item per entry of its shard. The clock is read before a
+// shard is locked and locks are held for a lookup only, so Mutex defaults to
+// SpinSharedMutex.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>,
+          typename Mutex = SpinSharedMutex,
+          typename Clock = std::chrono::steady_clock>
+class TtlHashMap {
+public:
+  using key_type = K;
+  using value_type = V;
+  using size_type = std::size_t;
+  using duration = std::chrono::nanoseconds;
+
+  // Wheel items each write may handle
+  static constexpr size_type kExpireBudget = 8;
+
+private:
+  struct Entry {
+    value_type value;
+
+    // Expired from this tick on
+    uint64_t deadline;
+
+    typename TimerWheel<key_type>::handle_type timer;
+  };
+
+  struct alignas(kCacheLineSize) Shard {
+    Mutex m;
+
+    HashMap<key_type, Entry, Hash, KeyEqual> map;
+
+    TimerWheel<key_type> wheel;
+  };
+
+  const typename Clock::time_point epoch_;
+
+  const int64_t tick_;
+
+  const size_type shard_size_;
+
+  ts_stl::Array<Shard> shard_;
+
+  ShardedCounter size_;
+
+  const Hash hasher_;
+
+  auto ShardOf(const key_type &key) -> Shard & {
+    return shard_[MixHash(hasher_(key)) & (shard_size_ - 1)];
+  }
+
+  auto Now() const -> uint64_t {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<duration>(Clock::now() - epoch_).count() /
+        tick_);
+  }
+
+  // Rounded up, so an entry never expires early
+  auto DeadlineAfter(duration ttl) const -> uint64_t {
+    int64_t since_epoch =
+        std::chrono::duration_cast<duration>(Clock::now() - epoch_ + ttl)
+            .count();
+    return static_cast<uint64_t>((Max<int64_t>(since_epoch, 0) + tick_ - 1) /
+                                 tick_);
+  }
+
+  // Caller holds the unique lock of shard
+  auto ExpireIn(Shard &shard, uint64_t now, size_type budget) -> size_type {
+    size_type expired = 0;
+    shard.wheel.Advance(now, budget, [&](const key_type &key, uint64_t) {
+      shard.map.Delete(key);
+      size_.Add(-1);
+      ++expired;
+    });
+    return expired;
+  }
+
+  template <typename U>
+  void InsertEntry(const key_type &key, U &&value, duration ttl) {
+    Shard &shard = ShardOf(key);
+    uint64_t now = Now();
+    uint64_t deadline = DeadlineAfter(ttl);
+    std::unique_lock<Mutex> lock(shard.m);
+    ExpireIn(shard, now, kExpireBudget);
+    if (auto entry = shard.map.Find(key)) {
+      entry->value = std::forward<U>(value);
+      if (entry->deadline != deadline) {
+        entry->deadline = deadline;
+        shard.wheel.Reschedule(entry->timer, deadline);
+      }
+      return;
+    }
+    shard.map.Insert(key, Entry{std::forward<U>(value), deadline,
+                                shard.wheel.Schedule(key, deadline)});
+    size_.Add(1);
+  }
+
+public:
+  // Deadlines are kept in whole ticks. shard_size 0 picks
+  // DefaultStripeSize().
+  TtlHashMap(duration tick = std::chrono::milliseconds(1),
+             size_type shard_size = 0, Hash hasher = Hash())
+      : epoch_(Clock::now()), tick_(Max<int64_t>(tick.count(), 1)),
+        shard_size_(CeilPowerOfTwo(shard_size == 0 ? DefaultStripeSize()
+                                                   : shard_size)),
+        shard_(shard_size_), hasher_(hasher) {}
+
+  TtlHashMap(const TtlHashMap &) = delete;
+
+  auto operator=(const TtlHashMap &) -> TtlHashMap & = delete;
+
+  // Entries not removed yet, expired ones included. Lock-free, exact
+  // whenever no write is in flight.
+  auto size() const -> size_type {
+    return static_cast<size_type>(Max<int64_t>(size_.Load(), 0));
+  }
+
+  auto shard_size() const -> size_type { return shard_size_; }
+
+  // Inserts or replaces key, which expires ttl from now
+  void Insert(const key_type &key, const value_type &value, duration ttl) {
+    InsertEntry(key, value, ttl);
+  }
+
+  void Insert(const key_type &key, value_type &&value, duration ttl) {
+    InsertEntry(key, std::move(value), ttl);
+  }
+
+  // Copies the value of key into value unless key is absent or expired
+  auto Get(const key_type &key, value_type &value) -> bool {
+    Shard &shard = ShardOf(key);
+    uint64_t now = Now();
+    std::shared_lock<Mutex> lock(shard.m);
+    auto entry = shard.map.Find(key);
+    if (entry == nullptr || entry->deadline <= now) {
+      return false;
+    }
+    value = entry->value;
+    return true;
+  }
+
+  auto Contains(const key_type &key) -> bool {
+    Shard &shard = ShardOf(key);
+    uint64_t now = Now();
+    std::shared_lock<Mutex> lock(shard.m);
+    auto entry = shard.map.Find(key);
+    return entry != nullptr && entry->deadline > now;
+  }
+
+  // Time until key expires, or zero if it is absent or expired
+  auto Ttl(const key_type &key) -> duration {
+    Shard &shard = ShardOf(key);
+    std::shared_lock<Mutex> lock(shard.m);
+    auto entry = shard.map.Find(key);
+    if (entry == nullptr) {
+      return duration::zero();
+    }
+    auto deadline = epoch_ + duration(static_cast<int64_t>(entry->deadline) *
+                                      tick_);
+    return Max(std::chrono::duration_cast<duration>(deadline - Clock::now()),
+               duration::zero());
+  }
+
+  auto Delete(const key_type &key) -> bool {
+    Shard &shard = ShardOf(key);
+    uint64_t now = Now();
+    std::unique_lock<Mutex> lock(shard.m);
+    ExpireIn(shard, now, kExpireBudget);
+    auto entry = shard.map.Find(key);
+    if (entry == nullptr) {
+      return false;
+    }
+    bool live = entry->deadline > now;
+    shard.wheel.Cancel(entry->timer);
+    shard.map.Delete(key);
+    size_.Add(-1);
+    return live;
+  }
+
+  // Removes up to budget expired entries from every shard, for shards
+  // without writes. Unlike writes, it does not stop at moving items between
+  // wheel levels. Returns the number of entries removed.
+  auto Expire(size_type budget = kExpireBudget) -> size_type {
+    size_type expired = 0;
+    uint64_t now = Now();
+    for (auto &shard : shard_) {
+      std::unique_lock<Mutex> lock(shard.m);
+      size_type removed = 0;
+      while (removed < budget && !shard.wheel.CaughtUp(now)) {
+        removed += ExpireIn(shard, now, budget - removed);
+      }
+      expired += removed;
+    }
+    return expired;
+  }
+
+  // The value of key, or value_type() if it is absent or expired
+  auto operator[](const key_type &key) -> value_type {
+    value_type value{};
+    Get(key, value);
+    return value;
+  }
+};
+
+} // namespace ts_stl
+
+#endif
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <iterator>
 #include <memory>
@@ -28,6 +29,14 @@ public:
   static constexpr bool value = decltype(test<T>(std::declval<T>()))::value;
 };
 
+// Whether T declares is_transparent, which enables lookups by other key types
+template <typename T, typename = void>
+struct is_transparent : std::false_type {};
+
+template <typename T>
+struct is_transparent<T, std::void_t<typename T::is_transparent>>
+    : std::true_type {};
+
 inline void Assert(bool condition, const char *message) {
   if (!condition) {
     std::cerr << message << std::endl;
@@ -45,6 +54,30 @@ template <typename T> auto Min(const T &a, const T &b) -> T {
   return a < b ? a : b;
 }
 
+// Smallest power of two no less than n
+inline auto CeilPowerOfTwo(size_t n) -> size_t {
+  size_t result = 1;
+  while (result < n) {
+    result <<= 1;
+  }
+  return result;
+}
+
+// Largest e with 2^e <= n, n must not be 0
+inline auto FloorLog2(uint64_t n) -> size_t {
+  return 63 - __builtin_clzll(n);
+}
+
+// Reverses the bit order of a 64-bit word
+inline auto ReverseBits(uint64_t n) -> uint64_t {
+  n = (n >> 1 & 0x5555555555555555ull) | (n & 0x5555555555555555ull) << 1;
+  n = (n >> 2 & 0x3333333333333333ull) | (n & 0x3333333333333333ull) << 2;
+  n = (n >> 4 & 0x0f0f0f0f0f0f0f0full) | (n & 0x0f0f0f0f0f0f0f0full) << 4;
+  n = (n >> 8 & 0x00ff00ff00ff00ffull) | (n & 0x00ff00ff00ff00ffull) << 8;
+  n = (n >> 16 & 0x0000ffff0000ffffull) | (n & 0x0000ffff0000ffffull) << 16;
+  return n >> 32 | n << 32;
+}
+
 template <typename T> auto Abs(const T &a) -> T { return a < 0 ? -a : a; }
 
 template <typename T> auto Clamp(const T &v, const T &min, const T &max) -> T {
@@ -78,6 +111,16 @@ auto CopyBackward(Iter1 dest_end, Iter2 begin, Iter2 end) -> Iter1 {
   return std::copy_backward(begin, end, dest_end);
 }
 
+template <typename Iter1, typename Iter2>
+auto Move(Iter1 dest_begin, Iter2 begin, Iter2 end) -> Iter1 {
+  return std::move(begin, end, dest_begin);
+}
+
+template <typename Iter1, typename Iter2>
+auto MoveBackward(Iter1 dest_end, Iter2 begin, Iter2 end) -> Iter1 {
+  return std::move_backward(begin, end, dest_end);
+}
+
 template <typename Iter1, typename Iter2>
 auto ConstructorCopy(Iter1 dest_begin, Iter2 begin, Iter2 end) -> Iter1 {
   while (begin != end) {
@@ -106,6 +149,15 @@ auto AutoCopy(Iter dest_begin, Iter begin, Iter end) -> Iter {
   }
 }
 
+template <typename Iter>
+auto AutoMove(Iter dest_begin, Iter begin, Iter end) -> Iter {
+  if constexpr (has_assignment_operator<decltype(*Iter{})>::value) {
+    return Move(dest_begin, begin, end);
+  } else {
+    return ConstructorCopy(dest_begin, begin, end);
+  }
+}
+
 template <typename Iter>
 auto AutoCopyBackward(Iter dest_end, Iter begin, Iter end) -> Iter {
   if constexpr (has_assignment_operator<decltype(*Iter{})>::value) {
@@ -40,7 +40,7 @@ private:
     if (size_ > capacity) {
       size_ = capacity;
     }
-    AutoCopy(new_data, data_, data_ + size_);
+    AutoMove(new_data, data_, data_ + size_);
     Swap(new_data, data_);
     delete[] new_data;
     capacity_ = capacity;
@@ -89,6 +89,7 @@ public:
     expand_factor_ = other.expand_factor_;
     auto_shrink_ = other.auto_shrink_;
     data_ = other.data_;
+    other.size_ = other.capacity_ = 0;
     other.data_ = nullptr;
   }
 
@@ -111,7 +112,9 @@ public:
       capacity_ = other.capacity_;
       expand_factor_ = other.expand_factor_;
       auto_shrink_ = other.auto_shrink_;
+      delete[] data_;
       data_ = other.data_;
+      other.size_ = other.capacity_ = 0;
       other.data_ = nullptr;
     }
     return *this;
@@ -219,6 +222,170 @@ public:
   }
 };
 
+// Vector keeping up to N elements inline, the heap is only used beyond
+// that. Like Vector, unused slots hold default constructed elements.
+template <typename T, std::size_t N> class SmallVector {
+public:
+  using value_type = T;
+  using pointer = T *;
+  using const_pointer = const T *;
+  using reference = T &;
+  using const_reference = const T &;
+  using difference_type = std::ptrdiff_t;
+  using size_type = std::size_t;
+
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  static_assert(N > 0, "SmallVector: N must be greater than 0.");
+
+private:
+  size_type size_ = 0;
+  size_type capacity_ = N;
+
+  // inline_ or a heap array of capacity_ elements
+  T *data_ = inline_;
+
+  T inline_[N];
+
+  auto IsInline() const -> bool { return data_ == inline_; }
+
+  void ChangeCapacity(size_type capacity) {
+    T *new_data = new T[capacity];
+    AutoMove(new_data, data_, data_ + size_);
+    if (!IsInline()) {
+      delete[] data_;
+    }
+    data_ = new_data;
+    capacity_ = capacity;
+  }
+
+  void CheckExpand() {
+    if (size_ == capacity_) {
+      ChangeCapacity(capacity_ * 2);
+    }
+  }
+
+  // Takes the elements of other and leaves it empty and inline
+  void Steal(SmallVector &other) {
+    if (other.IsInline()) {
+      AutoMove(inline_, other.inline_, other.inline_ + other.size_);
+      data_ = inline_;
+      capacity_ = N;
+    } else {
+      data_ = other.data_;
+      capacity_ = other.capacity_;
+      other.data_ = other.inline_;
+      other.capacity_ = N;
+    }
+    size_ = other.size_;
+    other.size_ = 0;
+  }
+
+public:
+  auto begin() -> iterator { return data_; }
+  auto end() -> iterator { return data_ + size_; }
+  auto begin() const -> const_iterator { return data_; }
+  auto end() const -> const_iterator { return data_ + size_; }
+  auto cbegin() const -> const_iterator { return data_; }
+  auto cend() const -> const_iterator { return data_ + size_; }
+
+  SmallVector() {}
+
+  SmallVector(const SmallVector &other) {
+    Reserve(other.size_);
+    AutoCopy(data_, other.data_, other.data_ + other.size_);
+    size_ = other.size_;
+  }
+
+  SmallVector(SmallVector &&other) { Steal(other); }
+
+  auto operator=(const SmallVector &other) -> SmallVector & {
+    if (this != &other) {
+      size_ = 0;
+      Reserve(other.size_);
+      AutoCopy(data_, other.data_, other.data_ + other.size_);
+      size_ = other.size_;
+    }
+    return *this;
+  }
+
+  auto operator=(SmallVector &&other) -> SmallVector & {
+    if (this != &other) {
+      if (!IsInline()) {
+        delete[] data_;
+      }
+      Steal(other);
+    }
+    return *this;
+  }
+
+  ~SmallVector() {
+    if (!IsInline()) {
+      delete[] data_;
+    }
+  }
+
+  void PushBack(const T &value) {
+    CheckExpand();
+    *(data_ + size_++) = value;
+  }
+
+  template <typename... Args> void EmplaceBack(Args &&...args) {
+    CheckExpand();
+    new (data_ + size_++) T(std::forward<Args>(args)...);
+  }
+
+  auto PopBack() -> T {
+    Assert(size_ > 0, "SmallVector::PopBack(): vector is empty.");
+    return *(data_ + --size_);
+  }
+
+  auto Back() -> T & {
+    Assert(size_ > 0, "SmallVector::Back(): vector is empty.");
+    return *(data_ + size_ - 1);
+  }
+
+  auto Back() const -> const T & {
+    Assert(size_ > 0, "SmallVector::Back(): vector is empty.");
+    return *(data_ + size_ - 1);
+  }
+
+  auto Delete(size_type index) -> T {
+    Assert(index < size_, "SmallVector::Delete(): index out of range.");
+    T t = *(data_ + index);
+    AutoCopy(data_ + index, data_ + index + 1, data_ + size_);
+    size_--;
+    return t;
+  }
+
+  void Reserve(size_type capacity) {
+    if (capacity > capacity_) {
+      ChangeCapacity(capacity);
+    }
+  }
+
+  auto operator[](size_type index) -> T & {
+    Assert(index < size_, "SmallVector::operator[]: index out of range.");
+    return data_[index];
+  }
+
+  auto operator[](size_type index) const -> const T & {
+    Assert(index < size_, "SmallVector::operator[]: index out of range.");
+    return data_[index];
+  }
+
+  auto size() const -> size_type { return size_; }
+  auto capacity() const -> size_type { return capacity_; }
+
+  auto RawData() -> T * { return data_; }
+  auto RawData() const -> const T * { return data_; }
+
+  auto Empty() const -> bool { return size_ == 0; }
+
+  void Clear() { size_ = 0; }
+};
+
 template <typename T> class SyncVector {
 public:
   using value_type = T;
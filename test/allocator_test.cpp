@@ -0,0 +1,74 @@
+#include "src/allocator.h"
+#include "test_utils.h"
+#include <gtest/gtest.h>
+#include <set>
+#include <vector>
+
+TEST(AllocatorTest, PoolAllocatorTest) {
+  ts_stl::PoolAllocator<size_t> allocator;
+  std::vector<size_t *> pointers;
+  std::set<size_t *> distinct;
+  for (size_t i = 0; i < 10000; ++i) {
+    size_t *p = allocator.allocate(1);
+    *p = i;
+    pointers.push_back(p);
+    distinct.insert(p);
+  }
+  EXPECT_EQ(distinct.size(), 10000);
+  // Consecutive objects of a chunk are adjacent
+  EXPECT_EQ(pointers[1], pointers[0] + 1);
+  for (size_t i = 0; i < 10000; ++i) {
+    EXPECT_EQ(*pointers[i], i);
+  }
+
+  // Freed objects are handed out again first
+  allocator.deallocate(pointers[42], 1);
+  EXPECT_EQ(allocator.allocate(1), pointers[42]);
+
+  // Copies share the pool, container copies do not
+  auto copy = allocator;
+  EXPECT_TRUE(copy == allocator);
+  EXPECT_FALSE(allocator.Unique());
+  copy.deallocate(pointers[7], 1);
+  EXPECT_EQ(allocator.allocate(1), pointers[7]);
+  auto other = allocator.select_on_container_copy_construction();
+  EXPECT_TRUE(other != allocator);
+  copy = other;
+  EXPECT_TRUE(allocator.Unique());
+
+  // Arrays bypass the pool
+  size_t *array = allocator.allocate(16);
+  allocator.deallocate(array, 16);
+
+  allocator.Release();
+  size_t *p = allocator.allocate(1);
+  *p = 1;
+  allocator.deallocate(p, 1);
+}
+
+TEST(AllocatorTest, PoolAllocatorCopyTest) {
+  // A copy made before the first allocation shares the pool all the same
+  ts_stl::PoolAllocator<size_t> allocator;
+  auto copy = allocator;
+  EXPECT_TRUE(copy == allocator);
+  size_t *p = allocator.allocate(1);
+  EXPECT_TRUE(copy == allocator);
+  copy.deallocate(p, 1);
+  EXPECT_EQ(allocator.allocate(1), p);
+  allocator.deallocate(p, 1);
+
+  // Rebinding keeps equality, A(B(a)) == a
+  ts_stl::PoolAllocator<char> rebound(allocator);
+  EXPECT_TRUE(rebound == allocator);
+  EXPECT_TRUE(ts_stl::PoolAllocator<size_t>(rebound) == allocator);
+  char *c = rebound.allocate(1);
+  *c = 'a';
+  ts_stl::PoolAllocator<char>(allocator).deallocate(c, 1);
+
+  // A moved-from allocator starts over when it allocates again
+  auto moved = std::move(copy);
+  EXPECT_TRUE(moved == allocator);
+  size_t *q = copy.allocate(1);
+  EXPECT_TRUE(copy != allocator);
+  copy.deallocate(q, 1);
+}
@@ -1,24 +1,63 @@
+#include "src/btree_map.h"
+#include "src/cache.h"
+#include "src/cuckoo_hashmap.h"
 #include "src/deque.h"
 #include "src/hashmap.h"
 #include "src/map.h"
 #include "src/queue.h"
 #include "src/stack.h"
+#include "src/static_hashmap.h"
+#include "src/sync.h"
+#include "src/ttl_hashmap.h"
 #include "src/vector.h"
 #include "test/test_utils.h"
 #include <algorithm>
+#include <chrono>
 #include <deque>
 #include <iostream>
+#include <list>
 #include <map>
+#include <mutex>
 #include <queue>
+#include <random>
 #include <stack>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 const int T3 = 1e3, T5 = 1e5, T6 = 1e6, T7 = 1e7, T8 = 1e8;
 
+const size_t kThreads =
+    std::max(static_cast<size_t>(std::thread::hardware_concurrency()),
+             static_cast<size_t>(2));
+
+// T6 operations split over threads, one write per 10 reads
+template <typename Map> void ContendedOps(Map &m, size_t threads) {
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&m, t, threads] {
+      size_t x = t * 2654435761u + 1;
+      for (size_t i = t; i < T6; i += threads) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        size_t key = (x >> 33) % T6;
+        if (i % 10 == 0) {
+          m.Insert(key, i);
+        } else {
+          m.Contains(key);
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
 template <typename Fn1, typename Fn2>
-void Benchmark(Fn1 fn1, Fn2 fn2, const char *name, size_t time_ms = 3000) {
+void Benchmark(Fn1 fn1, Fn2 fn2, const char *name,
+               const char *name1 = "TS-STL", const char *name2 = "STL",
+               size_t time_ms = 3000) {
   (void)[] {
     // Warm Up
     std::string s;
@@ -37,8 +76,8 @@ void Benchmark(Fn1 fn1, Fn2 fn2, const char *name, size_t time_ms = 3000) {
     t1 += TestTimeMs(fn1);
     t2 += TestTimeMs(fn2);
   }
-  std::cout << name << " benchmark: (TS-STL)" << t1 << "ms vs (STL)" << t2
-            << "ms" << std::endl;
+  std::cout << name << " benchmark: (" << name1 << ")" << t1 << "ms vs ("
+            << name2 << ")" << t2 << "ms" << std::endl;
 }
 
 int main() {
@@ -145,21 +184,512 @@ int main() {
       },
       "HashMap");
 
+  {
+    ts_stl::HashMap<size_t, size_t> m;
+    std::vector<size_t> keys(T6);
+    for (int i = 0; i < T6; ++i) {
+      keys[i] = FastRandom();
+      m[keys[i]] = i;
+    }
+    std::vector<size_t> queries(T6);
+    for (int i = 0; i < T6; ++i) {
+      queries[i] = i % 2 ? keys[FastRandom(0, T6 - 1)] : FastRandom();
+    }
+    std::vector<const size_t *> results(T6);
+    Benchmark(
+        [&] {
+          for (int i = 0; i < T6; i += 256) {
+            m.FindBatch(queries.data() + i, std::min(256, T6 - i),
+                        results.data() + i);
+          }
+        },
+        [&] {
+          for (int i = 0; i < T6; ++i) {
+            m.FindBatch(queries.data() + i, 1, results.data() + i);
+          }
+        },
+        "HashMap::FindBatch", "Batch", "Per-key");
+  }
+
+  {
+    const size_t buckets = 1 << 20;
+    ts_stl::SyncFixedHashMap<size_t, size_t> m(buckets);
+    std::cout << "SyncFixedHashMap lock memory for " << buckets
+              << " buckets: (per-bucket shared_mutex)"
+              << buckets * sizeof(std::shared_mutex) << "B vs ("
+              << m.stripe_size() << " padded stripes)"
+              << m.stripe_size() *
+                     sizeof(ts_stl::CacheLinePadded<std::shared_mutex>)
+              << "B" << std::endl;
+  }
+
+  Benchmark(
+      [] {
+        ts_stl::SyncFixedHashMap<size_t, size_t, std::hash<size_t>,
+                                 std::equal_to<size_t>,
+                                 ts_stl::PowerOfTwoBucketPolicy,
+                                 ts_stl::SpinSharedMutex>
+            m(T6);
+        ContendedOps(m, kThreads);
+      },
+      [] {
+        ts_stl::SyncFixedHashMap<size_t, size_t> m(T6);
+        ContendedOps(m, kThreads);
+      },
+      "SyncFixedHashMap contended", "SpinSharedMutex", "shared_mutex");
+
   Benchmark(
       [] {
-        ts_stl::Map<size_t, size_t> m;
-        for (int i = 0; i < T5; ++i) {
+        ts_stl::SyncFixedHashMap<size_t, size_t, std::hash<size_t>,
+                                 std::equal_to<size_t>,
+                                 ts_stl::PowerOfTwoBucketPolicy,
+                                 ts_stl::SeqLock>
+            m(T6);
+        ContendedOps(m, kThreads);
+      },
+      [] {
+        ts_stl::SyncFixedHashMap<size_t, size_t, std::hash<size_t>,
+                                 std::equal_to<size_t>,
+                                 ts_stl::PowerOfTwoBucketPolicy,
+                                 ts_stl::SpinSharedMutex>
+            m(T6);
+        ContendedOps(m, kThreads);
+      },
+      "SyncFixedHashMap optimistic reads", "SeqLock", "SpinSharedMutex");
+
+  Benchmark(
+      [] {
+        ts_stl::LockFreeHashMap<size_t, size_t> m;
+        ContendedOps(m, kThreads);
+      },
+      [] {
+        ts_stl::SyncHashMap<size_t, size_t> m;
+        ContendedOps(m, kThreads);
+      },
+      "HashMap contended", "LockFreeHashMap", "SyncHashMap");
+
+  // T6 counter updates over 1e4 keys, split over 1 to 64 threads
+  for (size_t threads = 1; threads <= 64; threads *= 2) {
+    auto count = [threads](auto add) {
+      std::vector<std::thread> workers;
+      for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([add, t, threads] {
+          for (size_t i = t; i < T6; i += threads) {
+            add(i * 2654435761u % 10000);
+          }
+        });
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+    };
+    std::string name =
+        "Counting with " + std::to_string(threads) + " threads";
+    Benchmark(
+        [count] {
+          ts_stl::ShardedHashMap<size_t, size_t> m;
+          count([&m](size_t key) { m.Add(key, 1); });
+          m.Fold();
+        },
+        [count] {
+          ts_stl::SyncFixedHashMap<size_t, size_t> m(10000);
+          count([&m](size_t key) {
+            m.Upsert(key, [](size_t &value) { ++value; }, 1);
+          });
+        },
+        name.c_str(), "ShardedHashMap", "SyncFixedHashMap", 1000);
+  }
+
+  {
+    ts_stl::HashMap<size_t, size_t> source;
+    for (int i = 0; i < T6; ++i) {
+      source[FastRandom()] = i;
+    }
+    auto start = std::chrono::steady_clock::now();
+    ts_stl::StaticHashMap<size_t, size_t> m1(source);
+    std::cout << "StaticHashMap build of " << T6 << " keys: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << "ms" << std::endl;
+    ts_stl::FixedHashMap<size_t, size_t> m2(T6);
+    source.ForEach([&m2](size_t key, size_t value) { m2.Insert(key, value); });
+    std::vector<size_t> queries;
+    source.ForEach([&queries](size_t key, size_t) { queries.push_back(key); });
+    // Bucket order would favour FixedHashMap, which shares the bucket hash
+    std::shuffle(queries.begin(), queries.end(), std::mt19937_64(T6));
+    size_t sum = 0;
+    Benchmark(
+        [&] {
+          for (size_t key : queries) {
+            sum += m1[key];
+          }
+        },
+        [&] {
+          for (size_t key : queries) {
+            sum += m2[key];
+          }
+        },
+        "StaticHashMap lookup", "StaticHashMap", "FixedHashMap");
+    std::cout << "(checksum " << sum << ")" << std::endl;
+  }
+
+  {
+    // Keys sharing their low 20 bits, so std::hash alone would collide
+    std::vector<size_t> keys(T6);
+    for (int i = 0; i < T6; ++i) {
+      keys[i] = FastRandom() << 20;
+    }
+    ts_stl::CuckooHashMap<size_t, size_t> m1;
+    ts_stl::FixedHashMap<size_t, size_t> m2(T6);
+    for (int i = 0; i < T6; ++i) {
+      m1.Insert(keys[i], i);
+      m2.Insert(keys[i], i);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(T6));
+    size_t sum = 0;
+    Benchmark(
+        [&] {
+          for (size_t key : keys) {
+            sum += m1[key];
+          }
+        },
+        [&] {
+          for (size_t key : keys) {
+            sum += m2[key];
+          }
+        },
+        "CuckooHashMap lookup", "CuckooHashMap", "FixedHashMap");
+    std::cout << "(checksum " << sum << ")" << std::endl;
+  }
+
+  Benchmark(
+      [] {
+        ts_stl::SyncCuckooHashMap<size_t, size_t, std::hash<size_t>,
+                                  std::equal_to<size_t>, ts_stl::SeqLock>
+            m(T6);
+        ContendedOps(m, kThreads);
+      },
+      [] {
+        ts_stl::SyncFixedHashMap<size_t, size_t, std::hash<size_t>,
+                                 std::equal_to<size_t>,
+                                 ts_stl::PowerOfTwoBucketPolicy,
+                                 ts_stl::SeqLock>
+            m(T6);
+        ContendedOps(m, kThreads);
+      },
+      "Optimistic reads contended", "SyncCuckooHashMap", "SyncFixedHashMap");
+
+  {
+    // T6 lookups, 80% of them for absent keys
+    std::vector<size_t> keys(T6), queries(T6);
+    std::vector<std::string> names(T6), name_queries(T6);
+    for (int i = 0; i < T6; ++i) {
+      keys[i] = FastRandom();
+      names[i] = "user/" + std::to_string(keys[i]) + "/session";
+    }
+    for (int i = 0; i < T6; ++i) {
+      queries[i] = i % 5 == 0 ? keys[FastRandom(0, T6 - 1)] : FastRandom();
+      name_queries[i] = "user/" + std::to_string(queries[i]) + "/session";
+    }
+    ts_stl::HashMap<std::string, size_t, std::hash<std::string>,
+                    std::equal_to<std::string>,
+                    ts_stl::PowerOfTwoBucketPolicy, ts_stl::InlineBucket,
+                    ts_stl::CountingBloomFilter>
+        m1;
+    ts_stl::HashMap<std::string, size_t> m2;
+    ts_stl::SyncFixedHashMap<size_t, size_t, std::hash<size_t>,
+                             std::equal_to<size_t>,
+                             ts_stl::PowerOfTwoBucketPolicy, std::shared_mutex,
+                             ts_stl::CountingBloomFilter>
+        m3(T6);
+    ts_stl::SyncFixedHashMap<size_t, size_t> m4(T6);
+    for (int i = 0; i < T6; ++i) {
+      m1.Insert(names[i], i);
+      m2.Insert(names[i], i);
+      m3.Insert(keys[i], i);
+      m4.Insert(keys[i], i);
+    }
+    size_t hits = 0;
+    auto lookup = [&hits](auto &m, const auto &queries) {
+      for (auto &key : queries) {
+        hits += m.Contains(key);
+      }
+    };
+    Benchmark([&] { lookup(m1, name_queries); },
+              [&] { lookup(m2, name_queries); },
+              "HashMap<std::string> negative lookups", "CountingBloomFilter",
+              "NoFilter");
+    Benchmark([&] { lookup(m3, queries); }, [&] { lookup(m4, queries); },
+              "SyncFixedHashMap negative lookups", "CountingBloomFilter",
+              "NoFilter");
+    std::cout << "(hits " << hits << ")" << std::endl;
+  }
+
+  Benchmark(
+      [] {
+        ts_stl::FlatHashMap<size_t, size_t> m;
+        for (int i = 0; i < T6; ++i) {
           size_t x = FastRandom(), y = FastRandom();
           m[x] = y;
         }
+        size_t hits = 0;
+        for (int i = 0; i < T6; ++i) {
+          hits += m.Contains(FastRandom());
+        }
+        (void)hits;
       },
       [] {
-        std::map<size_t, size_t> m;
-        for (int i = 0; i < T5; ++i) {
+        std::unordered_map<size_t, size_t> m;
+        for (int i = 0; i < T6; ++i) {
           size_t x = FastRandom(), y = FastRandom();
           m[x] = y;
         }
+        size_t hits = 0;
+        for (int i = 0; i < T6; ++i) {
+          hits += m.count(FastRandom());
+        }
+        (void)hits;
       },
-      "Map");
+      "FlatHashMap");
+
+  {
+    std::vector<std::pair<size_t, size_t>> input(T6);
+    for (auto &[key, value] : input) {
+      key = FastRandom();
+      value = FastRandom();
+    }
+    Benchmark(
+        [&input] {
+          ts_stl::HashMap<size_t, size_t> m;
+          m.BulkBuild(input);
+        },
+        [&input] {
+          ts_stl::HashMap<size_t, size_t> m;
+          m.Reserve(input.size());
+          for (auto &[key, value] : input) {
+            m.Insert(key, value);
+          }
+        },
+        "HashMap build", "BulkBuild", "Insert");
+  }
+
+  {
+    // T6 lookups split over threads, keys skewed towards the small ones so
+    // that a cache of 1e4 entries hits most of them
+    auto lookups = [](auto get) {
+      std::vector<std::thread> workers;
+      for (size_t t = 0; t < kThreads; ++t) {
+        workers.emplace_back([get, t] {
+          size_t x = t * 2654435761u + 1;
+          for (size_t i = t; i < T6; i += kThreads) {
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+            size_t r = (x >> 33) % T6;
+            get(r * r / T6 / 8);
+          }
+        });
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+    };
+    Benchmark(
+        [lookups] {
+          ts_stl::ConcurrentCache<size_t, size_t> cache(10000);
+          lookups([&cache](size_t key) {
+            size_t value;
+            if (!cache.Get(key, value)) {
+              cache.Put(key, key);
+            }
+          });
+        },
+        [lookups] {
+          // LRU list under one lock, what the cache replaces
+          std::mutex m;
+          std::list<std::pair<size_t, size_t>> order;
+          std::unordered_map<size_t, decltype(order)::iterator> index;
+          lookups([&](size_t key) {
+            std::lock_guard<std::mutex> lock(m);
+            if (auto it = index.find(key); it != index.end()) {
+              order.splice(order.begin(), order, it->second);
+              return;
+            }
+            if (order.size() == 10000) {
+              index.erase(order.back().first);
+              order.pop_back();
+            }
+            order.emplace_front(key, key);
+            index[key] = order.begin();
+          });
+        },
+        "Cache contended", "ConcurrentCache", "Locked LRU");
+  }
+
+  {
+    // T6 operations split over threads, one insert with a short ttl per 4
+    // lookups
+    auto ops = [](auto insert, auto contains) {
+      std::vector<std::thread> workers;
+      for (size_t t = 0; t < kThreads; ++t) {
+        workers.emplace_back([insert, contains, t] {
+          size_t x = t * 2654435761u + 1;
+          for (size_t i = t; i < T6; i += kThreads) {
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+            size_t key = (x >> 33) % T6;
+            if (i % 5 == 0) {
+              insert(key);
+            } else {
+              contains(key);
+            }
+          }
+        });
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+    };
+    const auto ttl = std::chrono::milliseconds(5);
+    Benchmark(
+        [ops, ttl] {
+          ts_stl::TtlHashMap<size_t, size_t> m;
+          ops([&m, ttl](size_t key) { m.Insert(key, key, ttl); },
+              [&m](size_t key) { m.Contains(key); });
+        },
+        [ops, ttl] {
+          // One map under a lock, swept in full every 1e4 inserts
+          using Clock = std::chrono::steady_clock;
+          std::mutex m;
+          std::unordered_map<size_t, Clock::time_point> deadline;
+          size_t inserts = 0;
+          ops(
+              [&](size_t key) {
+                std::lock_guard<std::mutex> lock(m);
+                auto now = Clock::now();
+                deadline[key] = now + ttl;
+                if (++inserts % 10000 == 0) {
+                  for (auto it = deadline.begin(); it != deadline.end();) {
+                    it = it->second <= now ? deadline.erase(it) : ++it;
+                  }
+                }
+              },
+              [&](size_t key) {
+                std::lock_guard<std::mutex> lock(m);
+                auto it = deadline.find(key);
+                (void)(it != deadline.end() && it->second > Clock::now());
+              });
+        },
+        "TTL contended", "TtlHashMap", "Swept map");
+  }
+
+  // 1e8 keys would take about 6GB as std::map nodes, so sizes stop at T7
+  for (size_t n : {T5, T6, T7}) {
+    // n random inserts, a lookup of each key and an in-order scan
+    auto ops = [n](auto &m, auto contains) {
+      size_t x = n, hits = 0;
+      for (size_t i = 0; i < n; ++i) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        m[x >> 16] = i;
+      }
+      x = n;
+      for (size_t i = 0; i < n; ++i) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        hits += contains(m, x >> 16);
+      }
+      for (auto [key, value] : m) {
+        hits += value;
+      }
+      return hits;
+    };
+    auto contains = [](auto &m, size_t key) { return m.Contains(key); };
+    auto count = [](auto &m, size_t key) { return m.count(key) != 0; };
+    std::string name = "Map with " + std::to_string(n) + " keys";
+    Benchmark(
+        [ops, contains] {
+          ts_stl::BTreeMap<size_t, size_t> m;
+          ops(m, contains);
+        },
+        [ops, count] {
+          std::map<size_t, size_t> m;
+          ops(m, count);
+        },
+        name.c_str(), "BTreeMap", "std::map", 1000);
+    Benchmark(
+        [ops, contains] {
+          ts_stl::Map<size_t, size_t> m;
+          ops(m, contains);
+        },
+        [ops, count] {
+          std::map<size_t, size_t> m;
+          ops(m, count);
+        },
+        name.c_str(), "Map", "std::map", 1000);
+  }
+
+  {
+    // T6 random inserts, half of them deleted and reinserted, a scan and
+    // teardown
+    auto churn = [](auto &m) {
+      size_t sum = 0;
+      for (size_t i = 0; i < T6; ++i) {
+        m.Insert(i * 2654435761u % T7, i);
+      }
+      for (size_t i = 0; i < T6; i += 2) {
+        m.Delete(i * 2654435761u % T7);
+      }
+      for (size_t i = 0; i < T6; i += 2) {
+        m.Insert(i * 2654435761u % T7, i);
+      }
+      for (auto [key, value] : m) {
+        sum += value;
+      }
+      m.Clear();
+      return sum;
+    };
+    Benchmark(
+        [churn] {
+          ts_stl::Map<size_t, size_t> m;
+          churn(m);
+        },
+        [churn] {
+          ts_stl::Map<size_t, size_t, std::less<size_t>,
+                      std::allocator<std::pair<const size_t, size_t>>>
+              m;
+          churn(m);
+        },
+        "Map allocator", "PoolAllocator", "std::allocator");
+  }
+
+  {
+    // What SyncMap replaces, a Map behind one lock
+    struct LockedMap {
+      std::mutex m;
+      ts_stl::Map<size_t, size_t> map;
+
+      // Keeps the unused lookups from being optimized out
+      size_t hits = 0;
+
+      void Insert(size_t key, size_t value) {
+        std::lock_guard<std::mutex> lock(m);
+        map.Insert(key, value);
+      }
+
+      auto Contains(size_t key) -> bool {
+        std::lock_guard<std::mutex> lock(m);
+        bool found = map.Contains(key);
+        hits += found;
+        return found;
+      }
+    };
+    Benchmark(
+        [] {
+          ts_stl::SyncMap<size_t, size_t> m;
+          ContendedOps(m, kThreads);
+        },
+        [] {
+          LockedMap m;
+          ContendedOps(m, kThreads);
+        },
+        "Map contended", "SyncMap", "Locked Map");
+  }
   return 0;
 }
\ No newline at end of file
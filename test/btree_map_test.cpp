@@ -0,0 +1,152 @@
+#include "src/btree_map.h"
+#include "test_utils.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+TEST(BTreeMapTest, BasicTest) {
+  ts_stl::BTreeMap<int, int> map1;
+  ASSERT_EQ(map1.begin(), map1.end());
+  ASSERT_EQ(map1.back(), map1.end());
+
+  map1.Insert(1, 10);
+  map1.Insert(2, 20);
+  map1.Insert(3, 30);
+  ASSERT_EQ(map1.Size(), 3);
+
+  ts_stl::BTreeMap<int, int> map2(map1);
+  ASSERT_EQ(map1.Size(), map2.Size());
+  for (auto i1 = map1.begin(), i2 = map2.begin(); i1 != map1.end();
+       ++i1, ++i2) {
+    ASSERT_EQ((*i1).first, (*i2).first);
+    ASSERT_EQ((*i1).second, (*i2).second);
+  }
+
+  ts_stl::BTreeMap<int, int> map3(std::move(map2));
+  ASSERT_EQ(map2.Size(), 0);
+  ASSERT_EQ(map3.Size(), 3);
+
+  map1[4] = 40;
+  ASSERT_EQ(map1.Size(), 4);
+  ASSERT_EQ(map1[4], 40);
+
+  ASSERT_TRUE(map1.Delete(2));
+  ASSERT_TRUE(map1.Delete(3));
+  ASSERT_FALSE(map1.Delete(3));
+  ASSERT_EQ(map1.Size(), 2);
+  ASSERT_TRUE(map1.Contains(1));
+  ASSERT_FALSE(map1.Contains(2));
+  ASSERT_TRUE(map1.Contains(4));
+  ASSERT_EQ(map1.Find(1), map1.begin());
+  ASSERT_EQ(map1.Find(2), map1.end());
+  ASSERT_EQ(map1.Find(4), map1.back());
+  ASSERT_EQ(--map1.end(), map1.back());
+  ASSERT_EQ(++map1.back(), map1.end());
+
+  map1.Delete(1);
+  map1.Delete(4);
+  ASSERT_TRUE(map1.Empty());
+  ASSERT_EQ(map1.begin(), map1.end());
+}
+
+TEST(BTreeMapTest, RandomTest) {
+  // Small keys keep splits, borrows and merges happening on every level
+  ts_stl::BTreeMap<size_t, size_t> map1;
+  std::map<size_t, size_t> map2;
+
+  const int T = 2e5;
+  for (int i = 0; i < T; ++i) {
+    size_t key = Random(0, 20000);
+    size_t value = Random();
+    if (Random(0, 2) == 0) {
+      ASSERT_EQ(map1.Delete(key), map2.erase(key) != 0);
+    } else {
+      map1.Insert(key, value);
+      map2[key] = value;
+    }
+    ASSERT_EQ(map1.Size(), map2.size());
+  }
+
+  for (int i = 0; i < 20000; ++i) {
+    size_t key = Random(0, 20001);
+    ASSERT_EQ(map1.Contains(key), map2.count(key) != 0);
+
+    auto it1 = map1.FindGE(key);
+    auto it2 = map2.lower_bound(key);
+    ASSERT_EQ(it1 == map1.end(), it2 == map2.end());
+    if (it2 != map2.end()) {
+      ASSERT_EQ((*it1).first, it2->first);
+    }
+    it1 = map1.FindG(key);
+    it2 = map2.upper_bound(key);
+    ASSERT_EQ(it1 == map1.end(), it2 == map2.end());
+    if (it2 != map2.end()) {
+      ASSERT_EQ((*it1).first, it2->first);
+    }
+
+    it1 = map1.FindL(key);
+    it2 = map2.lower_bound(key);
+    ASSERT_EQ(it1 == map1.end(), it2 == map2.begin());
+    if (it2 != map2.begin()) {
+      ASSERT_EQ((*it1).first, std::prev(it2)->first);
+    }
+    it1 = map1.FindLE(key);
+    it2 = map2.upper_bound(key);
+    ASSERT_EQ(it1 == map1.end(), it2 == map2.begin());
+    if (it2 != map2.begin()) {
+      ASSERT_EQ((*it1).first, std::prev(it2)->first);
+    }
+  }
+
+  std::vector<std::pair<size_t, size_t>> v1, v2, v3;
+  for (auto [key, value] : map1) {
+    v1.emplace_back(key, value);
+  }
+  for (auto [key, value] : map2) {
+    v2.emplace_back(key, value);
+  }
+  ASSERT_EQ(v1, v2);
+
+  // Backwards through a copy
+  const ts_stl::BTreeMap<size_t, size_t> map3(map1);
+  for (auto it = map3.back(); it != map3.end(); --it) {
+    v3.emplace_back((*it).first, (*it).second);
+  }
+  std::reverse(v3.begin(), v3.end());
+  ASSERT_EQ(v3, v2);
+
+  for (auto [key, value] : map2) {
+    ASSERT_TRUE(map1.Delete(key));
+  }
+  ASSERT_TRUE(map1.Empty());
+  ASSERT_EQ(map3.Size(), map2.size());
+}
+
+TEST(BTreeMapTest, TransparentTest) {
+  ts_stl::BTreeMap<std::string, int, std::less<>> map1;
+  for (int i = 0; i < 100; ++i) {
+    map1.Insert(std::to_string(i * 2), i);
+  }
+
+  std::string_view key = "42";
+  ASSERT_TRUE(map1.Contains(key));
+  ASSERT_FALSE(map1.Contains(std::string_view("43")));
+  ASSERT_EQ((*map1.Find(key)).second, 21);
+  ASSERT_EQ(map1.Find("43"), map1.end());
+  ASSERT_EQ((*map1.FindL(std::string_view("43"))).first, "42");
+  ASSERT_EQ((*map1.FindLE(std::string_view("42"))).first, "42");
+  ASSERT_EQ((*map1.FindG(std::string_view("42"))).first, "44");
+  ASSERT_EQ((*map1.FindGE(std::string_view("43"))).first, "44");
+
+  const auto &map2 = map1;
+  ASSERT_EQ(map2[key], 21);
+  ASSERT_EQ((*map2.FindGE(key)).first, "42");
+
+  map1["abc"] = 7;
+  ASSERT_EQ(map1[std::string_view("abc")], 7);
+  ASSERT_EQ(map1.Size(), 101);
+}
@@ -0,0 +1,76 @@
+#include "src/cache.h"
+#include "test_utils.h"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(CacheTest, ConcurrentCacheTest) {
+  ts_stl::ConcurrentCache<int, std::string> cache(4, 1);
+  EXPECT_EQ(cache.segment_size(), 1);
+  for (int i = 0; i < 4; ++i) {
+    cache.Put(i, std::to_string(i));
+  }
+  EXPECT_EQ(cache.size(), 4);
+
+  // A hit protects an entry from the next eviction
+  std::string value;
+  EXPECT_TRUE(cache.Get(0, value));
+  EXPECT_EQ(value, "0");
+  cache.Put(4, "4");
+  EXPECT_EQ(cache.size(), 4);
+  EXPECT_TRUE(cache.Contains(0));
+  EXPECT_FALSE(cache.Contains(1));
+  EXPECT_FALSE(cache.Get(1, value));
+
+  EXPECT_TRUE(cache.Delete(2));
+  EXPECT_FALSE(cache.Delete(2));
+  cache.Put(5, "5");
+  EXPECT_EQ(cache.size(), 4);
+  EXPECT_TRUE(cache.Contains(3));
+
+  EXPECT_EQ(cache.GetOrCompute(6, [] { return std::string("6"); }), "6");
+  EXPECT_EQ(cache.GetOrCompute(6, [] { return std::string("x"); }), "6");
+
+  auto stats = cache.Stats();
+  EXPECT_EQ(stats.hits, 2);
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.evictions, 2);
+
+  cache.Clear();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_FALSE(cache.Contains(6));
+}
+
+TEST(CacheTest, ConcurrentCacheCapacityTest) {
+  const size_t C = 1000, T = 100000, N = 8;
+  ts_stl::ConcurrentCache<size_t, size_t> cache(C, 16);
+  EXPECT_EQ(cache.capacity(), C);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&cache, t] {
+      for (size_t i = t; i < T; i += N) {
+        // A small hot set among many cold keys
+        size_t key = i / N % 4 ? i % 101 : T + i;
+        size_t value;
+        if (cache.Get(key, value)) {
+          EXPECT_EQ(value, key * 2);
+        } else {
+          cache.Put(key, key * 2);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(cache.size(), C);
+  for (size_t key = 0; key < 101; ++key) {
+    EXPECT_TRUE(cache.Contains(key));
+  }
+  auto stats = cache.Stats();
+  EXPECT_EQ(stats.hits + stats.misses, T);
+  EXPECT_GE(stats.misses - stats.evictions, cache.size());
+}
@@ -0,0 +1,200 @@
+#include "src/cuckoo_hashmap.h"
+#include "test_utils.h"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+TEST(CuckooHashMapTest, CuckooHashMapTest) {
+  ts_stl::CuckooHashMap<size_t, size_t> m1;
+  std::unordered_map<size_t, size_t> m2;
+
+  const size_t T = 100000;
+  for (size_t i = 0; i < T; ++i) {
+    size_t x = Random(0, T), y = Random();
+    if (i % 4 == 0) {
+      EXPECT_EQ(m1.Delete(x), m2.erase(x) == 1);
+    } else if (i % 4 == 1) {
+      m1[x] = y;
+      m2[x] = y;
+    } else {
+      m1.Insert(x, y);
+      m2[x] = y;
+    }
+  }
+  EXPECT_EQ(m1.size(), m2.size());
+  for (size_t i = 0; i < T * 2; ++i) {
+    EXPECT_EQ(m1.Contains(i), m2.find(i) != m2.end());
+    if (m1.Contains(i)) {
+      EXPECT_EQ(*m1.Find(i), m2[i]);
+    }
+  }
+
+  auto m3 = m1;
+  m1.Clear();
+  EXPECT_TRUE(m1.Empty());
+  EXPECT_FALSE(m1.Contains(m2.begin()->first));
+  EXPECT_EQ(m3.size(), m2.size());
+  for (auto &[key, value] : m2) {
+    EXPECT_EQ(m3[key], value);
+  }
+}
+
+TEST(CuckooHashMapTest, MoveTest) {
+  // A moved-from map is empty and usable
+  ts_stl::CuckooHashMap<int, int> a;
+  a.Insert(1, 1);
+  auto b = std::move(a);
+  EXPECT_EQ(a.size(), 0);
+  EXPECT_FALSE(a.Contains(1));
+  EXPECT_EQ(b[1], 1);
+
+  auto c = a;
+  EXPECT_TRUE(c.Empty());
+  a.Insert(2, 2);
+  EXPECT_EQ(a[2], 2);
+
+  b = std::move(a);
+  EXPECT_EQ(a.size(), 0);
+  EXPECT_FALSE(b.Contains(1));
+  EXPECT_EQ(b[2], 2);
+  a.Insert(3, 3);
+  EXPECT_EQ(a.size(), 1);
+}
+
+TEST(CuckooHashMapTest, LoadTest) {
+  // Displacement fills the buckets well before the table grows
+  const size_t T = 100000;
+  ts_stl::CuckooHashMap<size_t, size_t> m;
+  m.Reserve(T);
+  size_t bucket_size = m.bucket_size();
+  for (size_t i = 0; i < T; ++i) {
+    m.Insert(i * 7919, i);
+  }
+  EXPECT_EQ(m.bucket_size(), bucket_size);
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_EQ(m[i * 7919], i);
+  }
+
+  // Keys whose std::hash share their low bits still spread out
+  ts_stl::CuckooHashMap<size_t, size_t> skewed;
+  for (size_t i = 0; i < T; ++i) {
+    skewed.Insert(i << 20, i);
+  }
+  EXPECT_LE(skewed.size(), skewed.bucket_size() * ts_stl::kCuckooSlots);
+  EXPECT_GE(skewed.size() * 4, skewed.bucket_size() * ts_stl::kCuckooSlots);
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_EQ(skewed[i << 20], i);
+  }
+}
+
+TEST(CuckooHashMapTest, StringTest) {
+  ts_stl::CuckooHashMap<std::string, std::string> m;
+  for (int i = 0; i < 10000; ++i) {
+    m.Insert("key" + std::to_string(i), std::to_string(i));
+  }
+  for (int i = 0; i < 10000; i += 2) {
+    EXPECT_TRUE(m.Delete("key" + std::to_string(i)));
+  }
+  EXPECT_EQ(m.size(), 5000);
+  for (int i = 0; i < 10000; ++i) {
+    EXPECT_EQ(m.Contains("key" + std::to_string(i)), i % 2 == 1);
+    EXPECT_EQ(m["key" + std::to_string(i)], i % 2 ? std::to_string(i) : "");
+  }
+}
+
+template <typename Mutex> void SyncCuckooHashMapTest() {
+  // Starts small, so inserts displace entries and grow the table
+  ts_stl::SyncCuckooHashMap<size_t, size_t, std::hash<size_t>,
+                            std::equal_to<size_t>, Mutex>
+      m(0, 16);
+  EXPECT_EQ(m.stripe_size(), 16);
+
+  const size_t T = 100000, N = 8;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, t] {
+      for (size_t i = t; i < T; i += N) {
+        m.Insert(i, i * 2);
+      }
+      for (size_t i = t; i < T; i += N * 2) {
+        EXPECT_TRUE(m.Delete(i));
+      }
+      for (size_t i = t; i < T; i += N) {
+        EXPECT_EQ(m.Contains(i), i % (N * 2) >= N);
+        EXPECT_EQ(m[i], i % (N * 2) >= N ? i * 2 : 0);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(m.size(), T / 2);
+  EXPECT_GE(m.bucket_size() * ts_stl::kCuckooSlots, T / 2);
+}
+
+TEST(CuckooHashMapTest, SyncCuckooHashMapTest) {
+  SyncCuckooHashMapTest<std::shared_mutex>();
+  SyncCuckooHashMapTest<ts_stl::SpinSharedMutex>();
+  SyncCuckooHashMapTest<ts_stl::SeqLock>();
+}
+
+TEST(CuckooHashMapTest, SyncCuckooHashMapOptimisticTest) {
+  ts_stl::SyncCuckooHashMap<size_t, size_t, std::hash<size_t>,
+                            std::equal_to<size_t>, ts_stl::SeqLock>
+      m(0, 4);
+
+  // Readers find every key while entries move and the table grows
+  const size_t T = 50000, N = 4;
+  std::atomic<size_t> inserted(0);
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, &inserted, &done, t] {
+      while (!done.load()) {
+        size_t n = inserted.load();
+        for (size_t i = t; i < n; i += N * 16) {
+          EXPECT_EQ(m[i], i * 2);
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < T; ++i) {
+    m.Insert(i, i * 2);
+    inserted.store(i + 1);
+  }
+  done.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(m.size(), T);
+}
+
+TEST(CuckooHashMapTest, UpsertTest) {
+  ts_stl::SyncCuckooHashMap<size_t, size_t> m;
+  const size_t T = 10000, N = 8;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m] {
+      for (size_t i = 0; i < T; ++i) {
+        m.Upsert(i % 100, [](size_t &value) { ++value; }, 1);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(m[i], T * N / 100);
+  }
+  EXPECT_EQ(m.ComputeIfAbsent(1000, [] { return 7; }), 7);
+  EXPECT_EQ(m.ComputeIfAbsent(1000, [] { return 8; }), 7);
+  EXPECT_FALSE(m.InsertIfAbsent(1000, 9));
+  EXPECT_FALSE(m.EraseIf(1000, [](size_t value) { return value != 7; }));
+  EXPECT_TRUE(m.EraseIf(1000, [](size_t value) { return value == 7; }));
+  EXPECT_TRUE(m.InsertIfAbsent(1000, 9));
+  EXPECT_EQ(m[1000], 9);
+  EXPECT_EQ(m.size(), 101);
+}
@@ -0,0 +1,91 @@
+#include "src/filter.h"
+#include "test_utils.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+TEST(FilterTest, NoFilterTest) {
+  ts_stl::NoFilter filter;
+  filter.Reset(100);
+  filter.Add(1);
+  EXPECT_TRUE(filter.MayContain(1));
+  EXPECT_TRUE(filter.MayContain(2));
+}
+
+TEST(FilterTest, CountingBloomFilterTest) {
+  const size_t T = 100000;
+  ts_stl::CountingBloomFilter filter(T);
+  for (size_t i = 0; i < T; ++i) {
+    filter.Add(i);
+  }
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_TRUE(filter.MayContain(i));
+  }
+
+  size_t false_positives = 0;
+  for (size_t i = T; i < T * 2; ++i) {
+    false_positives += filter.MayContain(i);
+  }
+  EXPECT_LT(false_positives, T / 20);
+
+  // Removing half the keys keeps the rest and frees most counters
+  for (size_t i = 0; i < T; i += 2) {
+    filter.Remove(i);
+  }
+  size_t remaining = 0;
+  for (size_t i = 0; i < T; ++i) {
+    if (i % 2) {
+      EXPECT_TRUE(filter.MayContain(i));
+    } else {
+      remaining += filter.MayContain(i);
+    }
+  }
+  EXPECT_LT(remaining, T / 40);
+
+  ts_stl::CountingBloomFilter copy(filter);
+  for (size_t i = 1; i < T; i += 2) {
+    EXPECT_TRUE(copy.MayContain(i));
+  }
+
+  filter.Reset(T);
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_FALSE(filter.MayContain(i));
+  }
+}
+
+TEST(FilterTest, CountingBloomFilterSaturationTest) {
+  ts_stl::CountingBloomFilter filter(16);
+  // Counters stuck at 15 are never decremented, so nothing is lost
+  for (int i = 0; i < 100; ++i) {
+    filter.Add(7);
+  }
+  for (int i = 0; i < 99; ++i) {
+    filter.Remove(7);
+  }
+  EXPECT_TRUE(filter.MayContain(7));
+}
+
+TEST(FilterTest, SyncCountingBloomFilterTest) {
+  const size_t T = 100000, N = 8;
+  ts_stl::CountingBloomFilter filter(T);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&filter, t] {
+      for (size_t i = t; i < T; i += N) {
+        filter.Add(i);
+        EXPECT_TRUE(filter.MayContain(i));
+      }
+      for (size_t i = t; i < T; i += N * 2) {
+        filter.Remove(i);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (size_t i = 0; i < T; ++i) {
+    if (i % (N * 2) >= N) {
+      EXPECT_TRUE(filter.MayContain(i));
+    }
+  }
+}
@@ -0,0 +1,97 @@
+#include "src/frozen_hashmap.h"
+#include "test_utils.h"
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <string>
+#include <unordered_map>
+
+TEST(FrozenHashMapTest, BasicTest) {
+  std::string path = testing::TempDir() + "frozen_hashmap_test.bin";
+  ts_stl::HashMap<size_t, double> m1;
+  std::unordered_map<size_t, double> m2;
+
+  size_t T = 100000;
+  for (size_t i = 0; i < T; ++i) {
+    size_t x = Random(0, T * 2);
+    double y = static_cast<double>(Random());
+    m1.Insert(x, y);
+    m2[x] = y;
+  }
+  ASSERT_TRUE(ts_stl::Freeze(m1, path.c_str()));
+
+  ts_stl::FrozenHashMap<size_t, double> frozen;
+  EXPECT_FALSE(frozen.IsOpen());
+  EXPECT_FALSE(frozen.Contains(0));
+  ASSERT_TRUE(frozen.Open(path.c_str()));
+  EXPECT_EQ(frozen.size(), m2.size());
+  for (size_t i = 0; i <= T * 2; ++i) {
+    EXPECT_EQ(frozen.Contains(i), m2.find(i) != m2.end());
+    EXPECT_EQ(frozen[i], m2.count(i) ? m2[i] : 0.0);
+  }
+
+  // A second view shares the mapping, the first keeps working after a move
+  ts_stl::FrozenHashMap<size_t, double> moved(std::move(frozen));
+  ts_stl::FrozenHashMap<size_t, double> other;
+  ASSERT_TRUE(other.Open(path.c_str()));
+  for (auto &[key, value] : m2) {
+    ASSERT_NE(moved.Find(key), nullptr);
+    EXPECT_EQ(*moved.Find(key), value);
+    EXPECT_EQ(other[key], value);
+  }
+
+  // Images of other types, corrupt images and missing files are rejected
+  ts_stl::FrozenHashMap<uint32_t, double> wrong_type;
+  EXPECT_FALSE(wrong_type.Open(path.c_str()));
+  std::FILE *file = std::fopen(path.c_str(), "r+b");
+  ASSERT_NE(file, nullptr);
+  std::fputc('X', file);
+  std::fclose(file);
+  EXPECT_FALSE(other.Open(path.c_str()));
+  EXPECT_FALSE(other.IsOpen());
+  EXPECT_FALSE(other.Open((path + ".missing").c_str()));
+
+  // Freezing over an open image replaces the file, the old mapping stays
+  ts_stl::HashMap<size_t, double> empty;
+  ASSERT_TRUE(ts_stl::Freeze(empty, path.c_str()));
+  ASSERT_TRUE(other.Open(path.c_str()));
+  EXPECT_EQ(other.size(), 0);
+  EXPECT_FALSE(other.Contains(0));
+  EXPECT_EQ(moved.size(), m2.size());
+  for (auto &[key, value] : m2) {
+    EXPECT_EQ(moved[key], value);
+  }
+  std::remove(path.c_str());
+}
+
+auto ReadFile(const std::string &path) -> std::string {
+  std::string content;
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (file != nullptr) {
+    char buffer[4096];
+    for (size_t n; (n = std::fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+      content.append(buffer, n);
+    }
+    std::fclose(file);
+  }
+  return content;
+}
+
+TEST(FrozenHashMapTest, ReproducibleTest) {
+  std::string path1 = testing::TempDir() + "frozen_hashmap_test1.bin";
+  std::string path2 = testing::TempDir() + "frozen_hashmap_test2.bin";
+  // Entries of uint32_t keys and uint64_t values are padded
+  ts_stl::HashMap<uint32_t, uint64_t> m;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    m.Insert(i * 7, i);
+  }
+  ASSERT_TRUE(ts_stl::Freeze(m, path1.c_str()));
+  ASSERT_TRUE(ts_stl::Freeze(m, path2.c_str()));
+  EXPECT_FALSE(ReadFile(path1).empty());
+  EXPECT_EQ(ReadFile(path1), ReadFile(path2));
+
+  // Images can't be written to a missing directory
+  EXPECT_FALSE(ts_stl::Freeze(
+      m, (testing::TempDir() + "missing/frozen_hashmap_test.bin").c_str()));
+  std::remove(path1.c_str());
+  std::remove(path2.c_str());
+}
@@ -1,6 +1,13 @@
 #include "src/hashmap.h"
 #include "test_utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 TEST(HashMapTest, FixedHashMapTest) {
   ts_stl::FixedHashMap<int, size_t> m1(1000);
@@ -21,7 +28,119 @@ TEST(HashMapTest, FixedHashMapTest) {
   }
 }
 
-TEST(HashMapTest, SyncFixedHashMapTest) {}
+template <typename Mutex, typename Filter = ts_stl::NoFilter>
+void SyncFixedHashMapTest() {
+  ts_stl::SyncFixedHashMap<size_t, size_t, std::hash<size_t>,
+                           std::equal_to<size_t>,
+                           ts_stl::PowerOfTwoBucketPolicy, Mutex, Filter>
+      m(1000, std::hash<size_t>(), std::equal_to<size_t>(), 16);
+  EXPECT_EQ(m.stripe_size(), 16);
+
+  const size_t T = 100000, N = 8;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, t] {
+      for (size_t i = t; i < T; i += N) {
+        m.Insert(i, i * 2);
+      }
+      for (size_t i = t; i < T; i += N * 2) {
+        EXPECT_TRUE(m.Delete(i));
+      }
+      for (size_t i = t; i < T; i += N) {
+        EXPECT_EQ(m.Contains(i), i % (N * 2) >= N);
+        EXPECT_EQ(m[i], i % (N * 2) >= N ? i * 2 : 0);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(m.size(), T / 2);
+}
+
+TEST(HashMapTest, SyncFixedHashMapTest) {
+  SyncFixedHashMapTest<std::shared_mutex>();
+  SyncFixedHashMapTest<ts_stl::SpinSharedMutex>();
+  SyncFixedHashMapTest<ts_stl::SeqLock>();
+}
+
+TEST(HashMapTest, FilterTest) {
+  // A filter never hides a key, with or without concurrent writers
+  SyncFixedHashMapTest<std::shared_mutex, ts_stl::CountingBloomFilter>();
+  SyncFixedHashMapTest<ts_stl::SeqLock, ts_stl::CountingBloomFilter>();
+
+  ts_stl::HashMap<size_t, size_t, std::hash<size_t>, std::equal_to<size_t>,
+                  ts_stl::PowerOfTwoBucketPolicy, ts_stl::InlineBucket,
+                  ts_stl::CountingBloomFilter>
+      m1;
+  std::unordered_map<size_t, size_t> m2;
+
+  const size_t T = 100000;
+  for (size_t i = 0; i < T; ++i) {
+    size_t x = Random(0, T), y = Random();
+    if (i % 4 == 0) {
+      EXPECT_EQ(m1.Delete(x), m2.erase(x) == 1);
+    } else if (i % 4 == 1) {
+      m1[x] = y;
+      m2[x] = y;
+    } else {
+      m1.Insert(x, y);
+      m2[x] = y;
+    }
+  }
+  EXPECT_EQ(m1.size(), m2.size());
+  for (size_t i = 0; i < T * 2; ++i) {
+    EXPECT_EQ(m1.Contains(i), m2.find(i) != m2.end());
+    if (m1.Contains(i)) {
+      EXPECT_EQ(m1[i], m2[i]);
+    }
+  }
+
+  m1.Clear();
+  EXPECT_FALSE(m1.Contains(0));
+  m1.Insert(0, 1);
+  EXPECT_EQ(*m1.Find(0), 1);
+}
+
+TEST(HashMapTest, SyncFixedHashMapOptimisticTest) {
+  ts_stl::SyncFixedHashMap<size_t, size_t, std::hash<size_t>,
+                           std::equal_to<size_t>,
+                           ts_stl::PowerOfTwoBucketPolicy, ts_stl::SeqLock>
+      m(64, std::hash<size_t>(), std::equal_to<size_t>(), 4);
+
+  // Readers never see a torn or stale-buffer value while buckets grow
+  const size_t T = 20000, N = 4;
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, &done, t] {
+      while (!done.load()) {
+        for (size_t i = t; i < T; i += N * 16) {
+          size_t value = m[i];
+          EXPECT_TRUE(value == 0 || value == i * 2 || value == i * 3);
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < T; ++i) {
+    m.Insert(i, i * 2);
+    if (i % 3 == 0) {
+      m.Insert(i, i * 3);
+    }
+    if (i % 5 == 0) {
+      EXPECT_TRUE(m.Delete(i));
+    }
+  }
+  done.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(m.size(), T - T / 5);
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_EQ(m.Contains(i), i % 5 != 0);
+  }
+}
 
 TEST(HashMapTest, HashMapTest) {
   return;
@@ -41,4 +160,451 @@ TEST(HashMapTest, HashMapTest) {
       EXPECT_EQ(m1[i], m2[i]);
     }
   }
-}
\ No newline at end of file
+}
+
+TEST(HashMapTest, SyncHashMapTest) {
+  ts_stl::SyncHashMap<size_t, size_t> m(4);
+
+  const size_t T = 100000, N = 8;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, t] {
+      for (size_t i = t; i < T; i += N) {
+        m.Insert(i, i * 2);
+      }
+      for (size_t i = t; i < T; i += N * 2) {
+        EXPECT_TRUE(m.Delete(i));
+      }
+      for (size_t i = t; i < T; i += N) {
+        EXPECT_EQ(m.Contains(i), i % (N * 2) >= N);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(m.size(), T / 2);
+  EXPECT_GE(m.bucket_size() * 2.0, m.size());
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_EQ(m.Contains(i), i % (N * 2) >= N);
+    EXPECT_EQ(m[i], m.Contains(i) ? i * 2 : 0);
+  }
+}
+
+template <typename Map> void SyncUpsertTest(Map &m) {
+  const size_t T = 10000, K = 100, N = 8;
+  std::atomic<size_t> created(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, &created] {
+      for (size_t i = 0; i < T; ++i) {
+        m.Upsert(i % K, [](size_t &count) { ++count; }, 1);
+        EXPECT_EQ(m.ComputeIfAbsent(K + i % K,
+                                    [&created, i] {
+                                      created.fetch_add(1);
+                                      return i % K;
+                                    }),
+                  i % K);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(created.load(), K);
+  for (size_t i = 0; i < K; ++i) {
+    EXPECT_EQ(m[i], T / K * N);
+  }
+
+  EXPECT_FALSE(m.InsertIfAbsent(0, 7));
+  EXPECT_TRUE(m.InsertIfAbsent(K * 2, 7));
+  EXPECT_EQ(m[K * 2], 7);
+  EXPECT_FALSE(
+      m.EraseIf(K * 2, [](const size_t &value) { return value != 7; }));
+  EXPECT_TRUE(
+      m.EraseIf(K * 2, [](const size_t &value) { return value == 7; }));
+  EXPECT_FALSE(m.EraseIf(K * 2, [](const size_t &) { return true; }));
+  EXPECT_EQ(m.size(), K * 2);
+}
+
+TEST(HashMapTest, UpsertTest) {
+  ts_stl::SyncFixedHashMap<size_t, size_t> m1(64, std::hash<size_t>(),
+                                             std::equal_to<size_t>(), 4);
+  SyncUpsertTest(m1);
+
+  ts_stl::SyncFixedHashMap<size_t, size_t, std::hash<size_t>,
+                           std::equal_to<size_t>,
+                           ts_stl::PowerOfTwoBucketPolicy, ts_stl::SeqLock>
+      m2(64, std::hash<size_t>(), std::equal_to<size_t>(), 4);
+  SyncUpsertTest(m2);
+
+  ts_stl::SyncHashMap<size_t, size_t> m3(4);
+  SyncUpsertTest(m3);
+
+  ts_stl::SyncHashMap<size_t, size_t, std::hash<size_t>, std::equal_to<size_t>,
+                      std::shared_mutex, ts_stl::Vector>
+      m4(4);
+  SyncUpsertTest(m4);
+}
+
+TEST(HashMapTest, LockFreeHashMapTest) {
+  ts_stl::LockFreeHashMap<size_t, size_t> m;
+
+  const size_t T = 100000, N = 8;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, t] {
+      for (size_t i = t; i < T; i += N) {
+        m.Insert(i, i);
+        m.Insert(i, i * 2);
+      }
+      for (size_t i = t; i < T; i += N * 2) {
+        EXPECT_TRUE(m.Delete(i));
+        EXPECT_FALSE(m.Delete(i));
+      }
+      for (size_t i = t; i < T; i += N) {
+        EXPECT_EQ(m.Contains(i), i % (N * 2) >= N);
+        EXPECT_EQ(m[i], i % (N * 2) >= N ? i * 2 : 0);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(m.size(), T / 2);
+  EXPECT_GE(m.bucket_size() * 4.0, m.size());
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_EQ(m.Contains(i), i % (N * 2) >= N);
+  }
+
+  ts_stl::LockFreeHashMap<size_t, std::string> m1;
+  std::unordered_map<size_t, std::string> m2;
+  for (size_t i = 0; i < T; ++i) {
+    size_t x = Random(0, T / 4);
+    if (Random(0, 3) == 0) {
+      EXPECT_EQ(m1.Delete(x), m2.erase(x) != 0);
+    } else {
+      std::string y = std::to_string(Random());
+      m1.Insert(x, y);
+      m2[x] = y;
+    }
+  }
+  EXPECT_EQ(m1.size(), m2.size());
+  for (size_t i = 0; i <= T / 4; ++i) {
+    EXPECT_EQ(m1.Contains(i), m2.find(i) != m2.end());
+    EXPECT_EQ(m1[i], m2[i]);
+  }
+}
+
+TEST(HashMapTest, LockFreeHashMapDeleteInsertTest) {
+  // Every key has one writer while others delete it. A write that meets an
+  // entry being deleted inserts a new one, so the writer reads its own value
+  // back unless a later Delete removed it.
+  ts_stl::LockFreeHashMap<size_t, size_t> m;
+  const size_t T = 100000, K = 4;
+  std::atomic<size_t> done(0);
+  std::atomic<size_t> deleted(0);
+  std::vector<std::thread> threads;
+  for (size_t k = 0; k < K; ++k) {
+    threads.emplace_back([&, k] {
+      for (size_t i = 1; i <= T; ++i) {
+        size_t before = deleted.load();
+        m.Insert(k, i);
+        size_t value = m[k];
+        if (value != i) {
+          EXPECT_EQ(value, 0);
+          // Only a Delete that marked the entry after the Insert may have
+          // removed it, and it is counted once it returns
+          auto deadline =
+              std::chrono::steady_clock::now() + std::chrono::seconds(10);
+          while (deleted.load() == before &&
+                 std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+          }
+          EXPECT_NE(deleted.load(), before);
+        }
+      }
+      done.fetch_add(1);
+    });
+    threads.emplace_back([&, k] {
+      while (done.load() < K) {
+        if (m.Delete(k)) {
+          deleted.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  size_t present = 0;
+  for (size_t k = 0; k < K; ++k) {
+    present += m.Contains(k);
+    m.Insert(k, T + 1);
+    EXPECT_EQ(m[k], T + 1);
+  }
+  EXPECT_LE(present, K);
+  EXPECT_EQ(m.size(), K);
+}
+
+struct MaxMerge {
+  void operator()(size_t &into, const size_t &value) const {
+    into = std::max(into, value);
+  }
+};
+
+TEST(HashMapTest, ShardedHashMapTest) {
+  ts_stl::ShardedHashMap<size_t, size_t> m;
+  ts_stl::ShardedHashMap<size_t, size_t, MaxMerge> max;
+
+  const size_t T = 100000, K = 1000, N = 8;
+  std::atomic<size_t> finished(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&, t] {
+      for (size_t i = 0; i < T; ++i) {
+        m.Add(i % K, 1);
+        max.Add(i % K, i * N + t);
+      }
+      finished.fetch_add(1);
+    });
+  }
+  // Folds and reads race with the writers
+  while (finished.load() < N) {
+    m.Fold();
+    EXPECT_LE(m.Get(0), T / K * N);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(m.shard_size(), N);
+  auto snapshot = m.Snapshot();
+  EXPECT_EQ(snapshot.size(), K);
+  for (size_t i = 0; i < K; ++i) {
+    EXPECT_EQ(snapshot[i], T / K * N);
+    EXPECT_EQ(m.Get(i), T / K * N);
+    EXPECT_EQ(max.Get(i), (T - K + i) * N + N - 1);
+  }
+  m.Fold();
+  EXPECT_EQ(m.Get(K - 1), T / K * N);
+  EXPECT_EQ(m.Get(K), 0);
+
+  // Short-lived maps leave nothing behind in the writing thread
+  for (size_t i = 0; i < K; ++i) {
+    ts_stl::ShardedHashMap<size_t, size_t> temporary;
+    temporary.Add(i, i);
+    EXPECT_EQ(temporary.Get(i), i);
+    EXPECT_EQ(temporary.shard_size(), 1);
+  }
+}
+
+TEST(HashMapTest, FlatHashMapTest) {
+  ts_stl::FlatHashMap<size_t, std::string> m1;
+  std::unordered_map<size_t, std::string> m2;
+
+  size_t T = 100000;
+  for (size_t i = 0; i < T; ++i) {
+    size_t x = Random(0, T / 4);
+    if (Random(0, 3) == 0) {
+      EXPECT_EQ(m1.Delete(x), m2.erase(x) != 0);
+    } else {
+      std::string y = std::to_string(Random());
+      m1.Insert(x, y);
+      m2[x] = y;
+    }
+    EXPECT_EQ(m1.size(), m2.size());
+  }
+
+  ts_stl::FlatHashMap<size_t, std::string> m3(m1);
+  for (size_t i = 0; i <= T / 4; ++i) {
+    EXPECT_EQ(m1.Contains(i), m2.find(i) != m2.end());
+    EXPECT_EQ(m3.Contains(i), m2.find(i) != m2.end());
+    if (m1.Contains(i)) {
+      EXPECT_EQ(m1[i], m2[i]);
+      EXPECT_EQ(m3[i], m2[i]);
+    }
+  }
+  EXPECT_LE(m1.size(), m1.bucket_size());
+}
+
+template <typename BucketPolicy,
+          template <typename> class Bucket = ts_stl::InlineBucket>
+void BucketPolicyTest() {
+  ts_stl::HashMap<size_t, size_t, std::hash<size_t>, std::equal_to<size_t>,
+                  BucketPolicy, Bucket>
+      m1;
+  ts_stl::FixedHashMap<size_t, size_t, std::hash<size_t>,
+                       std::equal_to<size_t>, BucketPolicy, Bucket>
+      m2(1000);
+
+  size_t T = 100000;
+  for (size_t i = 0; i < T; ++i) {
+    m1.Insert(i << 10, i);
+    m2.Insert(i << 10, i);
+  }
+  EXPECT_EQ(m1.size(), T);
+  EXPECT_EQ(m2.size(), T);
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_TRUE(m1.Contains(i << 10));
+    EXPECT_FALSE(m1.Contains((i << 10) + 1));
+    EXPECT_EQ(m1[i << 10], i);
+    EXPECT_EQ(m2[i << 10], i);
+  }
+  for (size_t i = 0; i < T; i += 2) {
+    EXPECT_TRUE(m1.Delete(i << 10));
+  }
+  EXPECT_EQ(m1.size(), T / 2);
+}
+
+TEST(HashMapTest, BucketPolicyTest) {
+  BucketPolicyTest<ts_stl::ModuloBucketPolicy>();
+  BucketPolicyTest<ts_stl::PowerOfTwoBucketPolicy>();
+  BucketPolicyTest<ts_stl::FastRangeBucketPolicy>();
+  BucketPolicyTest<ts_stl::PowerOfTwoBucketPolicy, ts_stl::Vector>();
+
+  ts_stl::PowerOfTwoBucketPolicy policy;
+  EXPECT_EQ(policy.Reset(1000), 1024);
+  for (size_t i = 0; i < 1000; ++i) {
+    EXPECT_LT(policy.Index(Random()), 1024);
+  }
+}
+
+TEST(HashMapTest, ReserveTest) {
+  ts_stl::HashMap<size_t, std::string> m;
+  size_t T = 100000;
+  m.Reserve(T);
+  size_t bucket_size = m.bucket_size();
+  EXPECT_GE(bucket_size * 2.0, T);
+
+  for (size_t i = 0; i < T; ++i) {
+    m.Insert(i, std::to_string(i));
+  }
+  EXPECT_EQ(m.bucket_size(), bucket_size);
+
+  m.Resize(T * 4);
+  EXPECT_EQ(m.size(), T);
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_EQ(m[i], std::to_string(i));
+  }
+}
+
+TEST(HashMapTest, TransparentTest) {
+  ts_stl::HashMap<std::string, int, ts_stl::StringHash, std::equal_to<>> m;
+  for (int i = 0; i < 1000; ++i) {
+    m.Insert(std::to_string(i), i);
+  }
+
+  std::string_view key = "42";
+  EXPECT_TRUE(m.Contains(key));
+  EXPECT_TRUE(m.Contains("999"));
+  EXPECT_FALSE(m.Contains(std::string_view("1000")));
+  EXPECT_EQ(m[key], 42);
+
+  const auto &cm = m;
+  EXPECT_EQ(cm["7"], 7);
+  EXPECT_EQ(cm[std::string_view("1000")], 0);
+  EXPECT_EQ(m.size(), 1000);
+
+  m["1000"] = 1000;
+  EXPECT_EQ(m.size(), 1001);
+  EXPECT_TRUE(m.Delete(std::string_view("1000")));
+  EXPECT_FALSE(m.Delete("1000"));
+  EXPECT_EQ(m.size(), 1000);
+}
+
+TEST(HashMapTest, BatchTest) {
+  ts_stl::HashMap<size_t, size_t> m1;
+  ts_stl::FixedHashMap<size_t, size_t> m2(1000);
+
+  const size_t T = 10000;
+  std::vector<size_t> keys(T), values(T);
+  for (size_t i = 0; i < T; ++i) {
+    keys[i] = Random(0, T * 2);
+    values[i] = Random();
+  }
+  m1.InsertBatch(keys.data(), values.data(), T);
+  m2.InsertBatch(keys.data(), values.data(), T);
+
+  std::unordered_map<size_t, size_t> expected;
+  for (size_t i = 0; i < T; ++i) {
+    expected[keys[i]] = values[i];
+  }
+  EXPECT_EQ(m1.size(), expected.size());
+  EXPECT_EQ(m2.size(), expected.size());
+
+  std::vector<size_t> queries(T * 2);
+  for (size_t i = 0; i < T * 2; ++i) {
+    queries[i] = i;
+  }
+  std::vector<const size_t *> r1(T * 2), r2(T * 2);
+  m1.FindBatch(queries.data(), T * 2, r1.data());
+  m2.FindBatch(queries.data(), T * 2, r2.data());
+  for (size_t i = 0; i < T * 2; ++i) {
+    auto it = expected.find(i);
+    if (it == expected.end()) {
+      EXPECT_EQ(r1[i], nullptr);
+      EXPECT_EQ(r2[i], nullptr);
+    } else {
+      ASSERT_NE(r1[i], nullptr);
+      ASSERT_NE(r2[i], nullptr);
+      EXPECT_EQ(*r1[i], it->second);
+      EXPECT_EQ(*r2[i], it->second);
+    }
+  }
+}
+
+TEST(HashMapTest, BulkBuildTest) {
+  // Duplicate keys, the last value of each wins as with Insert()
+  const size_t T = 200000;
+  std::vector<std::pair<size_t, size_t>> input(T);
+  std::unordered_map<size_t, size_t> expected;
+  for (size_t i = 0; i < T; ++i) {
+    input[i] = {Random(0, T / 2), i};
+    expected[input[i].first] = i;
+  }
+
+  ts_stl::HashMap<size_t, size_t> m1;
+  m1.Insert(T * 2, 1);
+  m1.BulkBuild(input, 4);
+  EXPECT_EQ(m1.size(), expected.size() + 1);
+  for (auto &[key, value] : expected) {
+    EXPECT_EQ(m1[key], value);
+  }
+  EXPECT_EQ(m1[T * 2], 1);
+
+  ts_stl::HashMap<size_t, size_t, std::hash<size_t>, std::equal_to<size_t>,
+                  ts_stl::ModuloBucketPolicy, ts_stl::InlineBucket,
+                  ts_stl::CountingBloomFilter>
+      m2;
+  m2.BulkBuild(input);
+  EXPECT_EQ(m2.size(), expected.size());
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_EQ(m2.Contains(i), expected.count(i) == 1);
+  }
+
+  std::atomic<size_t> count(0), sum(0);
+  m1.ForEachParallel(
+      [&](const size_t &key, size_t &value) {
+        ++count;
+        sum += key;
+        ++value;
+      },
+      4);
+  size_t expected_sum = T * 2;
+  for (auto &[key, value] : expected) {
+    expected_sum += key;
+  }
+  EXPECT_EQ(count, m1.size());
+  EXPECT_EQ(sum, expected_sum);
+  EXPECT_EQ(m1[T * 2], 2);
+
+  const auto &m3 = m2;
+  count = 0;
+  m3.ForEachParallel([&](const size_t &, const size_t &) { ++count; });
+  EXPECT_EQ(count, m3.size());
+}
@@ -1,8 +1,13 @@
 #include "src/map.h"
 #include "test_utils.h"
+#include <atomic>
 #include <gtest/gtest.h>
+#include <iterator>
 #include <map>
 #include <random>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -92,4 +97,272 @@ TEST(MapTest, RandomTest) {
     v2.emplace_back(key, value);
   }
   ASSERT_EQ(v1, v2);
-}
\ No newline at end of file
+}
+
+TEST(MapTest, TransparentTest) {
+  ts_stl::Map<std::string, int, std::less<>> map1;
+  for (int i = 0; i < 100; ++i) {
+    map1.Insert(std::to_string(i * 2), i);
+  }
+
+  std::string_view key = "42";
+  ASSERT_TRUE(map1.Contains(key));
+  ASSERT_TRUE(map1.Contains("42"));
+  ASSERT_FALSE(map1.Contains(std::string_view("43")));
+  ASSERT_EQ((*map1.Find(key)).second, 21);
+  ASSERT_EQ(map1.Find("43"), map1.end());
+  ASSERT_EQ((*map1.FindL(std::string_view("43"))).first, "42");
+  ASSERT_EQ((*map1.FindLE(std::string_view("42"))).first, "42");
+  ASSERT_EQ((*map1.FindG(std::string_view("42"))).first, "44");
+  ASSERT_EQ((*map1.FindGE(std::string_view("43"))).first, "44");
+
+  const auto &map2 = map1;
+  ASSERT_EQ(map2[key], 21);
+  ASSERT_EQ((*map2.Find(key)).second, 21);
+  ASSERT_EQ((*map2.FindGE(key)).first, "42");
+
+  map1["abc"] = 7;
+  ASSERT_EQ(map1[std::string_view("abc")], 7);
+  ASSERT_EQ(map1.Size(), 101);
+}
+
+TEST(MapTest, SplitTest) {
+  const size_t T = 1e5;
+  ts_stl::Map<size_t, size_t> map1;
+  for (size_t i = 0; i < T; ++i) {
+    map1.Insert(i * 2, i);
+  }
+  ts_stl::Map<size_t, size_t> map2(map1);
+
+  auto map3 = map1.SplitL(T);
+  auto map4 = map2.SplitLE(T);
+  ASSERT_EQ(map1.Size(), T / 2);
+  ASSERT_EQ(map3.Size(), T / 2);
+  ASSERT_EQ(map2.Size(), T / 2 + 1);
+  ASSERT_EQ(map4.Size(), T / 2 - 1);
+  ASSERT_EQ((*map1.back()).first, T - 2);
+  ASSERT_EQ((*map3.begin()).first, T);
+  ASSERT_EQ((*map4.begin()).first, T + 2);
+
+  // Parent links are walked both ways
+  size_t key = T;
+  for (auto [k, v] : map3) {
+    ASSERT_EQ(k, key);
+    key += 2;
+  }
+  ASSERT_EQ(key, T * 2);
+  size_t count = 0;
+  for (auto it = map2.back(); it != map2.end(); --it) {
+    ASSERT_EQ((*it).first, T - count * 2);
+    ++count;
+  }
+  ASSERT_EQ(count, map2.Size());
+
+  ASSERT_TRUE(map3.Delete(T));
+  ASSERT_FALSE(map3.Contains(T));
+  map3.Clear();
+  ASSERT_TRUE(map3.Empty());
+  ASSERT_EQ(map3.begin(), map3.end());
+}
+
+TEST(MapTest, AllocatorTest) {
+  // Non-trivial values are destroyed before the pool is dropped
+  ts_stl::Map<size_t, std::string> map1;
+  for (size_t i = 0; i < 1000; ++i) {
+    map1.Insert(i, std::string(100, 'a'));
+  }
+  for (size_t i = 0; i < 1000; i += 2) {
+    map1.Delete(i);
+  }
+  ts_stl::Map<size_t, std::string> map2(map1);
+  map1.Insert(0, "0");
+  ASSERT_EQ(map1.Size(), 501);
+  ASSERT_EQ(map2.Size(), 500);
+
+  // The smaller half of a split is copied into a pool of its own
+  auto map3 = map1.SplitL(500);
+  map1.Clear();
+  ASSERT_EQ(map3.Size(), 250);
+  ASSERT_EQ(map3[501], std::string(100, 'a'));
+  map3.Insert(1000, "1000");
+  map3 = std::move(map2);
+  ASSERT_EQ(map3.Size(), 500);
+  ASSERT_EQ((*map3.begin()).first, 1);
+
+  ts_stl::Map<int, int, std::less<int>,
+              std::allocator<std::pair<const int, int>>>
+      map4;
+  for (int i = 0; i < 1000; ++i) {
+    map4[i] = i;
+  }
+  auto map5 = map4.SplitLE(499);
+  ASSERT_EQ(map4.Size(), 500);
+  ASSERT_EQ(map5.Size(), 500);
+  map4.Clear();
+  ASSERT_TRUE(map4.Empty());
+}
+
+TEST(MapTest, SplitThreadTest) {
+  // The halves of a split share no pool, so each may change on its own thread
+  const size_t T = 20000;
+  ts_stl::Map<size_t, size_t> map1;
+  for (size_t i = 0; i < T; ++i) {
+    map1.Insert(i, i);
+  }
+  auto map2 = map1.SplitL(T / 4);
+  auto map3 = map2.SplitLE(T / 2);
+  ASSERT_EQ(map1.Size(), T / 4);
+  ASSERT_EQ(map2.Size(), T / 4 + 1);
+  ASSERT_EQ(map3.Size(), T / 2 - 1);
+
+  std::vector<std::thread> threads;
+  for (auto map : {&map1, &map2, &map3}) {
+    threads.emplace_back([map, T] {
+      for (size_t i = 0; i < T; ++i) {
+        size_t key = T + i * 3;
+        map->Insert(key, i);
+        if (i % 2 == 0) {
+          map->Delete(key);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(map1.Size(), T / 4 + T / 2);
+  ASSERT_EQ(map2.Size(), T / 4 + 1 + T / 2);
+  ASSERT_EQ(map3.Size(), T / 2 - 1 + T / 2);
+  ASSERT_EQ((*map1.begin()).first, 0);
+  ASSERT_EQ((*map2.begin()).first, T / 4);
+  ASSERT_EQ((*map3.begin()).first, T / 2 + 1);
+}
+
+TEST(MapTest, ConcurrentBuildTest) {
+  // Independent maps built at once share no state
+  const size_t T = 10000, N = 4;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([T] {
+      ts_stl::Map<size_t, size_t> map;
+      for (size_t i = 0; i < T; ++i) {
+        map.Insert(i * 7 % T, i);
+      }
+      EXPECT_EQ(map.Size(), T);
+      size_t key = 0;
+      for (auto [k, v] : map) {
+        EXPECT_EQ(k, key++);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+TEST(MapTest, SyncMapTest) {
+  ts_stl::SyncMap<size_t, size_t> map1;
+  std::map<size_t, size_t> map2;
+
+  const int T = 1e5;
+  for (int i = 0; i < T; ++i) {
+    size_t key = Random(0, T), value = Random();
+    if (i % 3 == 0) {
+      ASSERT_EQ(map1.Delete(key), map2.erase(key) == 1);
+    } else {
+      map1.Insert(key, value);
+      map2[key] = value;
+    }
+  }
+  ASSERT_EQ(map1.Size(), map2.size());
+
+  std::pair<size_t, size_t> entry;
+  using Entry = std::pair<size_t, size_t>;
+  for (int i = 0; i < 1000; ++i) {
+    size_t key = Random(0, T + 1);
+    auto it = map2.lower_bound(key);
+    ASSERT_EQ(map1.FindGE(key, entry), it != map2.end());
+    if (it != map2.end()) {
+      ASSERT_EQ(entry, Entry(*it));
+    }
+    ASSERT_EQ(map1.FindL(key, entry), it != map2.begin());
+    if (it != map2.begin()) {
+      ASSERT_EQ(entry, Entry(*std::prev(it)));
+    }
+    it = map2.upper_bound(key);
+    ASSERT_EQ(map1.FindG(key, entry), it != map2.end());
+    if (it != map2.end()) {
+      ASSERT_EQ(entry, Entry(*it));
+    }
+    ASSERT_EQ(map1.FindLE(key, entry), it != map2.begin());
+    if (it != map2.begin()) {
+      ASSERT_EQ(entry, Entry(*std::prev(it)));
+    }
+    ASSERT_EQ(map1.Contains(key), map2.count(key) == 1);
+    ASSERT_EQ(map1[key], map2.count(key) ? map2[key] : 0);
+  }
+
+  std::vector<std::pair<size_t, size_t>> v1, v2;
+  map1.ForEachRange(T / 4, T / 2, [&](size_t key, size_t value) {
+    v1.emplace_back(key, value);
+  });
+  for (auto it = map2.lower_bound(T / 4); it->first < T / 2; ++it) {
+    v2.push_back(*it);
+  }
+  ASSERT_EQ(v1, v2);
+  v1.clear();
+  map1.ForEach([&](size_t key, size_t value) { v1.emplace_back(key, value); });
+  v2.assign(map2.begin(), map2.end());
+  ASSERT_EQ(v1, v2);
+}
+
+TEST(MapTest, SyncMapConcurrentTest) {
+  ts_stl::SyncMap<size_t, size_t> map;
+  const size_t T = 100000, N = 4;
+  std::atomic<bool> done(false);
+
+  // Scans stay sorted and only see values written for their key
+  std::thread scanner([&map, &done] {
+    while (!done.load()) {
+      size_t last = 0, count = 0;
+      map.ForEach([&](size_t key, size_t value) {
+        EXPECT_TRUE(count == 0 || last < key);
+        EXPECT_EQ(value, key * 2);
+        last = key;
+        ++count;
+      });
+    }
+  });
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&map, t] {
+      for (size_t i = t; i < T; i += N) {
+        map.Insert(i, i * 2);
+      }
+      for (size_t i = t; i < T; i += N * 2) {
+        EXPECT_TRUE(map.Delete(i));
+      }
+      std::pair<size_t, size_t> entry;
+      for (size_t i = t; i < T; i += N) {
+        EXPECT_EQ(map.Contains(i), i % (N * 2) >= N);
+        // Keys of the other threads may or may not be there yet
+        if (map.FindGE(i, entry)) {
+          EXPECT_GE(entry.first, i);
+          EXPECT_EQ(entry.second, entry.first * 2);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  done.store(true);
+  scanner.join();
+  EXPECT_EQ(map.Size(), T / 2);
+  size_t count = 0;
+  map.ForEach([&](size_t key, size_t) {
+    EXPECT_GE(key % (N * 2), N);
+    ++count;
+  });
+  EXPECT_EQ(count, T / 2);
+}
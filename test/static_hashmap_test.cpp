@@ -0,0 +1,73 @@
+#include "src/static_hashmap.h"
+#include "test_utils.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+TEST(StaticHashMapTest, HashMapTest) {
+  ts_stl::HashMap<size_t, size_t> m1;
+  std::unordered_map<size_t, size_t> m2;
+
+  size_t T = 100000;
+  for (size_t i = 0; i < T; ++i) {
+    size_t x = Random(0, T * 2), y = Random();
+    m1[x] = y;
+    m2[x] = y;
+  }
+
+  ts_stl::StaticHashMap<size_t, size_t> m3(m1);
+  EXPECT_EQ(m3.size(), m2.size());
+  for (size_t i = 0; i <= T * 2; ++i) {
+    EXPECT_EQ(m3.Contains(i), m2.find(i) != m2.end());
+    EXPECT_EQ(m3[i], m2.count(i) ? m2[i] : 0);
+  }
+}
+
+TEST(StaticHashMapTest, RangeTest) {
+  std::vector<std::pair<std::string, int>> entries;
+  for (int i = 0; i < 1000; ++i) {
+    entries.emplace_back("key" + std::to_string(i), i);
+  }
+  ts_stl::StaticHashMap<std::string, int> m(entries.begin(), entries.end());
+  EXPECT_EQ(m.size(), 1000);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_NE(m.Find("key" + std::to_string(i)), nullptr);
+    EXPECT_EQ(*m.Find("key" + std::to_string(i)), i);
+    EXPECT_FALSE(m.Contains("other" + std::to_string(i)));
+  }
+
+  ts_stl::StaticHashMap<std::string, int> empty(entries.end(), entries.end());
+  EXPECT_EQ(empty.size(), 0);
+  EXPECT_FALSE(empty.Contains("key0"));
+  EXPECT_EQ(empty["key0"], 0);
+}
+
+constexpr std::pair<std::string_view, int> kKeywords[] = {
+    {"if", 1},     {"else", 2},   {"while", 3},  {"for", 4},
+    {"return", 5}, {"break", 6},  {"switch", 7}, {"case", 8},
+    {"do", 9},     {"goto", 10},  {"const", 11}, {"static", 12},
+};
+
+constexpr auto kKeywordMap = ts_stl::MakeStaticHashMap(kKeywords);
+
+static_assert(kKeywordMap.size() == 12);
+static_assert(kKeywordMap["while"] == 3);
+static_assert(kKeywordMap["static"] == 12);
+static_assert(!kKeywordMap.Contains("class"));
+
+constexpr std::pair<int, int> kSquares[] = {{1, 1}, {2, 4}, {3, 9},
+                                            {4, 16}, {5, 25}};
+
+static_assert(ts_stl::MakeStaticHashMap(kSquares)[4] == 16);
+
+TEST(StaticHashMapTest, ConstexprTest) {
+  for (auto &[key, value] : kKeywords) {
+    EXPECT_TRUE(kKeywordMap.Contains(key));
+    EXPECT_EQ(*kKeywordMap.Find(key), value);
+  }
+  EXPECT_EQ(kKeywordMap.Find("int"), nullptr);
+  EXPECT_EQ(kKeywordMap["int"], 0);
+}
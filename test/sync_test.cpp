@@ -0,0 +1,232 @@
+#include "src/sync.h"
+#include "test_utils.h"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+TEST(SyncTest, ShardedCounterTest) {
+  ts_stl::ShardedCounter counter(4);
+  EXPECT_EQ(counter.Load(), 0);
+
+  const int T = 100000, N = 8;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < N; ++t) {
+    threads.emplace_back([&counter, t] {
+      for (int i = 0; i < T; ++i) {
+        counter.Add(t % 2 ? -1 : 3);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counter.Load(), static_cast<int64_t>(T) * N);
+
+  counter.Reset();
+  EXPECT_EQ(counter.Load(), 0);
+}
+
+TEST(SyncTest, SpinSharedMutexTest) {
+  ts_stl::SpinSharedMutex m;
+  size_t value = 0;
+
+  const size_t T = 100000, N = 8;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, &value, t] {
+      for (size_t i = 0; i < T; ++i) {
+        if (i % 4 == t % 4) {
+          std::unique_lock<ts_stl::SpinSharedMutex> lock(m);
+          ++value;
+        } else {
+          std::shared_lock<ts_stl::SpinSharedMutex> lock(m);
+          EXPECT_LE(value, T * N);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(value, T * N / 4);
+
+  EXPECT_TRUE(m.try_lock_shared());
+  EXPECT_FALSE(m.try_lock());
+  m.unlock_shared();
+  EXPECT_TRUE(m.try_lock());
+  EXPECT_FALSE(m.try_lock_shared());
+  m.unlock();
+}
+
+TEST(SyncTest, SeqLockTest) {
+  ts_stl::SeqLock m;
+  std::atomic<size_t> a(0), b(0);
+
+  // Writers keep a == b, validated optimistic reads must agree
+  const size_t T = 100000, N = 4;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, &a, &b, t] {
+      for (size_t i = 0; i < T; ++i) {
+        if (i % 4 == t % 4) {
+          std::unique_lock<ts_stl::SeqLock> lock(m);
+          a.store(a.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+          b.store(b.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+        } else {
+          uint64_t version = m.ReadBegin();
+          size_t x = a.load(std::memory_order_relaxed);
+          size_t y = b.load(std::memory_order_relaxed);
+          if (m.ReadValidate(version)) {
+            EXPECT_EQ(x, y);
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(a.load(), T * N / 4);
+
+  EXPECT_TRUE(m.try_lock());
+  EXPECT_FALSE(m.try_lock());
+  m.unlock();
+  uint64_t version = m.ReadBegin();
+  EXPECT_TRUE(m.ReadValidate(version));
+  m.lock();
+  m.unlock();
+  EXPECT_FALSE(m.ReadValidate(version));
+}
+
+struct Tracked {
+  std::atomic<size_t> *deleted;
+
+  ~Tracked() { deleted->fetch_add(1); }
+};
+
+// Outlives the test, retirements may be freed by later ones
+std::atomic<size_t> tracked_deleted(0);
+
+TEST(SyncTest, EpochReclaimerTest) {
+  const size_t T = 10000;
+  {
+    // Nothing retired after a guard was entered is freed while it is held
+    ts_stl::EpochGuard guard;
+    std::thread([] {
+      for (size_t i = 0; i < T; ++i) {
+        ts_stl::Retire(new Tracked{&tracked_deleted});
+      }
+    }).join();
+    EXPECT_EQ(tracked_deleted.load(), 0);
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([] {
+      for (size_t i = 0; i < T; ++i) {
+        ts_stl::EpochGuard guard;
+        ts_stl::Retire(new Tracked{&tracked_deleted});
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_GT(tracked_deleted.load(), 0);
+  EXPECT_LE(tracked_deleted.load(), T * 5);
+}
+
+// Freed nodes are poisoned and parked instead of deleted, so a reader that
+// can still reach one sees it
+struct Guarded {
+  std::atomic<size_t> value;
+};
+
+constexpr size_t kPoison = ~static_cast<size_t>(0);
+
+std::mutex graveyard_m;
+
+std::vector<Guarded *> graveyard;
+
+TEST(SyncTest, EpochReclaimerStressTest) {
+  const size_t T = 100000, N = 4;
+  std::atomic<Guarded *> head(new Guarded{{0}});
+  std::atomic<bool> done(false);
+  std::atomic<size_t> reads(0), poisoned(0);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&] {
+      while (!done.load()) {
+        ts_stl::EpochGuard guard;
+        Guarded *node = head.load(std::memory_order_acquire);
+        for (size_t i = 0; i < 16; ++i) {
+          poisoned += node->value.load(std::memory_order_relaxed) == kPoison;
+          std::this_thread::yield();
+        }
+        ++reads;
+      }
+    });
+  }
+  for (size_t w = 0; w < 2; ++w) {
+    threads.emplace_back([&, w] {
+      for (size_t i = 0; i < T; ++i) {
+        ts_stl::EpochGuard guard;
+        Guarded *old = head.exchange(new Guarded{{i * 2 + w}});
+        ts_stl::EpochReclaimer::Instance().Retire(old, [](void *p) {
+          auto *node = static_cast<Guarded *>(p);
+          node->value.store(kPoison, std::memory_order_relaxed);
+          std::lock_guard<std::mutex> lock(graveyard_m);
+          graveyard.push_back(node);
+        });
+      }
+    });
+  }
+  threads[N].join();
+  threads[N + 1].join();
+  done.store(true);
+  for (size_t t = 0; t < N; ++t) {
+    threads[t].join();
+  }
+  EXPECT_GT(reads.load(), 0);
+  EXPECT_EQ(poisoned.load(), 0);
+  EXPECT_GT(graveyard.size(), 0);
+
+  delete head.load();
+  std::lock_guard<std::mutex> lock(graveyard_m);
+  for (Guarded *node : graveyard) {
+    delete node;
+  }
+  graveyard.clear();
+}
+
+TEST(SyncTest, ThreadRandomTest) {
+  // Threads get their own sequences, each bit is set about half the time
+  const size_t T = 100000;
+  std::vector<std::vector<uint64_t>> values(4);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&values, t] {
+      for (size_t i = 0; i < T; ++i) {
+        values[t].push_back(ts_stl::ThreadRandom());
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_NE(values[0], values[1]);
+  for (size_t bit = 0; bit < 64; ++bit) {
+    size_t ones = 0;
+    for (uint64_t value : values[0]) {
+      ones += value >> bit & 1;
+    }
+    EXPECT_GT(ones, T * 49 / 100);
+    EXPECT_LT(ones, T * 51 / 100);
+  }
+}
@@ -0,0 +1,218 @@
+#include "src/ttl_hashmap.h"
+#include "test_utils.h"
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Moves only when a test advances it
+struct FakeClock {
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<FakeClock>;
+  static constexpr bool is_steady = true;
+
+  static inline std::atomic<rep> ticks{0};
+
+  static auto now() -> time_point { return time_point(duration(ticks.load())); }
+
+  static void Advance(std::chrono::nanoseconds d) { ticks += d.count(); }
+};
+
+using std::chrono::milliseconds;
+
+template <typename K, typename V>
+using FakeTtlHashMap =
+    ts_stl::TtlHashMap<K, V, std::hash<K>, std::equal_to<K>,
+                       std::shared_mutex, FakeClock>;
+
+TEST(TtlHashMapTest, TimerWheelTest) {
+  // Deadlines spread over every level, some past the top one, come out in
+  // order
+  ts_stl::TimerWheel<uint64_t> wheel;
+  std::multimap<uint64_t, uint64_t> expected;
+  for (size_t i = 0; i < 10000; ++i) {
+    uint64_t deadline =
+        Random(0, 1) ? Random(0, 1 << 20) : Random(0, uint64_t(1) << 40);
+    wheel.Schedule(i, deadline);
+    expected.emplace(deadline, i);
+  }
+  EXPECT_EQ(wheel.size(), 10000);
+
+  uint64_t now = 0;
+  while (!expected.empty()) {
+    now = now < (1 << 20) ? now + Random(1, 5000) : now * 2 + Random(0, 64);
+    wheel.Advance(now, SIZE_MAX, [&](uint64_t value, uint64_t deadline) {
+      EXPECT_LE(deadline, now);
+      auto it = expected.begin();
+      EXPECT_LE(it->first, deadline);
+      auto range = expected.equal_range(deadline);
+      bool found = false;
+      for (auto i = range.first; i != range.second; ++i) {
+        if (i->second == value) {
+          expected.erase(i);
+          found = true;
+          break;
+        }
+      }
+      EXPECT_TRUE(found);
+    });
+    EXPECT_EQ(wheel.current(), now);
+    if (!expected.empty()) {
+      EXPECT_GT(expected.begin()->first, now);
+    }
+  }
+  EXPECT_EQ(wheel.size(), 0);
+
+  // A small budget hands items out a few at a time
+  for (size_t i = 0; i < 100; ++i) {
+    wheel.Schedule(i, now + 1 + i % 3);
+  }
+  size_t total = 0;
+  while (!wheel.CaughtUp(now + 3)) {
+    size_t n = wheel.Advance(now + 3, 4, [](uint64_t, uint64_t) {});
+    EXPECT_LE(n, 4);
+    total += n;
+  }
+  EXPECT_EQ(total, 100);
+  EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST(TtlHashMapTest, RescheduleTest) {
+  // Moving or cancelling an item never leaves another one behind
+  ts_stl::TimerWheel<uint64_t> wheel;
+  auto handle = wheel.Schedule(1, 10);
+  auto other = wheel.Schedule(2, 1 << 20);
+  for (uint64_t i = 0; i < 100000; ++i) {
+    wheel.Reschedule(handle, 10 + i % 5000);
+    wheel.Reschedule(other, Random(0, uint64_t(1) << 40));
+    EXPECT_EQ(wheel.size(), 2);
+  }
+  wheel.Reschedule(handle, 5);
+  wheel.Cancel(other);
+  EXPECT_EQ(wheel.size(), 1);
+
+  // Cancelled items are reused by later ones
+  for (uint64_t i = 0; i < 1000; ++i) {
+    wheel.Cancel(wheel.Schedule(i, i));
+  }
+  EXPECT_EQ(wheel.size(), 1);
+
+  std::vector<uint64_t> due;
+  wheel.Advance(uint64_t(1) << 41, SIZE_MAX,
+                [&](uint64_t value, uint64_t deadline) {
+                  EXPECT_EQ(deadline, 5);
+                  due.push_back(value);
+                });
+  EXPECT_EQ(due, std::vector<uint64_t>{1});
+  EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST(TtlHashMapTest, TtlHashMapTest) {
+  FakeTtlHashMap<int, std::string> m(milliseconds(1), 1);
+  m.Insert(1, "1", milliseconds(10));
+  m.Insert(2, "2", milliseconds(20));
+  EXPECT_EQ(m.size(), 2);
+  EXPECT_EQ(m[1], "1");
+  EXPECT_EQ(m.Ttl(2), milliseconds(20));
+
+  FakeClock::Advance(milliseconds(10));
+  EXPECT_FALSE(m.Contains(1));
+  EXPECT_EQ(m[1], "");
+  EXPECT_TRUE(m.Contains(2));
+  EXPECT_EQ(m.Ttl(1), milliseconds(0));
+  EXPECT_EQ(m.Ttl(2), milliseconds(10));
+
+  // Expired but not removed until the wheel gets there
+  EXPECT_EQ(m.size(), 2);
+  EXPECT_EQ(m.Expire(), 1);
+  EXPECT_EQ(m.size(), 1);
+
+  // Reinserting pushes the deadline back
+  m.Insert(2, "two", milliseconds(30));
+  FakeClock::Advance(milliseconds(20));
+  EXPECT_EQ(m.Expire(), 0);
+  EXPECT_EQ(m[2], "two");
+  FakeClock::Advance(milliseconds(10));
+  EXPECT_FALSE(m.Contains(2));
+
+  m.Insert(3, "3", milliseconds(5));
+  EXPECT_TRUE(m.Delete(3));
+  EXPECT_FALSE(m.Delete(3));
+  EXPECT_EQ(m.size(), 0);
+  FakeClock::Advance(milliseconds(5));
+  EXPECT_EQ(m.Expire(), 0);
+
+  // Refreshes move the one wheel item of a key, which expires once
+  for (int i = 0; i < 10000; ++i) {
+    m.Insert(4, "4", milliseconds(10));
+    if (i % 3 == 0) {
+      EXPECT_TRUE(m.Delete(4));
+      m.Insert(4, "4", milliseconds(10));
+    }
+    FakeClock::Advance(milliseconds(1));
+    EXPECT_EQ(m.Expire(), 0);
+  }
+  FakeClock::Advance(milliseconds(9));
+  EXPECT_EQ(m.Expire(), 1);
+  EXPECT_EQ(m.size(), 0);
+}
+
+TEST(TtlHashMapTest, IncrementalExpiryTest) {
+  const size_t T = 10000;
+  FakeTtlHashMap<size_t, size_t> m(milliseconds(1), 4);
+  for (size_t i = 0; i < T; ++i) {
+    m.Insert(i, i, milliseconds(1 + i % 100));
+  }
+  FakeClock::Advance(milliseconds(100));
+  EXPECT_EQ(m.size(), T);
+
+  // Writes remove a bounded number of expired entries each
+  for (size_t i = 0; i < 100; ++i) {
+    m.Insert(T + i, i, milliseconds(1000));
+  }
+  EXPECT_LT(m.size(), T + 100);
+  EXPECT_GE(m.size() + 100 * m.kExpireBudget, T + 100);
+  while (m.Expire(64) != 0) {
+  }
+  EXPECT_EQ(m.size(), 100);
+  for (size_t i = 0; i < T + 100; ++i) {
+    EXPECT_EQ(m.Contains(i), i >= T);
+  }
+}
+
+TEST(TtlHashMapTest, ConcurrentTest) {
+  const size_t T = 100000, N = 8;
+  ts_stl::TtlHashMap<size_t, size_t> m(std::chrono::microseconds(100));
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N; ++t) {
+    threads.emplace_back([&m, t] {
+      for (size_t i = t; i < T; i += N) {
+        // Short lived keys among ones that outlive the test
+        if (i % 2) {
+          m.Insert(i, i * 2, std::chrono::hours(1));
+        } else {
+          m.Insert(i, i * 2, std::chrono::microseconds(i % 1000));
+        }
+        size_t value;
+        if (m.Get(i - i % 2 + 1, value)) {
+          EXPECT_EQ(value, (i - i % 2 + 1) * 2);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::this_thread::sleep_for(milliseconds(2));
+  while (m.Expire(1024) != 0) {
+  }
+  EXPECT_EQ(m.size(), T / 2);
+  for (size_t i = 0; i < T; ++i) {
+    EXPECT_EQ(m.Contains(i), i % 2 == 1);
+  }
+}
@@ -2,6 +2,7 @@
 #include "test_utils.h"
 #include <future>
 #include <gtest/gtest.h>
+#include <string>
 
 TEST(VectorTest, BasicTest) {
   ts_stl::Vector<int> v;
@@ -71,6 +72,43 @@ TEST(VectorTest, InsertTest) {
   ASSERT_TRUE(v.Empty());
 }
 
+TEST(VectorTest, SmallVectorTest) {
+  ts_stl::SmallVector<std::string, 2> v;
+  EXPECT_EQ(v.capacity(), 2);
+  v.PushBack("0");
+  v.EmplaceBack(1, '1');
+  EXPECT_EQ(v.capacity(), 2);
+  for (int i = 2; i < 100; ++i) {
+    v.PushBack(std::to_string(i));
+  }
+  EXPECT_GE(v.capacity(), 100);
+  EXPECT_EQ(v[1], "1");
+  EXPECT_EQ(v.Delete(0), "0");
+  EXPECT_EQ(v.Back(), "99");
+  EXPECT_EQ(v.size(), 99);
+
+  // Copies and moves from both inline and heap storage
+  ts_stl::SmallVector<std::string, 2> w(v), small;
+  small.PushBack("a");
+  EXPECT_EQ(w.size(), 99);
+  EXPECT_EQ(w[0], "1");
+  v = std::move(small);
+  EXPECT_EQ(v.size(), 1);
+  EXPECT_EQ(v[0], "a");
+  EXPECT_TRUE(small.Empty());
+  small = std::move(w);
+  EXPECT_EQ(small.size(), 99);
+  EXPECT_TRUE(w.Empty());
+  EXPECT_EQ(w.capacity(), 2);
+  w = small;
+  EXPECT_EQ(w.PopBack(), "99");
+  ts_stl::SmallVector<std::string, 2> moved(std::move(v));
+  EXPECT_EQ(moved[0], "a");
+
+  moved.Clear();
+  EXPECT_TRUE(moved.Empty());
+}
+
 TEST(VectorTest, SyncTest) {
   for (int t = 0; t < 20; ++t) {
     ts_stl::SyncVector<int> v;